@@ -0,0 +1,72 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2017 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_MACPROTOCOLS_CHANNEL_EMULATOR_H
+#define INCLUDED_MACPROTOCOLS_CHANNEL_EMULATOR_H
+
+#include <macprotocols/api.h>
+#include <macprotocols/mac_clock.h>
+#include <gnuradio/block.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    /*!
+     * \brief Shared wireless medium between the MAC blocks of one flowgraph, in place of PHYs and radios.
+     * \ingroup macprotocols
+     *
+     * Node i connects its "frame to phy" to "frame in<i>", "frame out<i>" to its "frame from phy",
+     * "request to cs" to "cs request<i>" and "cs out<i>" to "cs in". A frame is on the air for
+     * preamble_time + byte_time*length (us) and reaches every other node prop_delay (us) after
+     * it ends. Transmissions of different nodes overlapping in time corrupt each other and reach
+     * nobody. Frames that made it are lost independently at each receiver with probability loss.
+     * CS requests are answered after the requested window, with the average power seen by the node
+     * meanwhile: busy_power while something was on the air, idle_power otherwise (dB). Malformed
+     * requests are dropped.
+     *
+     * Under a virtual clock, the MACs must be on the same clock: frames and CS answers hold it
+     * until the MAC has handled them (see virtual_clock).
+     */
+    class MACPROTOCOLS_API channel_emulator : virtual public gr::block
+    {
+     public:
+      typedef boost::shared_ptr<channel_emulator> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of macprotocols::channel_emulator.
+       *
+       * To avoid accidental use of raw pointers, macprotocols::channel_emulator's
+       * constructor is in a private implementation
+       * class. macprotocols::channel_emulator::make is the public interface for
+       * creating new instances.
+       */
+      static sptr make(int num_nodes, double byte_time, int preamble_time, int prop_delay, double loss, float idle_power, float busy_power, int seed, bool debug);
+
+#ifndef SWIG
+      //! Same block, timed by clock (e.g. a virtual_clock) instead of real time
+      static sptr make(int num_nodes, double byte_time, int preamble_time, int prop_delay, double loss, float idle_power, float busy_power, int seed, bool debug, mac_clock::sptr clock);
+#endif
+    };
+
+  } // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_CHANNEL_EMULATOR_H */
@@ -23,6 +23,7 @@
 #define INCLUDED_MACPROTOCOLS_CSMA_CA_H
 
 #include <macprotocols/api.h>
+#include <macprotocols/mac_clock.h>
 #include <gnuradio/block.h>
 
 namespace gr {
@@ -47,7 +48,16 @@ namespace gr {
        * creating new instances.
        */
 
-      static sptr make(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug);
+      static sptr make(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug, bool aggregation = false, double cs_samp_rate = 0, int rts_threshold = -1);
+
+#ifndef SWIG
+      //! Same block, timed by clock (e.g. a virtual_clock) instead of real time
+      static sptr make(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug, bool aggregation, double cs_samp_rate, int rts_threshold, mac_clock::sptr clock);
+#endif
+
+      //! Counters of the block (dict name -> uint64) and latency histograms (name -> dict of ns
+      //! percentiles), also published on the "stats" port on request
+      virtual pmt::pmt_t stats() = 0;
     };
 
   } // namespace macprotocols
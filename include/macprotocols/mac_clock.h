@@ -0,0 +1,191 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2017 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_MACPROTOCOLS_MAC_CLOCK_H
+#define INCLUDED_MACPROTOCOLS_MAC_CLOCK_H
+
+#include <macprotocols/api.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <vector>
+
+namespace gr {
+  namespace macprotocols {
+
+    /*!
+     * \brief Time source of the MAC blocks.
+     * \ingroup macprotocols
+     *
+     * Every time stamp, sleep and timed wait of a block goes through the clock it was made with.
+     * By default that is the shared real-time clock. A virtual_clock runs the same code in
+     * simulated time instead.
+     */
+    class MACPROTOCOLS_API mac_clock
+    {
+     public:
+      typedef boost::shared_ptr<mac_clock> sptr;
+      typedef std::chrono::high_resolution_clock::time_point time_point;
+      typedef std::chrono::high_resolution_clock::duration duration;
+
+      virtual ~mac_clock() {}
+
+      virtual time_point now() = 0;
+
+      //! Returns at t or a bit later (scheduling latency of the OS)
+      virtual void sleep_until(time_point t) = 0;
+
+      //! Returns at t as precisely as possible. The real-time clock sleeps most of the way and spins the last few us.
+      virtual void spin_until(time_point t) = 0;
+
+      /*!
+       * Waits on cond, with lock held, until pred() holds or deadline is reached. Returns pred().
+       * Whoever makes pred() true must notify cond while holding the mutex of lock.
+       */
+      virtual bool wait_until(boost::unique_lock<boost::mutex> &lock, boost::condition_variable &cond,
+                              time_point deadline, const std::function<bool()> &pred) = 0;
+
+      bool wait(boost::unique_lock<boost::mutex> &lock, boost::condition_variable &cond, const std::function<bool()> &pred) {
+        return wait_until(lock, cond, time_point::max(), pred);
+      }
+
+      void sleep_for(duration d) { sleep_until(now() + d); }
+
+      //! Declares the calling thread as driven by this clock (see virtual_clock). Call it first thing in the thread.
+      virtual void attach() {}
+      virtual void detach() {}
+
+      //! attach() for as long as it is in scope, so that a thread interrupted in a wait detaches on its way out
+      class scoped_attach {
+       public:
+        scoped_attach(mac_clock &clock) : d_clock(clock) { d_clock.attach(); }
+        ~scoped_attach() { d_clock.detach(); }
+
+       private:
+        mac_clock &d_clock;
+      };
+
+      //! Keeps time from moving on while something an attached thread may wait for is under way (see virtual_clock)
+      virtual void hold(int n = 1) {}
+      virtual void release() {}
+
+      //! cond.notify_all(), for waits that go through this clock. Call it with the mutex of the waiters held.
+      virtual void notify_all(boost::condition_variable &cond) { cond.notify_all(); }
+
+      //! Releases one hold when it goes out of scope, e.g. at the end of the handler of a message sent with the clock held
+      class scoped_release {
+       public:
+        scoped_release(mac_clock &clock) : d_clock(clock) {}
+        ~scoped_release() { d_clock.release(); }
+
+       private:
+        mac_clock &d_clock;
+      };
+
+      //! False if now() is unrelated to std::chrono::high_resolution_clock
+      virtual bool is_realtime() const { return true; }
+
+      //! The real-time clock, shared by all blocks made without a clock
+      static sptr realtime();
+    };
+
+    /*!
+     * \brief Simulated time for MAC blocks.
+     * \ingroup macprotocols
+     *
+     * Time only moves when every attached thread is blocked in sleep_until(), spin_until() or
+     * wait_until(). It then jumps to the earliest deadline, and the threads due at it are woken,
+     * in the order they started waiting. Hours of backoffs or superframes thus take as long as the
+     * computation in between, and runs do not depend on the load of the machine.
+     *
+     * Threads that are not attached (message handlers, the flowgraph scheduler) still run in real
+     * time and do not hold time back. Code that works on something an attached thread is waiting
+     * for keeps time still with hold()/release(). Hold the clock as well until every block has
+     * started and attached its threads, or the first ones may run ahead alone.
+     *
+     * Messages between blocks on the clock (frames and CS requests between the MACs and the
+     * channel_emulator) are such work: the sender holds the clock once per subscriber of the port
+     * before publishing, and the handler of each receiver releases it once done, so a frame in a
+     * message queue is never overtaken by a timeout. Blocks that are not on the clock must thus not
+     * be subscribed to those ports. Handlers wake the threads up with notify_all() of the clock,
+     * which counts them as running right away: time does not move before they have seen the news.
+     *
+     * A thread interrupted in a wait (boost::thread::interrupt(), e.g. when its block stops) leaves
+     * it cleanly, and no longer holds time back once it has detached.
+     */
+    class MACPROTOCOLS_API virtual_clock : public mac_clock
+    {
+     public:
+      typedef boost::shared_ptr<virtual_clock> sptr;
+
+      //! Simulation starts at start, or at the current real time if omitted
+      static sptr make(time_point start = time_point());
+
+      time_point now();
+      void sleep_until(time_point t);
+      void spin_until(time_point t);
+      bool wait_until(boost::unique_lock<boost::mutex> &lock, boost::condition_variable &cond,
+                      time_point deadline, const std::function<bool()> &pred);
+      void attach();
+      void detach();
+      bool is_realtime() const { return false; }
+
+      void hold(int n = 1);
+      void release();
+      void notify_all(boost::condition_variable &cond);
+
+      //! Moves time forward by d right away, waking whoever is due meanwhile
+      void advance(duration d);
+
+     private:
+      struct waiter {
+        time_point deadline;
+        boost::mutex *mu; // NULL: sleeping on d_cond
+        boost::condition_variable *cond;
+        uint64_t id;
+        bool attached, woken;
+      };
+
+      virtual_clock(time_point start);
+
+      uint64_t enqueue(time_point deadline, boost::mutex *mu, boost::condition_variable *cond);
+      void dequeue(uint64_t id);
+      std::vector<waiter> advance_if_idle();
+      std::vector<waiter> collect_due();
+      void wake(const std::vector<waiter> &due);
+
+      boost::mutex d_mu;
+      boost::condition_variable d_cond;
+      time_point d_now;
+      std::vector<waiter> d_waiters;
+      std::set<boost::thread::id> d_threads;
+      uint64_t d_next_id;
+      int d_blocked, d_holds; // Attached threads waiting, hold() calls not released yet
+    };
+
+  } // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_MAC_CLOCK_H */
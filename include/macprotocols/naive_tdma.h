@@ -23,6 +23,7 @@
 #define INCLUDED_MACPROTOCOLS_NAIVE_TDMA_H
 
 #include <macprotocols/api.h>
+#include <macprotocols/mac_clock.h>
 #include <gnuradio/block.h>
 
 namespace gr {
@@ -47,6 +48,14 @@ namespace gr {
        * creating new instances.
        */
       static sptr make(bool is_coord, std::vector<uint8_t> src_mac, int slot_time, int alpha, bool debug);
+
+#ifndef SWIG
+      //! Same block, timed by clock (e.g. a virtual_clock) instead of real time
+      static sptr make(bool is_coord, std::vector<uint8_t> src_mac, int slot_time, int alpha, bool debug, mac_clock::sptr clock);
+#endif
+
+      //! Counters of the block (dict name -> uint64), also published on the "stats" port on request
+      virtual pmt::pmt_t stats() = 0;
     };
 
   } // namespace macprotocols
@@ -23,6 +23,7 @@
 #define INCLUDED_MACPROTOCOLS_TDMA_H
 
 #include <macprotocols/api.h>
+#include <macprotocols/mac_clock.h>
 #include <gnuradio/block.h>
 
 namespace gr {
@@ -45,8 +46,27 @@ namespace gr {
        * constructor is in a private implementation
        * class. macprotocols::tdma::make is the public interface for
        * creating new instances.
+       *
+       * comm_slot: length of a comm slot (us), 0 for 2*alpha*slot_time. byte_time: airtime of a byte
+       * (us, PHY overhead included); when set, a node fills its comm slot with as many queued frames
+       * as fit, SIFS apart, instead of sending one frame per superframe. alpha only stretches the slots:
+       * byte_time and sifs are taken as they are, so a frame that does not fit a whole comm slot (max_comm if
+       * set), with its ACK slot, is dropped.
+       * max_comm: length of the comm interval (us) the coordinator shares among the stations in
+       * proportion to the backlog they report (max-min fair), at least min_slot (us, 0 for comm_slot)
+       * each; 0 for equal comm slots. Needs byte_time.
+       * reserve: superframes a node reserves its comm slot for, so that it does not have to ask for it
+       * in each allocation interval (0 for no reservations). An idle reservation is released.
        */
-      static sptr make(bool is_coord, std::vector<uint8_t> src_mac, uint16_t slot_time, uint16_t alpha, bool debug);
+      static sptr make(bool is_coord, std::vector<uint8_t> src_mac, uint16_t slot_time, uint16_t alpha, bool debug, int comm_slot = 0, double byte_time = 0, int sifs = 16, int max_comm = 0, int min_slot = 0, int reserve = 0);
+
+#ifndef SWIG
+      //! Same block, timed by clock (e.g. a virtual_clock) instead of real time
+      static sptr make(bool is_coord, std::vector<uint8_t> src_mac, uint16_t slot_time, uint16_t alpha, bool debug, int comm_slot, double byte_time, int sifs, int max_comm, int min_slot, int reserve, mac_clock::sptr clock);
+#endif
+
+      //! Counters of the block (dict name -> uint64), also published on the "stats" port on request
+      virtual pmt::pmt_t stats() = 0;
     };
 
   } // namespace macprotocols
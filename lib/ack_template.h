@@ -0,0 +1,87 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_ACK_TEMPLATE_H
+#define INCLUDED_MACPROTOCOLS_ACK_TEMPLATE_H
+
+#include <pmt/pmt.h>
+#include "crc32.h"
+#include <stdint.h>
+#include <string.h>
+
+// Offsets within the 24 bytes MAC header
+#define ACK_OFFSET_DURATION 2
+#define ACK_OFFSET_ADDR1 4
+#define ACK_OFFSET_ADDR2 10
+#define ACK_OFFSET_ADDR3 16
+#define ACK_OFFSET_SEQ_NR 22
+#define ACK_HEADER_LEN 24
+#define ACK_LEN 28 // header + fcs
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Prebuilt ACK frame. Frame control and transmitter address (addr2) never change for a given
+		 * block, so they are written once. Building an ACK only patches duration + addr1 and addr3 +
+		 * seq_nr (two 8 bytes runs), and allocates the blob. The FCS is that of the template with
+		 * those runs zeroed, precomputed, XORed with the raw CRCs of the runs, the first one shifted
+		 * over the 14 bytes after it (CRC linearity): only the changing bytes go through the CRC.
+		 * The "crc_included" dict is shared by all ACKs.
+		 *
+		 * Not thread-safe: it is meant to be used from the handler of "frame from phy" only.
+		 */
+		class ack_template {
+			public:
+				ack_template(const uint8_t *src_mac, uint16_t fc) {
+					memset(d_psdu, 0, ACK_LEN);
+					memcpy(d_psdu, &fc, sizeof(uint16_t));
+					memcpy(d_psdu + ACK_OFFSET_ADDR2, src_mac, 6);
+
+					d_crc_base = crc32(d_psdu, ACK_HEADER_LEN);
+
+					d_dict = pmt::make_dict();
+					d_dict = pmt::dict_add(d_dict, pmt::mp("crc_included"), pmt::PMT_T);
+				}
+
+				pmt::pmt_t build(const uint8_t *addr1, const uint8_t *addr3, uint16_t duration, uint16_t seq_nr) {
+					memcpy(d_psdu + ACK_OFFSET_DURATION, &duration, sizeof(uint16_t));
+					memcpy(d_psdu + ACK_OFFSET_ADDR1, addr1, 6);
+					memcpy(d_psdu + ACK_OFFSET_ADDR3, addr3, 6);
+					memcpy(d_psdu + ACK_OFFSET_SEQ_NR, &seq_nr, sizeof(uint16_t));
+
+					static const crc32_shift shift(ACK_HEADER_LEN - ACK_OFFSET_ADDR2);
+					uint32_t fcs = d_crc_base ^ shift(crc32_raw_slice8(0, d_psdu + ACK_OFFSET_DURATION, ACK_OFFSET_ADDR2 - ACK_OFFSET_DURATION))
+						^ crc32_raw_slice8(0, d_psdu + ACK_OFFSET_ADDR3, ACK_HEADER_LEN - ACK_OFFSET_ADDR3);
+					memcpy(d_psdu + ACK_HEADER_LEN, &fcs, sizeof(uint32_t));
+
+					return pmt::cons(d_dict, pmt::make_blob(d_psdu, ACK_LEN));
+				}
+
+			private:
+				uint8_t d_psdu[ACK_LEN];
+				uint32_t d_crc_base; // FCS of the constant bytes, the others zeroed
+				pmt::pmt_t d_dict;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_ACK_TEMPLATE_H */
@@ -0,0 +1,96 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ampdu.h"
+#include "crc32.h"
+#include <string.h>
+
+namespace gr {
+	namespace macprotocols {
+
+		namespace {
+
+			// CRC-8 of the delimiter, x^8 + x^2 + x + 1, initial value 0xFF, inverted result
+			uint8_t delimiter_crc8(uint16_t field) {
+				uint8_t bytes[2] = {(uint8_t)(field & 0xff), (uint8_t)(field >> 8)};
+				uint8_t crc = 0xff;
+				for(int i = 0; i < 2; i++) {
+					crc ^= bytes[i];
+					for(int k = 0; k < 8; k++) crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+				}
+				return ~crc;
+			}
+
+		} // namespace
+
+		size_t ampdu_subframe_len(size_t mpdu_len) {
+			return AMPDU_DELIMITER_LEN + ((mpdu_len + 3) & ~(size_t)3);
+		}
+
+		size_t ampdu_write_subframe(uint8_t *dst, int index, const uint8_t *mpdu, size_t mpdu_len) {
+			uint16_t field = (uint16_t)((index & 0xf) << 12 | (mpdu_len & 0xfff));
+			size_t total = ampdu_subframe_len(mpdu_len);
+
+			dst[0] = field & 0xff;
+			dst[1] = field >> 8;
+			dst[2] = delimiter_crc8(field);
+			dst[3] = AMPDU_SIGNATURE;
+			memcpy(dst + AMPDU_DELIMITER_LEN, mpdu, mpdu_len);
+			memset(dst + AMPDU_DELIMITER_LEN + mpdu_len, 0, total - AMPDU_DELIMITER_LEN - mpdu_len);
+
+			return total;
+		}
+
+		int ampdu_parse(const uint8_t *payload, size_t len, ampdu_subframe *subframes, int max) {
+			size_t pos = 0, mpdu_len;
+			uint16_t field;
+			uint32_t fcs;
+			int count = 0;
+
+			while(pos + AMPDU_DELIMITER_LEN <= len and count < max) {
+				field = payload[pos] | payload[pos + 1] << 8;
+				mpdu_len = field & 0xfff;
+
+				if(payload[pos + 3] != AMPDU_SIGNATURE or payload[pos + 2] != delimiter_crc8(field)
+						or mpdu_len < AMPDU_MIN_MPDU_LEN or pos + AMPDU_DELIMITER_LEN + mpdu_len > len) {
+					pos += 4; // Corrupted delimiter, look for the next one
+					continue;
+				}
+
+				subframes[count].index = field >> 12;
+				subframes[count].offset = pos + AMPDU_DELIMITER_LEN;
+				subframes[count].length = mpdu_len;
+
+				memcpy(&fcs, payload + pos + AMPDU_DELIMITER_LEN + mpdu_len - 4, sizeof(uint32_t));
+				subframes[count].fcs_ok = crc32(payload + pos + AMPDU_DELIMITER_LEN, mpdu_len - 4) == fcs;
+
+				count++;
+				pos += ampdu_subframe_len(mpdu_len);
+			}
+
+			return count;
+		}
+
+	} // namespace macprotocols
+} // namespace gr
@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_AMPDU_H
+#define INCLUDED_MACPROTOCOLS_AMPDU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * A-MPDU framing (after 802.11-2016, 10.13). The aggregate is a regular frame (24 bytes MAC
+ * header + payload + FCS, so the PHY handles it as any other frame) whose payload is a sequence
+ * of subframes:
+ *
+ *   | delimiter (4) | MPDU, with its own FCS | padding to 4 bytes |
+ *
+ * Delimiter: 16 bits little endian, low 12 bits = MPDU length, high 4 bits = subframe index;
+ * then CRC-8 over those 16 bits and the signature 0x4E. The index lets the receiver report
+ * subframes in the block ACK bitmap even after it had to skip a corrupted delimiter.
+ */
+
+#define AMPDU_DELIMITER_LEN 4
+#define AMPDU_SIGNATURE 0x4E
+#define AMPDU_MAX_SUBFRAMES 16 // Index is 4 bits long and the block ACK bitmap is 16 bits long
+#define AMPDU_MAX_LEN 1528 // (bytes) Whole aggregate, header and FCS included
+#define AMPDU_MIN_MPDU_LEN 28 // MAC header + FCS
+
+namespace gr {
+	namespace macprotocols {
+
+		struct ampdu_subframe {
+			int index;
+			size_t offset, length; // MPDU position within the aggregate payload
+			bool fcs_ok;
+		};
+
+		// Room taken by a MPDU of "mpdu_len" bytes within the aggregate payload
+		size_t ampdu_subframe_len(size_t mpdu_len);
+
+		// Writes delimiter, MPDU and padding at dst. Returns the number of bytes written.
+		size_t ampdu_write_subframe(uint8_t *dst, int index, const uint8_t *mpdu, size_t mpdu_len);
+
+		/*
+		 * Walks an aggregate payload. Corrupted delimiters are skipped by looking for the next
+		 * valid one on a 4 bytes boundary. Returns the number of subframes found (at most max).
+		 */
+		int ampdu_parse(const uint8_t *payload, size_t len, ampdu_subframe *subframes, int max);
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_AMPDU_H */
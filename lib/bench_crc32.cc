@@ -0,0 +1,120 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Throughput of the CRC-32 kernels against boost::crc_32_type, for the frame sizes the MAC
+ * blocks actually handle: 28 bytes ACKs and 440 bytes data frames (MTU set by the tap scripts).
+ * Usage: bench-crc32 [iterations]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "crc32.h"
+#include <boost/crc.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+using namespace gr::macprotocols;
+
+typedef std::chrono::steady_clock bench_clock;
+
+static volatile uint32_t sink; // Keeps the compiler from dropping the loops
+
+static uint32_t boost_crc(const uint8_t *data, size_t len) {
+	boost::crc_32_type result;
+	result.process_bytes(data, len);
+	return result.checksum();
+}
+
+static uint32_t bytewise(const uint8_t *data, size_t len) {
+	return ~crc32_raw_bytewise(0xffffffff, data, len);
+}
+
+static uint32_t slice8(const uint8_t *data, size_t len) {
+	return ~crc32_raw_slice8(0xffffffff, data, len);
+}
+
+static uint32_t slice16(const uint8_t *data, size_t len) {
+	return ~crc32_raw_slice16(0xffffffff, data, len);
+}
+
+static uint32_t dispatched(const uint8_t *data, size_t len) {
+	return crc32(data, len);
+}
+
+static void run(const char *name, uint32_t (*f)(const uint8_t*, size_t), const uint8_t *data, size_t len, long iters) {
+	uint32_t acc = 0;
+	for(long i = 0; i < iters/10; i++) acc ^= f(data, len); // Warm up
+
+#if HAVE_RDTSC
+	unsigned long long c0 = __rdtsc();
+#endif
+	bench_clock::time_point t0 = bench_clock::now();
+	for(long i = 0; i < iters; i++) acc ^= f(data, len);
+	bench_clock::time_point t1 = bench_clock::now();
+#if HAVE_RDTSC
+	unsigned long long c1 = __rdtsc();
+	double cycles = (double)(c1 - c0)/iters;
+#endif
+	sink = acc;
+
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()/(double)iters;
+#if HAVE_RDTSC
+	printf("%-14s %5zu B %10.1f ns/frame %10.1f cycles/frame %8.3f B/cycle\n", name, len, ns, cycles, len/cycles);
+#else
+	printf("%-14s %5zu B %10.1f ns/frame %8.3f B/ns\n", name, len, ns, len/ns);
+#endif
+}
+
+int main(int argc, char **argv) {
+	long iters = argc > 1 ? atol(argv[1]) : 1000000;
+	size_t sizes[] = {28, 440};
+
+	std::vector<uint8_t> buf(1528);
+	for(size_t i = 0; i < buf.size(); i++) buf[i] = rand();
+
+	// Results must match boost before timing anything
+	for(size_t i = 0; i < buf.size(); i++) {
+		if(crc32(buf.data(), i) != boost_crc(buf.data(), i)) {
+			printf("Mismatch against boost::crc_32_type for %zu bytes!\n", i);
+			return 1;
+		}
+	}
+
+	printf("Selected kernel: %s\n", crc32_kernel_name());
+	for(size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+		run("boost", boost_crc, buf.data(), sizes[i], iters);
+		run("bytewise", bytewise, buf.data(), sizes[i], iters);
+		run("slice-by-8", slice8, buf.data(), sizes[i], iters);
+		run("slice-by-16", slice16, buf.data(), sizes[i], iters);
+		run(crc32_kernel_name(), dispatched, buf.data(), sizes[i], iters);
+	}
+
+	return 0;
+}
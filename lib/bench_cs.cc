@@ -0,0 +1,138 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Carrier sensing decision latency: local power ring (csma_ca with a power stream connected)
+ * against the request/response with an external CS block. The latter is modelled by what it
+ * costs besides the sensing window itself: duration formatted as a string, handed to another
+ * thread, parsed back, averaged there, and the float handed back. A sample producer runs all the
+ * time, as the scheduler thread would.
+ * That round trip is a model of the message path, not the real one: no GNU Radio message queue,
+ * scheduler or CS block is involved, so it is a lower bound of what asking the external block costs.
+ * Usage: bench-cs [decisions] [samples/s] [window in us]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "power_ring.h"
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace gr::macprotocols;
+
+typedef std::chrono::steady_clock bench_clock;
+
+static power_ring ring;
+static std::atomic<bool> running(true);
+
+static void producer() {
+	std::vector<float> chunk(4096);
+	for(size_t i = 0; i < chunk.size(); i++) chunk[i] = -90.0f + (rand() % 100)/10.0f;
+	while(running) ring.push(chunk.data(), chunk.size());
+}
+
+// External CS block: one message in, one message out
+static boost::mutex mu;
+static boost::condition_variable req_cond, resp_cond;
+static std::string request;
+static bool has_request = false, has_response = false;
+static float response;
+static double samp_rate;
+
+static void cs_block() {
+	boost::unique_lock<boost::mutex> lock(mu);
+	while(running) {
+		while(!has_request and running) req_cond.wait(lock);
+		if(!running) break;
+		has_request = false;
+
+		// Same window as the local path, but out of the parsed request
+		size_t n = std::max((size_t)1, (size_t)(std::stof(request)*samp_rate/1e6));
+		float avg = 0;
+		ring.average(n, avg);
+
+		response = avg;
+		has_response = true;
+		resp_cond.notify_all();
+	}
+}
+
+static void report(const char *name, std::vector<double> &ns) {
+	std::sort(ns.begin(), ns.end());
+	printf("%-12s p50 %9.0f ns  p99 %9.0f ns  max %9.0f ns\n", name, ns[ns.size()/2], ns[ns.size()*99/100], ns.back());
+}
+
+int main(int argc, char **argv) {
+	long decisions = argc > 1 ? atol(argv[1]) : 100000;
+	samp_rate = argc > 2 ? atof(argv[2]) : 10e6;
+	int time = argc > 3 ? atoi(argv[3]) : 34; // DIFS of 802.11a/n
+	size_t window = std::max((size_t)1, (size_t)(time*samp_rate/1e6));
+
+	boost::thread prod(producer), cs(cs_block);
+	while(ring.written() < window) boost::this_thread::yield();
+
+	std::vector<double> local(decisions), round_trip(decisions);
+	volatile bool busy;
+	float avg = 0;
+
+	for(long i = 0; i < decisions; i++) {
+		bench_clock::time_point t0 = bench_clock::now();
+		ring.average(window, avg);
+		busy = avg >= -60;
+		local[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - t0).count();
+	}
+
+	for(long i = 0; i < decisions; i++) {
+		bench_clock::time_point t0 = bench_clock::now();
+		boost::unique_lock<boost::mutex> lock(mu);
+		request = std::to_string((float)time);
+		has_request = true;
+		req_cond.notify_all();
+		while(!has_response) resp_cond.wait(lock);
+		has_response = false;
+		busy = response >= -60;
+		lock.unlock();
+		round_trip[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - t0).count();
+	}
+	(void)busy;
+
+	printf("Window: %d us, %zu samples\n", time, window);
+	report("local", local);
+	report("round trip", round_trip);
+	printf("The round trip is a model (mutex/condvar + string conversion), a lower bound of the real message path.\n");
+	printf("It also excludes the %d us the external block spends collecting samples.\n", time);
+
+	running = false;
+	{
+		boost::unique_lock<boost::mutex> lock(mu);
+		req_cond.notify_all();
+	}
+	prod.join();
+	cs.join();
+	return 0;
+}
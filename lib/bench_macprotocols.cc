@@ -0,0 +1,256 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Per-frame hot paths of csma_ca and frame_buffer, called directly on the block objects (no
+ * flowgraph, no scheduler, output ports left unconnected). Each path runs a fixed number of
+ * batches; the time of a batch divided by its size is one sample, and percentiles are taken over
+ * the samples. Allocations are counted by replacing the global operator new.
+ * The report is JSON on stdout.
+ * Usage: bench-macprotocols [batches] [batch size]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// ARP table read by frame_buffer, a fixture written at start up
+static char bench_arp_path[] = "/tmp/bench-macprotocols-arp-XXXXXX";
+#define ARP_CACHE bench_arp_path
+
+// Implementation classes, so that the handlers can be driven directly
+#include "csma_ca_impl.h"
+#include "frame_buffer_impl.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size ? size : 1);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+
+static uint8_t station[6] = {0x23, 0x23, 0x23, 0x23, 0x23, 0x23};
+static uint8_t peer[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0xab};
+static uint8_t other[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0xac};
+static uint8_t broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+static long num_batches = 2000, batch_size = 64;
+static bool first_result = true;
+
+struct bench_result {
+	std::vector<double> ns; // Per op, one sample per batch
+	uint64_t allocations;
+};
+
+// Runs setup(), untimed, then op() batch_size times, timed, for every batch
+template<class S, class O>
+static bench_result run(S setup, O op) {
+	bench_result r;
+	uint64_t allocs = 0;
+
+	for(long b = 0; b < num_batches/10 + num_batches; b++) {
+		setup();
+		uint64_t a0 = allocations.load(std::memory_order_relaxed);
+		bench_clock::time_point t0 = bench_clock::now();
+		for(long i = 0; i < batch_size; i++) op(i);
+		bench_clock::time_point t1 = bench_clock::now();
+		uint64_t a1 = allocations.load(std::memory_order_relaxed);
+
+		if(b < num_batches/10) continue; // Warm up
+		r.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()/(double)batch_size);
+		allocs += a1 - a0;
+	}
+	r.allocations = allocs;
+	return r;
+}
+
+template<class O>
+static bench_result run(O op) {
+	return run([] {}, op);
+}
+
+static void report(const char *name, bench_result r) {
+	std::vector<double> &ns = r.ns;
+	double sum = 0;
+	for(size_t i = 0; i < ns.size(); i++) sum += ns[i];
+	std::sort(ns.begin(), ns.end());
+
+	printf("%s\n    {\"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}, \"allocs_per_op\": %.2f}",
+		first_result ? "" : ",", name, (long)ns.size()*batch_size, sum/ns.size(), ns[ns.size()/2], ns[ns.size()*9/10], ns[ns.size()*99/100], ns.back(),
+		(double)r.allocations/(ns.size()*batch_size));
+	first_result = false;
+}
+
+static pmt::pmt_t make_frame(uint16_t fc, const uint8_t *dst, const uint8_t *src, uint16_t seq_nr, uint16_t duration, const uint8_t *body, size_t body_len) {
+	// Header, body and FCS, as the PHY delivers them
+	std::vector<uint8_t> psdu(24 + body_len + sizeof(uint32_t));
+	mac_header *h = (mac_header*)psdu.data();
+	h->frame_control = fc;
+	h->duration = duration;
+	memcpy(h->addr1, dst, 6);
+	memcpy(h->addr2, src, 6);
+	memcpy(h->addr3, broadcast, 6);
+	h->seq_nr = seq_nr;
+	if(body_len > 0) memcpy(psdu.data() + 24, body, body_len);
+
+	uint32_t fcs = crc32(psdu.data(), 24 + body_len);
+	memcpy(psdu.data() + 24 + body_len, &fcs, sizeof(uint32_t));
+	return pmt::cons(pmt::dict_add(pmt::make_dict(), pmt::mp("crc_included"), pmt::PMT_T), pmt::make_blob(psdu.data(), psdu.size()));
+}
+
+static pmt::pmt_t make_ampdu(int subframes, size_t body_len) {
+	std::vector<uint8_t> payload(AMPDU_MAX_LEN), body(body_len, 0x55);
+	size_t len = 0;
+	for(int i = 0; i < subframes; i++) {
+		pmt::pmt_t mpdu = make_frame(FC_DATA, station, peer, i, 0, body.data(), body.size());
+		len += ampdu_write_subframe(payload.data() + len, i, (const uint8_t*)pmt::blob_data(pmt::cdr(mpdu)), pmt::blob_length(pmt::cdr(mpdu)));
+	}
+	return make_frame(FC_AMPDU, station, peer, 0, 0, payload.data(), len);
+}
+
+static void drain(frame_buffer_impl &fb, long &queued) {
+	// Exactly as many credits as frames queued: the buffer ends empty, without credits left
+	fb.request(0, pmt::from_long(queued));
+	queued = 0;
+}
+
+static void set_seq_nr(pmt::pmt_t frame, uint16_t seq_nr) {
+	// Distinct sequence numbers keep data frames from being taken as duplicates. The stale FCS is not checked here.
+	((mac_header*)pmt::blob_data(pmt::cdr(frame)))->seq_nr = seq_nr;
+}
+
+int main(int argc, char **argv) {
+	if(argc > 1) num_batches = std::max(10L, atol(argv[1]));
+	if(argc > 2) batch_size = std::max(1L, atol(argv[2]));
+
+	// Data frames of the tap scripts: 440 bytes MTU, LLC + IPv4 to 10.0.0.2 in the body
+	std::vector<uint8_t> body(412, 0);
+	uint8_t ip_dst[4] = {10, 0, 0, 2}, ip_unknown[4] = {10, 0, 0, 3};
+	body[0] = 0xaa; body[1] = 0xaa; body[2] = 0x03; body[6] = 0x08; // LLC/SNAP, IPv4
+	memcpy(body.data() + 24, ip_dst, 4); // At 48 from the start of the frame
+
+	int fd = mkstemp(bench_arp_path);
+	FILE *arp = fdopen(fd, "w");
+	fprintf(arp, "IP address       HW type     Flags       HW address            Mask     Device\n");
+	for(int i = 10; i < 20; i++) fprintf(arp, "10.0.1.%d         0x1         0x2         12:34:56:78:90:%02x     *        tap0\n", i, i);
+	fprintf(arp, "10.0.0.2         0x1         0x2         12:34:56:78:90:ab     *        tap0\n");
+	fclose(arp);
+
+	// Blocks say hello on stdout, which is for the report only
+	std::streambuf *out = std::cout.rdbuf(NULL);
+	std::vector<uint8_t> mac(station, station + 6);
+	boost::shared_ptr<csma_ca_impl> csma(new csma_ca_impl(mac, 9, 16, 34, 1, -60, false, true, 0, -1, mac_clock::realtime()));
+	boost::shared_ptr<frame_buffer_impl> fb(new frame_buffer_impl(batch_size, false, 0, false));
+	boost::shared_ptr<frame_buffer_impl> fb_arp(new frame_buffer_impl(batch_size, true, 0, false));
+	std::cout.rdbuf(out);
+	std::cout.clear();
+
+	pmt::pmt_t data = make_frame(FC_DATA, station, peer, 0, 44, body.data(), body.size());
+	pmt::pmt_t data_unknown_ip = make_frame(FC_DATA, station, peer, 0, 44, body.data(), body.size());
+	memcpy((uint8_t*)pmt::blob_data(pmt::cdr(data_unknown_ip)) + 48, ip_unknown, 4);
+	pmt::pmt_t outgoing = make_frame(FC_DATA, peer, station, 0, 44, body.data(), body.size()); // frame_buffer rewrites it in place
+
+	printf("{\n  \"batches\": %ld, \"batch_size\": %ld,\n  \"results\": [", num_batches, batch_size);
+
+	// Frame construction
+	report("csma_ca/generate_frame", run([&](long i) { csma->generate_frame(body.data(), body.size(), FC_DATA, i, peer, 44); }));
+	report("csma_ca/generate_ack_frame", run([&](long i) { csma->generate_ack_frame(data); }));
+
+	// Reception, one case per frame control
+	uint16_t seq = 0;
+	pmt::pmt_t ampdu = make_ampdu(4, 100);
+	pmt::pmt_t ack = make_frame(FC_ACK, station, peer, 0, 0, NULL, 0);
+	uint16_t bitmap = 0xf;
+	pmt::pmt_t block_ack = make_frame(FC_BLOCK_ACK, station, peer, 0, 0, (const uint8_t*)&bitmap, sizeof(uint16_t));
+	pmt::pmt_t rts = make_frame(FC_RTS, station, peer, 0, 500, NULL, 0);
+	pmt::pmt_t cts = make_frame(FC_CTS, station, peer, 0, 400, NULL, 0);
+	pmt::pmt_t metrics = make_frame(FC_METRICS, station, peer, 0, 0, body.data(), 32);
+	pmt::pmt_t protocol = make_frame(FC_PROTOCOL, broadcast, peer, 0, 0, body.data(), 8);
+	pmt::pmt_t not_mine = make_frame(FC_DATA, other, peer, 0, 44, body.data(), body.size());
+
+	report("csma_ca/frame_from_phy/data", run([&](long i) { set_seq_nr(data, seq++); csma->frame_from_phy(data); }));
+	report("csma_ca/frame_from_phy/data_duplicate", run([&](long i) { csma->frame_from_phy(data); }));
+	report("csma_ca/frame_from_phy/ampdu_4x100", run([&](long i) { set_seq_nr(ampdu, seq++); csma->frame_from_phy(ampdu); }));
+	report("csma_ca/frame_from_phy/ack", run([&](long i) { csma->frame_from_phy(ack); }));
+	report("csma_ca/frame_from_phy/block_ack", run([&](long i) { csma->frame_from_phy(block_ack); }));
+	report("csma_ca/frame_from_phy/rts", run([&](long i) { csma->frame_from_phy(rts); }));
+	report("csma_ca/frame_from_phy/cts", run([&](long i) { csma->frame_from_phy(cts); }));
+	report("csma_ca/frame_from_phy/metrics", run([&](long i) { csma->frame_from_phy(metrics); }));
+	report("csma_ca/frame_from_phy/protocol", run([&](long i) { csma->frame_from_phy(protocol); }));
+	report("csma_ca/frame_from_phy/not_mine", run([&](long i) { csma->frame_from_phy(not_mine); }));
+
+	// frame_buffer: queueing without credits, then dequeueing one credit at a time. Each batch starts from
+	// an empty buffer that holds exactly a batch, so no frame is dropped.
+	long queued = 0;
+	report("frame_buffer/appin", run([&] { drain(*fb, queued); queued = batch_size; },
+		[&](long i) { fb->appin(outgoing); }));
+	drain(*fb, queued);
+	report("frame_buffer/appin_arp", run([&] { drain(*fb_arp, queued); queued = batch_size; },
+		[&](long i) { fb_arp->appin(outgoing); }));
+	drain(*fb_arp, queued);
+	report("frame_buffer/appin_arp_miss", run([&] { drain(*fb_arp, queued); queued = batch_size; },
+		[&](long i) { fb_arp->appin(data_unknown_ip); }));
+	drain(*fb_arp, queued);
+	report("frame_buffer/dequeue", run([&] { for(long i = 0; i < batch_size; i++) fb->appin(outgoing); },
+		[&](long i) { fb->request(0, pmt::from_long(1)); }));
+
+	uint8_t hw[6];
+	report("frame_buffer/lookup_arp/hit", run([&](long i) { fb->lookup_arp(ip_dst, hw); }));
+	report("frame_buffer/lookup_arp/miss", run([&](long i) { fb->lookup_arp(ip_unknown, hw); }));
+
+	printf("\n  ]\n}\n");
+	unlink(bench_arp_path);
+	return 0;
+}
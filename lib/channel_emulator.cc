@@ -0,0 +1,202 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <macprotocols/channel_emulator.h>
+#include <boost/thread.hpp>
+#include <pmt/pmt.h>
+#include "crc32.h"
+#include "channel_model.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MAX_NODES 64
+
+using namespace gr::macprotocols;
+
+class channel_emulator_impl : public channel_emulator {
+
+	typedef channel_model::time_point clock_type;
+	typedef channel_model::transmission transmission;
+	typedef channel_model::event event;
+
+	public:
+		channel_emulator_impl(int num_nodes, double byte_time, int preamble_time, int prop_delay, double loss, float idle_power, float busy_power, int seed, bool debug, mac_clock::sptr clock)
+			: gr::block("channel_emulator",
+			gr::io_signature::make(0, 0, 0),
+			gr::io_signature::make(0, 0, 0)),
+			pr_num_nodes(std::max(1, std::min(num_nodes, MAX_NODES))), pr_loss(loss), pr_debug(debug),
+			pr_model(pr_num_nodes, byte_time, preamble_time, prop_delay, idle_power, busy_power), pr_rng(seed), pr_clock(clock) {
+
+			// Ports "frame in0", "frame in1", ..., as GRC names the copies of a message port
+			for(int i = 0; i < pr_num_nodes; i++) {
+				pr_frame_in.push_back(pmt::mp("frame in" + std::to_string(i)));
+				message_port_register_in(pr_frame_in[i]);
+				set_msg_handler(pr_frame_in[i], boost::bind(&channel_emulator_impl::frame_in, this, i, _1));
+
+				pr_cs_request.push_back(pmt::mp("cs request" + std::to_string(i)));
+				message_port_register_in(pr_cs_request[i]);
+				set_msg_handler(pr_cs_request[i], boost::bind(&channel_emulator_impl::cs_request, this, i, _1));
+
+				pr_frame_out.push_back(pmt::mp("frame out" + std::to_string(i)));
+				message_port_register_out(pr_frame_out[i]);
+
+				pr_cs_out.push_back(pmt::mp("cs out" + std::to_string(i)));
+				message_port_register_out(pr_cs_out[i]);
+			}
+		}
+
+		bool start() {
+			thread_deliver = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&channel_emulator_impl::deliver, this)));
+			return block::start();
+		}
+
+		void frame_in(int node, pmt::pmt_t frame) {
+			// The frame occupies the medium from now on. Whatever another node sends meanwhile collides with it.
+			mac_clock::scoped_release release(*pr_clock); // Held by the MAC that sent it
+			if(!pmt::dict_has_key(pmt::car(frame), pmt::mp("crc_included"))) {
+				// The PHY appends the FCS, so the frame goes on the air, and reaches the other nodes, with it
+				pmt::pmt_t cdr = pmt::cdr(frame);
+				size_t len = pmt::blob_length(cdr);
+				std::vector<uint8_t> psdu(len + sizeof(uint32_t));
+				memcpy(psdu.data(), pmt::blob_data(cdr), len);
+				uint32_t fcs = crc32(psdu.data(), len);
+				memcpy(psdu.data() + len, &fcs, sizeof(uint32_t));
+				frame = pmt::cons(pmt::dict_add(pmt::car(frame), pmt::mp("crc_included"), pmt::PMT_T), pmt::make_blob(psdu.data(), psdu.size()));
+			}
+			size_t len = pmt::blob_length(pmt::cdr(frame));
+
+			boost::unique_lock<boost::mutex> lock(pr_mu);
+			boost::shared_ptr<transmission> tx = pr_model.transmit(node, pr_clock->now(), frame, len);
+			pr_clock->notify_all(pr_cond);
+
+			if(pr_debug and tx->collided) std::cout << "Collision: node " << node << " transmits while another node is on the air." << std::endl << std::flush;
+			if(pr_debug) std::cout << "Node " << node << " is transmitting " << len << " bytes." << std::endl << std::flush;
+		}
+
+		void cs_request(int node, pmt::pmt_t msg) {
+			// Same request as for the CS block: sensing window (us) as a symbol. Answered once it is over.
+			mac_clock::scoped_release release(*pr_clock);
+			const char *str;
+			char *end;
+			double window;
+
+			if(!pmt::is_symbol(msg)) {
+				if(pr_debug) std::cout << "CS request of node " << node << " is not a symbol. Dropped." << std::endl << std::flush;
+				return;
+			}
+			std::string s = pmt::symbol_to_string(msg);
+			str = s.c_str();
+			window = strtod(str, &end);
+			if(end == str or *end != '\0' or !std::isfinite(window)) {
+				if(pr_debug) std::cout << "Malformed CS request from node " << node << ": \"" << s << "\". Dropped." << std::endl << std::flush;
+				return;
+			}
+
+			boost::unique_lock<boost::mutex> lock(pr_mu);
+			pr_model.sense(node, pr_clock->now(), std::max(1L, (long)window));
+			pr_clock->notify_all(pr_cond);
+		}
+
+		void deliver() {
+			// Runs the events in time order. Publishing is done without the lock, so handlers are never blocked by it.
+			std::uniform_real_distribution<double> draw(0.0, 1.0);
+			boost::unique_lock<boost::mutex> lock(pr_mu);
+			clock_type next;
+			event e;
+
+			pr_clock->attach();
+			while(true) {
+				if(pr_model.empty()) {
+					pr_clock->wait(lock, pr_cond, [this] { return !pr_model.empty(); });
+					continue;
+				}
+
+				next = pr_model.next();
+				if(pr_clock->now() < next) { // An earlier event may be scheduled meanwhile
+					pr_clock->wait_until(lock, pr_cond, next, [this, next] { return pr_model.next() < next; });
+					continue;
+				}
+
+				e = pr_model.pop();
+
+				if(!e.tx) {
+					float power = pr_model.average_power(e.node, e.when - std::chrono::microseconds(e.window), e.when);
+					lock.unlock();
+					publish_held(pr_cs_out[e.node], pmt::from_float(power));
+				} else if(e.tx->collided) {
+					lock.unlock();
+					if(pr_debug) std::cout << "Frame from node " << e.tx->node << " to node " << e.node << " collided." << std::endl << std::flush;
+				} else if(draw(pr_rng) < pr_loss) {
+					lock.unlock();
+					if(pr_debug) std::cout << "Frame from node " << e.tx->node << " to node " << e.node << " lost." << std::endl << std::flush;
+				} else {
+					lock.unlock();
+					publish_held(pr_frame_out[e.node], e.tx->frame);
+				}
+				lock.lock();
+			}
+		}
+
+		void publish_held(pmt::pmt_t port, pmt::pmt_t msg) {
+			// Under a virtual clock, time stands still until the MAC has handled msg (see mac_clock::hold())
+			pr_clock->hold(pmt::length(message_subscribers(port)));
+			message_port_pub(port, msg);
+		}
+
+	private:
+		int pr_num_nodes;
+		double pr_loss;
+		bool pr_debug;
+
+		// Frames on the air and events due, guarded by pr_mu
+		channel_model pr_model;
+		boost::mutex pr_mu;
+		boost::condition_variable pr_cond;
+		boost::shared_ptr<gr::thread::thread> thread_deliver;
+
+		// Only used by deliver()
+		std::mt19937 pr_rng;
+
+		// Time source: real time unless the block was made with a virtual clock
+		mac_clock::sptr pr_clock;
+
+		// Ports, one of each per node
+		std::vector<pmt::pmt_t> pr_frame_in, pr_cs_request, pr_frame_out, pr_cs_out;
+};
+
+channel_emulator::sptr
+channel_emulator::make(int num_nodes, double byte_time, int preamble_time, int prop_delay, double loss, float idle_power, float busy_power, int seed, bool debug) {
+	return make(num_nodes, byte_time, preamble_time, prop_delay, loss, idle_power, busy_power, seed, debug, mac_clock::realtime());
+}
+
+channel_emulator::sptr
+channel_emulator::make(int num_nodes, double byte_time, int preamble_time, int prop_delay, double loss, float idle_power, float busy_power, int seed, bool debug, mac_clock::sptr clock) {
+	return gnuradio::get_initial_sptr(new channel_emulator_impl(num_nodes, byte_time, preamble_time, prop_delay, loss, idle_power, busy_power, seed, debug, clock));
+}
@@ -0,0 +1,173 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_CHANNEL_MODEL_H
+#define INCLUDED_MACPROTOCOLS_CHANNEL_MODEL_H
+
+#include <macprotocols/mac_clock.h>
+#include <boost/shared_ptr.hpp>
+#include <pmt/pmt.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <stdint.h>
+
+#define CS_HISTORY 100000 // (us) Transmissions ended longer ago than this are forgotten
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * The medium of channel_emulator: frames on the air, what they collide with, and the deliveries
+		 * and CS answers due, in time order. Times are given by the caller, so the block feeds it with
+		 * its clock and the tests with made up ones. Not thread safe, the block guards it.
+		 *
+		 * A frame is on the air for preamble_time + byte_time*length (us) from the time it is sent, and
+		 * reaches every other node prop_delay (us) after it ends. Frames of different nodes overlapping
+		 * in time corrupt each other. Those of a single node never do: a node sending back to back
+		 * (TXOP, SIFS apart) does not hear itself.
+		 */
+		class channel_model {
+			public:
+				typedef mac_clock::time_point time_point;
+
+				// One frame on the air, shared by its deliveries to every other node
+				struct transmission {
+					int node;
+					time_point start, end; // At the transmitter
+					pmt::pmt_t frame;
+					bool collided;
+				};
+
+				// Delivery of a frame to a node, or answer to a CS request of a node (tx is NULL)
+				struct event {
+					time_point when;
+					uint64_t order; // Simultaneous events keep their arrival order
+					int node;
+					boost::shared_ptr<transmission> tx;
+					long window; // (us) CS window, ending at "when"
+
+					bool operator>(const event &e) const {
+						return when > e.when or (when == e.when and order > e.order);
+					}
+				};
+
+				channel_model(int num_nodes, double byte_time, int preamble_time, int prop_delay, float idle_power, float busy_power)
+					: d_num_nodes(num_nodes), d_preamble_time(preamble_time), d_prop_delay(prop_delay), d_byte_time(byte_time),
+					d_idle_power(idle_power), d_busy_power(busy_power), d_order(0) {}
+
+				// Frame of len bytes (FCS included) sent by node at t. Returns it, collided or not.
+				boost::shared_ptr<transmission> transmit(int node, time_point t, pmt::pmt_t frame, size_t len) {
+					boost::shared_ptr<transmission> tx(new transmission());
+					tx->node = node;
+					tx->start = t;
+					tx->end = t + std::chrono::microseconds((long)(d_preamble_time + d_byte_time*len));
+					tx->frame = frame;
+					tx->collided = false;
+
+					for(size_t i = 0; i < d_history.size(); i++) {
+						if(d_history[i]->node == node or d_history[i]->end <= tx->start) continue;
+						d_history[i]->collided = true;
+						tx->collided = true;
+					}
+
+					while(!d_history.empty() and d_history.front()->end + std::chrono::microseconds(CS_HISTORY) < tx->start) d_history.pop_front();
+					d_history.push_back(tx);
+
+					for(int i = 0; i < d_num_nodes; i++) {
+						if(i != node) schedule(tx->end + std::chrono::microseconds(d_prop_delay), i, tx, 0);
+					}
+					return tx;
+				}
+
+				// CS request of node at t, answered once its window (us) is over
+				void sense(int node, time_point t, long window) {
+					schedule(t + std::chrono::microseconds(window), node, boost::shared_ptr<transmission>(), window);
+				}
+
+				bool empty() const {
+					return d_events.empty();
+				}
+
+				// Time of the earliest event. There must be one.
+				time_point next() const {
+					return d_events.top().when;
+				}
+
+				event pop() {
+					event e = d_events.top();
+					d_events.pop();
+					return e;
+				}
+
+				// Average power (dB) seen by node over [from, to]: busy_power while something was on the air there, idle_power otherwise
+				float average_power(int node, time_point from, time_point to) const {
+					std::vector<std::pair<time_point, time_point> > busy;
+					std::chrono::microseconds delay;
+
+					for(size_t i = 0; i < d_history.size(); i++) {
+						delay = std::chrono::microseconds(d_history[i]->node == node ? 0 : d_prop_delay);
+						time_point start = std::max(from, d_history[i]->start + delay), end = std::min(to, d_history[i]->end + delay);
+						if(start < end) busy.push_back(std::make_pair(start, end));
+					}
+					std::sort(busy.begin(), busy.end());
+
+					// Overlapping transmissions count once
+					time_point covered = from;
+					double busy_time = 0;
+					for(size_t i = 0; i < busy.size(); i++) {
+						time_point start = std::max(busy[i].first, covered);
+						if(busy[i].second <= start) continue;
+						busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(busy[i].second - start).count();
+						covered = busy[i].second;
+					}
+
+					double frac = busy_time/std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+					double mw = frac*std::pow(10, d_busy_power/10) + (1 - frac)*std::pow(10, d_idle_power/10);
+					return 10*std::log10(mw);
+				}
+
+			private:
+				void schedule(time_point when, int node, boost::shared_ptr<transmission> tx, long window) {
+					event e;
+					e.when = when;
+					e.order = d_order++;
+					e.node = node;
+					e.tx = tx;
+					e.window = window;
+					d_events.push(e);
+				}
+
+				int d_num_nodes, d_preamble_time, d_prop_delay;
+				double d_byte_time;
+				float d_idle_power, d_busy_power;
+
+				// Frames on the air or recently ended, oldest first
+				std::deque<boost::shared_ptr<transmission> > d_history;
+				std::priority_queue<event, std::vector<event>, std::greater<event> > d_events;
+				uint64_t d_order;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_CHANNEL_MODEL_H */
@@ -0,0 +1,333 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* -*- -*- Notes on CRC-32 -*- -*-
+   Reflected CRC-32, polynomial 0x04C11DB7 (0xEDB88320 reflected), initial value and final
+XOR 0xFFFFFFFF. Slice-by-N tables are the classic ones (table[k][b] is table[0][b] followed by
+k zero bytes). The PCLMULQDQ kernel folds 4x128 bits at a time and reduces with Barrett, after
+Gopal et al., "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction",
+Intel, 2009. crc32_patch() relies on CRC linearity: the FCS changes by the raw CRC of the XOR
+of old and new bytes, shifted over the trailing bytes with a multiplication by x^(8n) mod P.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "crc32.h"
+#include <string.h>
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#define CRC32_X86 1
+#include <immintrin.h>
+#elif defined(__GNUC__) and defined(__aarch64__) and defined(__linux__)
+#define CRC32_ARM 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#define CRC32_POLY 0xedb88320
+#define CRC32_FOLD_MIN 64 // Below this, tables beat folding
+
+namespace gr {
+	namespace macprotocols {
+
+		namespace {
+
+			struct crc32_tables {
+				uint32_t t[16][256];
+				uint32_t x2n[32]; // x^(2^n) mod P, for shifting a CRC over zero bytes
+
+				crc32_tables() {
+					for(uint32_t b = 0; b < 256; b++) {
+						uint32_t c = b;
+						for(int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ CRC32_POLY : c >> 1;
+						t[0][b] = c;
+					}
+					for(uint32_t b = 0; b < 256; b++) {
+						for(int k = 1; k < 16; k++) t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+					}
+
+					uint32_t p = 1u << 30; // x^1
+					x2n[0] = p;
+					for(int n = 1; n < 32; n++) x2n[n] = p = multmodp(p, p);
+				}
+
+				// a*b mod P, reflected
+				static uint32_t multmodp(uint32_t a, uint32_t b) {
+					uint32_t m = 1u << 31, p = 0;
+					while(true) {
+						if(a & m) {
+							p ^= b;
+							if((a & (m - 1)) == 0) break;
+						}
+						m >>= 1;
+						b = b & 1 ? (b >> 1) ^ CRC32_POLY : b >> 1;
+					}
+					return p;
+				}
+
+				// x^(8*n) mod P
+				uint32_t x8nmodp(size_t n) const {
+					uint32_t p = 1u << 31; // x^0
+					unsigned int k = 3;
+					while(n) {
+						if(n & 1) p = multmodp(x2n[k & 31], p);
+						n >>= 1;
+						k++;
+					}
+					return p;
+				}
+			};
+
+			const crc32_tables &tables() {
+				static const crc32_tables tbl;
+				return tbl;
+			}
+
+			inline uint32_t load32(const uint8_t *p) {
+				uint32_t v;
+				memcpy(&v, p, 4);
+				return v;
+			}
+
+#if CRC32_X86
+			__attribute__((target("pclmul,sse4.1")))
+			uint32_t crc32_raw_clmul(uint32_t crc, const uint8_t *buf, size_t len) {
+				// len >= 64 and multiple of 16
+				static const uint64_t k1k2[2] __attribute__((aligned(16))) = {0x0154442bd4, 0x01c6e41596};
+				static const uint64_t k3k4[2] __attribute__((aligned(16))) = {0x01751997d0, 0x00ccaa009e};
+				static const uint64_t k5k0[2] __attribute__((aligned(16))) = {0x0163cd6124, 0x0000000000};
+				static const uint64_t poly[2] __attribute__((aligned(16))) = {0x01db710641, 0x01f7011641};
+
+				__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+				x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+				x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+				x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+				x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+				x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+				x0 = _mm_load_si128((const __m128i*)k1k2);
+				buf += 64;
+				len -= 64;
+
+				// Parallel fold of 4x128 bits
+				while(len >= 64) {
+					x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+					x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+					x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+					x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+					x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+					x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+					x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+					x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+					y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+					y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+					y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+					y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+					x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+					x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+					x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+					x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+					buf += 64;
+					len -= 64;
+				}
+
+				// Fold into 128 bits
+				x0 = _mm_load_si128((const __m128i*)k3k4);
+				x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+				x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+				x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+				// Single 128 bits folds
+				while(len >= 16) {
+					x2 = _mm_loadu_si128((const __m128i*)buf);
+					x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+					x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+					x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+					buf += 16;
+					len -= 16;
+				}
+
+				// Fold 128 bits into 64 bits
+				x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+				x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+				x1 = _mm_srli_si128(x1, 8);
+				x1 = _mm_xor_si128(x1, x2);
+				x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+				x2 = _mm_srli_si128(x1, 4);
+				x1 = _mm_and_si128(x1, x3);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_xor_si128(x1, x2);
+
+				// Barrett reduction to 32 bits
+				x0 = _mm_load_si128((const __m128i*)poly);
+				x2 = _mm_and_si128(x1, x3);
+				x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+				x2 = _mm_and_si128(x2, x3);
+				x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+				x1 = _mm_xor_si128(x1, x2);
+
+				return _mm_extract_epi32(x1, 1);
+			}
+
+			uint32_t crc32_raw_accel(uint32_t state, const uint8_t *data, size_t len) {
+				if(len >= CRC32_FOLD_MIN) {
+					size_t chunk = len & ~(size_t)15;
+					state = crc32_raw_clmul(state, data, chunk);
+					data += chunk;
+					len -= chunk;
+				}
+				return crc32_raw_slice16(state, data, len);
+			}
+
+			bool accel_supported() {
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("pclmul") and __builtin_cpu_supports("sse4.1");
+			}
+
+			const char *accel_name = "pclmulqdq";
+#elif CRC32_ARM
+			__attribute__((target("+crc")))
+			uint32_t crc32_raw_accel(uint32_t state, const uint8_t *data, size_t len) {
+				uint64_t v;
+				while(len >= 8) {
+					memcpy(&v, data, 8);
+					state = __crc32d(state, v);
+					data += 8;
+					len -= 8;
+				}
+				while(len--) state = __crc32b(state, *data++);
+				return state;
+			}
+
+			bool accel_supported() {
+				return getauxval(AT_HWCAP) & HWCAP_CRC32;
+			}
+
+			const char *accel_name = "armv8-crc32";
+#endif
+
+			typedef uint32_t (*crc32_kernel)(uint32_t, const uint8_t*, size_t);
+
+			struct crc32_dispatch {
+				crc32_kernel kernel;
+				const char *name;
+
+				crc32_dispatch() : kernel(crc32_raw_slice16), name("slice-by-16") {
+#if CRC32_X86 or CRC32_ARM
+					if(accel_supported()) {
+						kernel = crc32_raw_accel;
+						name = accel_name;
+					}
+#endif
+				}
+			};
+
+			const crc32_dispatch &dispatch() {
+				static const crc32_dispatch d;
+				return d;
+			}
+
+		} // namespace
+
+		uint32_t crc32_raw_bytewise(uint32_t state, const uint8_t *data, size_t len) {
+			const crc32_tables &tbl = tables();
+			while(len--) state = (state >> 8) ^ tbl.t[0][(state ^ *data++) & 0xff];
+			return state;
+		}
+
+		uint32_t crc32_raw_slice8(uint32_t state, const uint8_t *data, size_t len) {
+			const crc32_tables &tbl = tables();
+			uint32_t a, b;
+			while(len >= 8) {
+				a = load32(data) ^ state;
+				b = load32(data + 4);
+				state = tbl.t[7][a & 0xff] ^ tbl.t[6][(a >> 8) & 0xff] ^ tbl.t[5][(a >> 16) & 0xff] ^ tbl.t[4][a >> 24] ^
+						tbl.t[3][b & 0xff] ^ tbl.t[2][(b >> 8) & 0xff] ^ tbl.t[1][(b >> 16) & 0xff] ^ tbl.t[0][b >> 24];
+				data += 8;
+				len -= 8;
+			}
+			return crc32_raw_bytewise(state, data, len);
+		}
+
+		uint32_t crc32_raw_slice16(uint32_t state, const uint8_t *data, size_t len) {
+			const crc32_tables &tbl = tables();
+			uint32_t a, b, c, d;
+			while(len >= 16) {
+				a = load32(data) ^ state;
+				b = load32(data + 4);
+				c = load32(data + 8);
+				d = load32(data + 12);
+				state = tbl.t[15][a & 0xff] ^ tbl.t[14][(a >> 8) & 0xff] ^ tbl.t[13][(a >> 16) & 0xff] ^ tbl.t[12][a >> 24] ^
+						tbl.t[11][b & 0xff] ^ tbl.t[10][(b >> 8) & 0xff] ^ tbl.t[9][(b >> 16) & 0xff] ^ tbl.t[8][b >> 24] ^
+						tbl.t[7][c & 0xff] ^ tbl.t[6][(c >> 8) & 0xff] ^ tbl.t[5][(c >> 16) & 0xff] ^ tbl.t[4][c >> 24] ^
+						tbl.t[3][d & 0xff] ^ tbl.t[2][(d >> 8) & 0xff] ^ tbl.t[1][(d >> 16) & 0xff] ^ tbl.t[0][d >> 24];
+				data += 16;
+				len -= 16;
+			}
+			return crc32_raw_slice8(state, data, len);
+		}
+
+		uint32_t crc32_raw_hw(uint32_t state, const uint8_t *data, size_t len) {
+			return dispatch().kernel(state, data, len);
+		}
+
+		uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+			return ~dispatch().kernel(~crc, (const uint8_t*)data, len);
+		}
+
+		uint32_t crc32(const void *data, size_t len) {
+			return crc32_update(0, data, len);
+		}
+
+		uint32_t crc32_patch(uint32_t crc, size_t len, size_t offset, const void *old_bytes, const void *new_bytes, size_t n) {
+			const uint8_t *o = (const uint8_t*)old_bytes;
+			const uint8_t *w = (const uint8_t*)new_bytes;
+			uint32_t delta = 0;
+
+			// Raw CRC (no inversions) of the difference, then shifted over the bytes that follow it
+			for(size_t i = 0; i < n; i++) delta = (delta >> 8) ^ tables().t[0][(delta ^ o[i] ^ w[i]) & 0xff];
+			if(delta == 0) return crc;
+
+			return crc ^ crc32_tables::multmodp(tables().x8nmodp(len - offset - n), delta);
+		}
+
+		crc32_shift::crc32_shift(size_t n) {
+			// Shifting is a multiplication by x^(8n) mod P, linear in the register: one table per byte of it
+			uint32_t p = tables().x8nmodp(n);
+			for(int k = 0; k < 4; k++) {
+				for(uint32_t b = 0; b < 256; b++) d_t[k][b] = crc32_tables::multmodp(p, b << 8*k);
+			}
+		}
+
+		const char *crc32_kernel_name() {
+			return dispatch().name;
+		}
+
+	} // namespace macprotocols
+} // namespace gr
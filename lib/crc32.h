@@ -0,0 +1,81 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_CRC32_H
+#define INCLUDED_MACPROTOCOLS_CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * CRC-32 (IEEE 802.3, the 802.11 FCS), bit-exact with boost::crc_32_type.
+ *
+ * The kernel is chosen once at runtime: PCLMULQDQ folding on x86, the CRC32 instructions on
+ * ARMv8, slice-by-16 tables otherwise. Short buffers (e.g. 28 bytes ACKs) always go through the
+ * tables, folding only pays off from 64 bytes on.
+ */
+namespace gr {
+	namespace macprotocols {
+
+		// FCS of "len" bytes, same as boost::crc_32_type::process_bytes() + checksum()
+		uint32_t crc32(const void *data, size_t len);
+
+		// Continues a FCS: crc32_update(crc32(a), b) == crc32(a followed by b)
+		uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+		/*
+		 * FCS of a buffer of "len" bytes in which "n" bytes at "offset" changed from "old_bytes" to
+		 * "new_bytes", given its previous FCS "crc". Costs O(n + log(len - offset)) instead of O(len).
+		 */
+		uint32_t crc32_patch(uint32_t crc, size_t len, size_t offset, const void *old_bytes, const void *new_bytes, size_t n);
+
+		/*
+		 * Moves a raw CRC register (see below) over n zero bytes, n fixed at construction, with four
+		 * table lookups. By CRC linearity, the constant and the changing bytes of a frame can then be
+		 * handled apart (see ack_template.h).
+		 */
+		class crc32_shift {
+			public:
+				crc32_shift(size_t n);
+
+				uint32_t operator()(uint32_t state) const {
+					return d_t[0][state & 0xff] ^ d_t[1][(state >> 8) & 0xff] ^ d_t[2][(state >> 16) & 0xff] ^ d_t[3][state >> 24];
+				}
+
+			private:
+				uint32_t d_t[4][256];
+		};
+
+		// Name of the kernel selected at runtime
+		const char *crc32_kernel_name();
+
+		/*
+		 * Raw kernels, exposed for benchmarking. They work on the internal register (no initial or
+		 * final inversion). crc32_raw_hw() falls back to slice-by-16 when the CPU lacks support.
+		 */
+		uint32_t crc32_raw_bytewise(uint32_t state, const uint8_t *data, size_t len);
+		uint32_t crc32_raw_slice8(uint32_t state, const uint8_t *data, size_t len);
+		uint32_t crc32_raw_slice16(uint32_t state, const uint8_t *data, size_t len);
+		uint32_t crc32_raw_hw(uint32_t state, const uint8_t *data, size_t len);
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_CRC32_H */
@@ -24,6 +24,7 @@
 
 #include <macprotocols/api.h>
 #include <macprotocols/csma_ca.h>
+#include <macprotocols/mac_clock.h>
 #include <gnuradio/block.h>
 #include <pmt/pmt.h>
 #include <chrono>
@@ -53,7 +54,9 @@ namespace gr {
 			public:
 				pmt::pmt_t frame;
 				uint8_t attempts;
-				clock_type tod;
+				clock_type tod; // Taken by the MAC from its local buffer
+				clock_type enqueued; // Entered frame buffer (tod if it did not go through it)
+				clock_type first_tx; // First time on the air, clock_type() until then
 		};
 
 		class MACPROTOCOLS_API csma_ca : virtual public gr::block {
@@ -69,7 +72,16 @@ namespace gr {
 				 * creating new instances.
 				 */
 
-				static sptr make(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug);
+				static sptr make(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug, bool aggregation = false, double cs_samp_rate = 0, int rts_threshold = -1);
+
+#ifndef SWIG
+				//! Same block, timed by clock (e.g. a virtual_clock) instead of real time
+				static sptr make(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug, bool aggregation, double cs_samp_rate, int rts_threshold, mac_clock::sptr clock);
+#endif
+
+				//! Counters of the block (dict name -> uint64) and latency histograms (name -> dict of ns
+				//! percentiles), also published on the "stats" port on request
+				virtual pmt::pmt_t stats() = 0;
 		};
 
 	} // namespace macprotocols
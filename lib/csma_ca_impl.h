@@ -0,0 +1,968 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Implementation class of the csma_ca block, see csma_ca.cc. Only included by csma_ca.cc, by
+ * bench_macprotocols.cc, which drives its handlers directly, and by qa_csma_ca.cc.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_CSMA_CA_IMPL_H
+#define INCLUDED_MACPROTOCOLS_CSMA_CA_IMPL_H
+
+#include <gnuradio/io_signature.h>
+#include <gnuradio/block_detail.h>
+#include "csma_ca.h"
+#include <boost/thread.hpp>
+#include <unistd.h>
+#include <string>
+#include <cstdlib>
+#include <stdlib.h>
+#include <time.h>
+#include <chrono>
+#include "dcf_backoff.h"
+#include "spsc_ring.h"
+#include "ack_template.h"
+#include "dup_cache.h"
+#include "ampdu.h"
+#include "power_ring.h"
+#include "crc32.h"
+#include "edca.h"
+#include "mac_stats.h"
+#include "latency_histogram.h"
+#include <vector>
+#include <deque>
+
+#define MAX_LOCAL_BUFF 3
+#define MAX_RETRIES 10
+#define RxPHYDelay 1 // (us) for max distance of 300m between nodes
+#define aCWmin 16 // aCWmin + 1
+#define aCWmax 1024 // aCWmax + 1
+#define VI_TXOP_LIMIT 3008 // (us) Default EDCA TXOP limits for OFDM PHYs
+#define VO_TXOP_LIMIT 1504
+// Frame Control (FC) cheat sheet
+#define FC_ACK 0x2B00
+#define FC_DATA 0x0008
+#define FC_PROTOCOL 0x2900 // Active protocol on network
+#define FC_METRICS 0x2100
+#define FC_AMPDU 0x2200 // Aggregate of data frames
+#define FC_BLOCK_ACK 0x2300
+#define FC_RTS 0x2D00
+#define FC_CTS 0x2E00
+// 802.11a/g OFDM at 6 Mbit/s (default encoding): 20 us preamble + SIGNAL, 24 data bits per 4 us symbol
+#define OFDM_PREAMBLE_TIME 20
+#define OFDM_SYMBOL_TIME 4
+#define OFDM_BITS_PER_SYMBOL 24
+#define CONTROL_FRAME_LEN 28 // RTS, CTS and ACK: header + fcs
+
+/* aCWm** from www.revolutionwifi.net/revolutionwifi/2010/08/wireless-qos-part-5-contention-window.html
+    802.11b    aCWmin 31    aCWmax 1023
+    802.11g    aCWmin 31    aCWmax 1023 (when 802.11b stations are present)
+    802.11g    aCWmin 15    aCWmax 1023
+    802.11a    aCWmin 15    aCWmax 1023
+    802.11n    aCWmin 15    aCWmax 1023
+*/
+
+using namespace gr::macprotocols;
+
+class csma_ca_impl : public csma_ca {
+
+	typedef std::chrono::high_resolution_clock clock;
+
+	// EDCA access category (802.11-2016, 10.22.2): its own queue, backoff and contention parameters
+	struct access_category {
+		access_category(unsigned int cw_min, unsigned int cw_max, int slot_time, int aifsn, int txop)
+			: dcf(cw_min, cw_max, slot_time), aifsn(aifsn), txop(txop), broadcast(false) {}
+
+		std::deque<pmt::pmt_t> queue; // Classified frames, not in flight yet
+		std::vector<buffer> inflight; // Frames being transmitted, a single MPDU or the subframes of an A-MPDU
+		dcf_backoff dcf;
+		int aifsn, txop; // TXOP limit (us, unscaled), 0: one exchange per access
+		bool broadcast; // In-flight frame is a broadcast one
+	};
+
+	public:
+		csma_ca_impl(std::vector<uint8_t> src_mac, int slot_time, int sifs, int difs, int alpha, int threshold, bool debug, bool aggregation, double cs_samp_rate, int rts_threshold, mac_clock::sptr clock) : gr::block(
+							"csma_ca",
+							gr::io_signature::make(0, 1, sizeof(float)), // Optional power stream for local carrier sensing
+							gr::io_signature::make(0, 0, 0)),
+							pr_slot_time(slot_time*alpha), pr_sifs(sifs*alpha), pr_difs(difs*alpha), pr_frame_id(0), pr_alpha(alpha), pr_threshold(threshold), pr_debug(debug), pr_aggregation(aggregation), pr_cs_samp_rate(cs_samp_rate),
+							pr_buff(MAX_LOCAL_BUFF), pr_nav_duration(sifs + slot_time + RxPHYDelay), pr_nav_sifs(sifs), pr_rts_threshold(rts_threshold),
+							pr_ack(src_mac.data(), FC_ACK), pr_clock(clock) {
+			// Inputs
+			message_port_register_in(msg_port_frame_from_buff);
+			set_msg_handler(msg_port_frame_from_buff, boost::bind(&csma_ca_impl::frame_from_buff, this, _1));
+
+			message_port_register_in(msg_port_frame_from_phy);
+			set_msg_handler(msg_port_frame_from_phy, boost::bind(&csma_ca_impl::frame_from_phy, this, _1));
+
+			message_port_register_in(msg_port_cs_in);
+			set_msg_handler(msg_port_cs_in, boost::bind(&csma_ca_impl::cs_in, this, _1));
+
+			message_port_register_in(msg_port_stats_request);
+			set_msg_handler(msg_port_stats_request, boost::bind(&csma_ca_impl::stats_request, this, _1));
+
+			// Outputs
+			message_port_register_out(msg_port_frame_to_phy);
+			message_port_register_out(msg_port_frame_request);
+			message_port_register_out(msg_port_request_to_cs);
+			message_port_register_out(msg_port_frame_to_app);
+			message_port_register_out(msg_port_stats);
+
+			// Variables initialization
+			pr_acked = false; // TRUE: ack was just received. This is usefull for thread handling send_frame().
+			pr_medium_busy = false;
+			pr_frame_arrived = false;
+			pr_ack_expected = 0;
+			pr_ampdu_seq = 0;
+
+			// Default EDCA parameter set (802.11-2016, Table 9-137), CW sizes are aCW + 1
+			pr_ac.reserve(NUM_AC);
+			pr_ac.push_back(access_category(aCWmin, aCWmax, slot_time*alpha, 7, 0)); // AC_BK
+			pr_ac.push_back(access_category(aCWmin, aCWmax, slot_time*alpha, 3, 0)); // AC_BE
+			pr_ac.push_back(access_category(aCWmin/2, aCWmin, slot_time*alpha, 2, VI_TXOP_LIMIT)); // AC_VI
+			pr_ac.push_back(access_category(aCWmin/4, aCWmin/2, slot_time*alpha, 2, VO_TXOP_LIMIT)); // AC_VO
+
+
+			for(int i = 0; i < 6; i++) {
+				pr_mac_addr[i] = src_mac[i];
+				pr_broadcast_addr[i] = 0xff;
+			}
+		}
+
+		bool start() {
+			/*
+			 * The use of start() prevents the thread bellow to access the message port before it even exists. 
+			 * This ensures the scheduler first deals with the msg port, then the thread is created.
+			*/
+			thread_send_frame = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&csma_ca_impl::send_frame, this)));
+
+			// Advertise the whole local buffer to frame buffer. From now on, it pushes frames as soon as they arrive.
+			message_port_pub(msg_port_frame_request, pmt::from_long(MAX_LOCAL_BUFF));
+			return block::start();
+		}
+
+		bool stop() {
+			// send_frame() always ends up waiting, on the clock or on the local buffer, and leaves there
+			if(thread_send_frame) {
+				thread_send_frame->interrupt();
+				thread_send_frame->join();
+				thread_send_frame.reset();
+			}
+			return block::stop();
+		}
+
+		void frame_from_buff(pmt::pmt_t frame) {
+			if(!pr_buff.push(frame)) { // push() wakes send_frame() up in case it is waiting for a new frame
+				pr_stats.inc(STAT_DROPS_QUEUE_FULL);
+				if(pr_debug) std::cout << "Local buffer is already FULL!" << std::endl << std::flush;
+			} else {
+				// Cuts a running countdown short, so that the frame's category starts its own. Once is enough.
+				boost::unique_lock<boost::mutex> lock(pr_mu2);
+				if(!pr_frame_arrived) {
+					pr_frame_arrived = true;
+					pr_clock->notify_all(pr_medium_cond);
+				}
+			}
+			pr_stats.high_water(STAT_QUEUE_HIGH_WATER, pr_buff.size());
+		}
+
+		pmt::pmt_t stats() {
+			// Stages of a frame: enqueued (frame buffer) -> dequeued (MAC) -> first transmission -> ACK or drop
+			pmt::pmt_t dict = pr_stats.snapshot();
+			dict = pmt::dict_add(dict, pmt::mp("latency_queue"), pr_lat_queue.snapshot());
+			dict = pmt::dict_add(dict, pmt::mp("latency_access"), pr_lat_access.snapshot());
+			dict = pmt::dict_add(dict, pmt::mp("latency_ack"), pr_lat_ack.snapshot());
+			dict = pmt::dict_add(dict, pmt::mp("latency_total"), pr_lat_total.snapshot());
+			dict = pmt::dict_add(dict, pmt::mp("latency_drop"), pr_lat_drop.snapshot());
+			return dict;
+		}
+
+		void stats_request(pmt::pmt_t msg) {
+			message_port_pub(msg_port_stats, stats());
+		}
+
+		void send_frame() {
+			uint deferrals = 0; // Number of times DIFS was found busy. So, discard frames after a while.
+			bool ch_busy, medium_busy, arrived, counting = false;
+			decltype(clock::now()) busy_time, deadline;
+			int winner;
+
+			mac_clock::scoped_attach attach(*pr_clock);
+			if(pr_debug) std::cout << "Sending frame..." << std::endl << std::flush;
+
+			while(true) {
+				// New frames are sorted into their categories, then each category prepares its next transmission.
+				// Frames left from its last transmission go first.
+				classify_frames(!backlogged());
+				for(int ac = 0; ac < NUM_AC; ac++) fill_inflight(pr_ac[ac]);
+				if(!backlogged()) continue;
+
+				if(deferrals >= MAX_RETRIES) {
+					for(int ac = 0; ac < NUM_AC; ac++) {
+						pr_stats.inc(STAT_DROPS_MEDIUM_BUSY, pr_ac[ac].inflight.size());
+						for(size_t i = 0; i < pr_ac[ac].inflight.size(); i++) pr_lat_drop.record(pr_clock->now() - pr_ac[ac].inflight[i].enqueued);
+						if(pr_debug and !pr_ac[ac].inflight.empty()) std::cout << "Medium is too busy. " << pr_ac[ac].inflight.size() << " frame(s) dropped!" << std::endl << std::flush;
+						pr_ac[ac].inflight.clear();
+					}
+					deferrals = 0;
+					continue;
+				}
+
+				if(!counting) {
+					// While the NAV is set, the medium is busy no matter what CS would say
+					if(wait_nav()) continue;
+
+					// Backoffs are frozen. They only resume after the medium has been idle for DIFS.
+					ch_busy = is_channel_busy(pr_threshold, pr_difs);
+					if(pr_debug) std::cout << "Is channel busy? " << ch_busy << std::endl << std::flush;
+
+					if(ch_busy) {
+						if(!broadcast_pending()) deferrals++; // Persistent on broadcast frames
+						continue;
+					}
+					clear_medium_busy();
+					resume_backoffs(pr_clock->now());
+					counting = true;
+				} else {
+					// Categories that got a frame during the countdown start theirs after their AIFS
+					resume_backoffs(pr_clock->now() + std::chrono::microseconds(pr_difs));
+				}
+
+				// Countdown. Sleeps until the first backoff counter reaches zero, unless a frame is heard meanwhile.
+				// A new local frame wakes it up too: counting stays set, so the countdown goes on with its category.
+				deadline = next_deadline();
+				medium_busy = wait_medium_busy(deadline, busy_time, arrived);
+				if(arrived) continue;
+				if(medium_busy) {
+					for(int ac = 0; ac < NUM_AC; ac++) pr_ac[ac].dcf.freeze(busy_time);
+					counting = false;
+					if(pr_debug) std::cout << "Medium is busy. Backoffs frozen." << std::endl << std::flush;
+					continue;
+				}
+
+				// Highest category whose counter reached zero gets the medium. The other ones that reached zero
+				// at the same slot behave as if their frame collided (internal collision).
+				winner = -1;
+				for(int ac = NUM_AC - 1; ac >= 0; ac--) {
+					access_category &c = pr_ac[ac];
+					if(c.inflight.empty() or !c.dcf.counting() or c.dcf.deadline() > deadline) continue;
+					if(winner < 0) {
+						winner = ac;
+					} else {
+						if(pr_debug) std::cout << "Internal collision, AC " << ac << " backs off." << std::endl << std::flush;
+						c.dcf.collision();
+						for(size_t i = 0; i < c.inflight.size(); i++) c.inflight[i].attempts++;
+						complete_inflight(c, 0);
+					}
+				}
+
+				// Own transmission keeps the medium busy for the others
+				for(int ac = 0; ac < NUM_AC; ac++) pr_ac[ac].dcf.freeze(deadline);
+				counting = false;
+				deferrals = 0;
+
+				transmit_opportunity(pr_ac[winner]);
+			}
+		}
+
+		void transmit_opportunity(access_category &c) {
+			/*
+			 * Backoff is over for this category. Without TXOP limit it performs a single exchange. Otherwise
+			 * it keeps the medium, SIFS apart, as long as the next exchange ends within the limit.
+			 */
+			decltype(clock::now()) txop_start = pr_clock->now();
+			long elapsed, next;
+
+			while(transmit(c) and c.txop > 0) {
+				classify_frames(false);
+				fill_inflight(c);
+				if(c.inflight.empty() or c.broadcast) return;
+
+				elapsed = std::chrono::duration_cast<std::chrono::microseconds>(pr_clock->now() - txop_start).count();
+				next = (2*pr_nav_sifs + airtime(tx_len(c)) + airtime(CONTROL_FRAME_LEN))*pr_alpha;
+				if(elapsed + next > c.txop*pr_alpha) return;
+
+				if(pr_debug) std::cout << "TXOP continues, " << c.txop*pr_alpha - elapsed << " (us) left." << std::endl << std::flush;
+				pr_clock->sleep_for(std::chrono::microseconds(pr_sifs));
+			}
+		}
+
+		bool transmit(access_category &c) {
+			// One exchange: [RTS/CTS], frame or A-MPDU, (block) ACK. Returns true if the exchange succeeded.
+			int timeout;
+			pmt::pmt_t tx_frame = build_tx_frame(c);
+
+			first_transmission(c);
+
+			// Long frames reserve the medium with RTS/CTS first, so a collision only costs the short RTS
+			if(use_rts(c, tx_frame) and !rts_cts(tx_frame)) {
+				c.dcf.collision();
+				if(pr_debug) std::cout << "CTS timeout. CW = " << c.dcf.cw() << std::endl << std::flush;
+				for(size_t i = 0; i < c.inflight.size(); i++) c.inflight[i].attempts++;
+				complete_inflight(c, 0);
+				return false;
+			}
+
+			boost::unique_lock<boost::mutex> lock3(pr_mu3);
+			pr_acked = false;
+			pr_ack_bitmap = 0;
+			pr_ack_expected = c.broadcast ? 0 : (c.inflight.size() > 1 ? FC_BLOCK_ACK : FC_ACK);
+			lock3.unlock();
+
+			publish_held(msg_port_frame_to_phy, tx_frame);
+			for(size_t i = 0; i < c.inflight.size(); i++) {
+				if(c.inflight[i].attempts > 0) pr_stats.inc(STAT_RETRIES);
+				c.inflight[i].attempts++;
+			}
+			pr_stats.inc(STAT_TX_ATTEMPTS, c.inflight.size());
+
+			if(c.broadcast) { // No ACK is expected from broadcast frames
+				pr_acked = true;
+				pr_ack_bitmap = 1;
+				if(pr_debug) std::cout << "Broadcast frame was sent!" << std::endl << std::flush;
+			} else {
+				// Waiting for (block) ack. Timeout is only an upper bound, frame_from_phy() wakes this thread up on ACK.
+				timeout = pr_sifs + pr_slot_time + RxPHYDelay*pr_alpha;
+				if(pr_debug) std::cout << "Waiting for ack. Timeout = " << timeout << std::endl << std::flush;
+				wait_ack(pr_clock->now() + std::chrono::microseconds(timeout));
+			}
+
+			lock3.lock();
+			pr_ack_expected = 0;
+			bool acked = pr_acked;
+			uint16_t bitmap = pr_ack_bitmap;
+			pr_acked = false;
+			lock3.unlock();
+
+			if(acked) {
+				c.dcf.success();
+			} else { // ACK is missing, so contention window is doubled.
+				c.dcf.collision();
+				if(pr_debug) std::cout << "ACK timeout. CW = " << c.dcf.cw() << std::endl << std::flush;
+			}
+
+			complete_inflight(c, bitmap);
+			return acked;
+		}
+
+		void first_transmission(access_category &c) {
+			// Access delay ends when the frame, or the RTS announcing it, first goes on the air
+			clock_type now = pr_clock->now();
+			for(size_t i = 0; i < c.inflight.size(); i++) {
+				if(c.inflight[i].first_tx != clock_type()) continue;
+				c.inflight[i].first_tx = now;
+				pr_lat_access.record(now - c.inflight[i].tod);
+			}
+		}
+
+		bool backlogged() {
+			for(int ac = 0; ac < NUM_AC; ac++) if(!pr_ac[ac].inflight.empty() or !pr_ac[ac].queue.empty()) return true;
+			return false;
+		}
+
+		bool broadcast_pending() {
+			for(int ac = 0; ac < NUM_AC; ac++) if(!pr_ac[ac].inflight.empty() and pr_ac[ac].broadcast) return true;
+			return false;
+		}
+
+		void resume_backoffs(decltype(clock::now()) idle_since) {
+			// AIFS[AC] = DIFS + (AIFSN[AC] - 2) x aSlotTime. The DIFS part is over at idle_since.
+			for(int ac = 0; ac < NUM_AC; ac++) {
+				access_category &c = pr_ac[ac];
+				if(c.inflight.empty() or c.dcf.counting()) continue;
+				c.dcf.resume(idle_since + std::chrono::microseconds((c.aifsn - 2)*pr_slot_time));
+			}
+		}
+
+		decltype(clock::now()) next_deadline() {
+			decltype(clock::now()) deadline = decltype(clock::now())::max();
+			for(int ac = 0; ac < NUM_AC; ac++) {
+				access_category &c = pr_ac[ac];
+				if(!c.inflight.empty() and c.dcf.counting() and c.dcf.deadline() < deadline) deadline = c.dcf.deadline();
+			}
+			return deadline;
+		}
+
+		void classify_frames(bool block) {
+			// Moves frames from the local buffer to the queue of their access category
+			if(block) pr_buff.wait_nonempty(*pr_clock); // Waiting for a new frame
+
+			while(!pr_buff.empty()) {
+				int ac = edca_access_category(pr_buff.front());
+				pr_ac[ac].queue.push_back(pr_buff.front());
+				pr_buff.pop();
+			}
+		}
+
+		bool use_rts(access_category &c, pmt::pmt_t frame) {
+			return pr_rts_threshold >= 0 and !c.broadcast and pmt::blob_length(pmt::cdr(frame)) > (size_t)pr_rts_threshold;
+		}
+
+		bool rts_cts(pmt::pmt_t frame) {
+			// Returns true if the receiver answered with CTS. Data may then go out after SIFS, without backoff.
+			mac_header *h = (mac_header*)pmt::blob_data(pmt::cdr(frame));
+			bool got_cts;
+			int timeout;
+
+			// NAV covers CTS + data + ACK, with SIFS between them
+			int duration = 3*pr_nav_sifs + 2*airtime(CONTROL_FRAME_LEN) + airtime(pmt::blob_length(pmt::cdr(frame)));
+
+			boost::unique_lock<boost::mutex> lock3(pr_mu3);
+			pr_acked = false;
+			pr_ack_bitmap = 0;
+			pr_ack_expected = FC_CTS;
+			lock3.unlock();
+
+			publish_held(msg_port_frame_to_phy, generate_frame(NULL, 0, FC_RTS, pr_frame_seq_nr, h->addr1, std::min(duration, 0x7fff)));
+
+			timeout = pr_sifs + pr_slot_time + RxPHYDelay*pr_alpha;
+			if(pr_debug) std::cout << "RTS sent. Waiting for CTS. Timeout = " << timeout << std::endl << std::flush;
+			wait_ack(pr_clock->now() + std::chrono::microseconds(timeout));
+
+			lock3.lock();
+			got_cts = pr_acked;
+			pr_acked = false;
+			pr_ack_expected = 0;
+			lock3.unlock();
+
+			if(got_cts) pr_clock->sleep_for(std::chrono::microseconds(pr_sifs));
+			return got_cts;
+		}
+
+		int airtime(size_t len) {
+			// (us, unscaled) 16 service bits and 6 tail bits are added to the PSDU
+			return OFDM_PREAMBLE_TIME + OFDM_SYMBOL_TIME*((16 + 8*len + 6 + OFDM_BITS_PER_SYMBOL - 1)/OFDM_BITS_PER_SYMBOL);
+		}
+
+		void fill_inflight(access_category &c) {
+			/*
+			 * Moves frames from the category queue into its in-flight list. With aggregation, frames queued
+			 * right behind the first one join it as long as they go to the same destination and the
+			 * aggregate still fits. Each frame taken frees a local slot, so its credit is given back.
+			 */
+			if(c.inflight.empty()) {
+				if(c.queue.empty()) return;
+				take_frame(c);
+			}
+
+			mac_header *h = (mac_header*)pmt::blob_data(pmt::cdr(c.inflight[0].frame));
+			c.broadcast = memcmp(h->addr1, pr_broadcast_addr, 6) == 0;
+			if(!pr_aggregation or c.broadcast) return;
+
+			size_t len = 24 + sizeof(uint32_t);
+			for(size_t i = 0; i < c.inflight.size(); i++) len += ampdu_subframe_len(mpdu_len(c.inflight[i].frame));
+
+			while(c.inflight.size() < AMPDU_MAX_SUBFRAMES and !c.queue.empty()) {
+				pmt::pmt_t next = c.queue.front();
+				mac_header *n = (mac_header*)pmt::blob_data(pmt::cdr(next));
+				size_t sub_len = ampdu_subframe_len(mpdu_len(next));
+
+				if(memcmp(n->addr1, h->addr1, 6) != 0 or len + sub_len > AMPDU_MAX_LEN) break;
+
+				len += sub_len;
+				take_frame(c);
+			}
+		}
+
+		void take_frame(access_category &c) {
+			buffer b;
+			b.frame = c.queue.front();
+			mac_header *h = (mac_header*)pmt::blob_data(pmt::cdr(b.frame));
+			if(memcmp(h->addr1, pr_broadcast_addr, 6) != 0) set_duration(b.frame, pr_nav_duration);
+			b.attempts = 0;
+			b.tod = pr_clock->now();
+			b.first_tx = clock_type();
+
+			// Stamped by frame buffer on arrival, in real time
+			pmt::pmt_t enqueued = pmt::PMT_NIL;
+			if(pr_clock->is_realtime() and pmt::is_dict(pmt::car(b.frame))) enqueued = pmt::dict_ref(pmt::car(b.frame), pr_enqueued_key, pmt::PMT_NIL);
+			if(pmt::is_integer(enqueued) or pmt::is_uint64(enqueued)) {
+				b.enqueued = clock_type(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(pmt::to_uint64(enqueued))));
+				pr_lat_queue.record(b.tod - b.enqueued);
+			} else {
+				b.enqueued = b.tod;
+			}
+			c.inflight.push_back(b);
+			c.queue.pop_front();
+
+			// One local slot is free again, give the credit back to frame buffer
+			message_port_pub(msg_port_frame_request, pmt::from_long(1));
+		}
+
+		size_t tx_len(access_category &c) {
+			// Bytes on the air for the in-flight frames: the frame itself, or the A-MPDU carrying them
+			if(c.inflight.size() == 1) return mpdu_len(c.inflight[0].frame);
+
+			size_t len = 24 + sizeof(uint32_t);
+			for(size_t i = 0; i < c.inflight.size(); i++) len += ampdu_subframe_len(mpdu_len(c.inflight[i].frame));
+			return len;
+		}
+
+		pmt::pmt_t build_tx_frame(access_category &c) {
+			std::vector<buffer> &inflight = c.inflight;
+
+			// A single frame goes out as it is, and is answered by a regular ACK
+			if(inflight.size() == 1) {
+				mac_header *h = (mac_header*)pmt::blob_data(pmt::cdr(inflight[0].frame));
+				pr_frame_seq_nr = h->seq_nr;
+				return inflight[0].frame;
+			}
+
+			mac_header *h = (mac_header*)pmt::blob_data(pmt::cdr(inflight[0].frame));
+			uint8_t payload[AMPDU_MAX_LEN], mpdu[AMPDU_MAX_LEN];
+			size_t payload_len = 0, len;
+
+			for(size_t i = 0; i < inflight.size(); i++) {
+				pmt::pmt_t cdr = pmt::cdr(inflight[i].frame);
+				len = pmt::blob_length(cdr);
+				memcpy(mpdu, pmt::blob_data(cdr), len);
+
+				// Each subframe carries its own FCS, so the receiver can keep the good ones
+				if(!pmt::dict_has_key(pmt::car(inflight[i].frame), pmt::mp("crc_included"))) {
+					uint32_t fcs = crc32(mpdu, len);
+					memcpy(mpdu + len, &fcs, sizeof(uint32_t));
+					len += sizeof(uint32_t);
+				}
+
+				payload_len += ampdu_write_subframe(payload + payload_len, i, mpdu, len);
+			}
+
+			pr_frame_seq_nr = pr_ampdu_seq++;
+			if(pr_debug) std::cout << "A-MPDU with " << inflight.size() << " subframes (" << payload_len << " bytes)." << std::endl << std::flush;
+
+			return generate_frame(payload, payload_len, FC_AMPDU, pr_frame_seq_nr, h->addr1, pr_nav_duration);
+		}
+
+		void complete_inflight(access_category &c, uint16_t bitmap) {
+			// Acked frames leave the list. The others stay for another attempt, up to MAX_RETRIES.
+			size_t kept = 0;
+			bool dropped = false;
+			clock_type now = pr_clock->now();
+
+			for(size_t i = 0; i < c.inflight.size(); i++) {
+				if(bitmap & (1 << i)) {
+					if(!c.broadcast) pr_lat_ack.record(now - c.inflight[i].first_tx);
+					pr_lat_total.record(now - c.inflight[i].enqueued);
+					if(pr_debug) std::cout << "Frame acked properly!" << std::endl << std::flush;
+				} else if(c.inflight[i].attempts >= MAX_RETRIES) {
+					dropped = true;
+					pr_stats.inc(STAT_DROPS_RETRY_LIMIT);
+					pr_lat_drop.record(now - c.inflight[i].enqueued);
+					if(pr_debug) std::cout << "Max number of retries exceeded. Frame dropped!" << std::endl << std::flush;
+				} else {
+					c.inflight[kept++] = c.inflight[i];
+				}
+			}
+			c.inflight.resize(kept);
+
+			if(dropped) c.dcf.success(); // Retry limit reached: contention window is reset as well
+		}
+
+		size_t mpdu_len(pmt::pmt_t frame) {
+			size_t len = pmt::blob_length(pmt::cdr(frame));
+			if(!pmt::dict_has_key(pmt::car(frame), pmt::mp("crc_included"))) len += sizeof(uint32_t);
+			return len;
+		}
+
+		void wait_ack(decltype(clock::now()) deadline) {
+			boost::unique_lock<boost::mutex> lock(pr_mu3);
+			pr_clock->wait_until(lock, pr_ack_cond, deadline, [this] { return pr_acked; });
+		}
+
+		bool wait_medium_busy(decltype(clock::now()) deadline, decltype(clock::now()) &busy_time, bool &arrived) {
+			// Returns true if medium became busy before deadline. arrived: a local frame came in before deadline.
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			pr_clock->wait_until(lock, pr_medium_cond, deadline, [this] { return pr_medium_busy or pr_frame_arrived; });
+			busy_time = pr_busy_time;
+			arrived = !pr_medium_busy and pr_frame_arrived and pr_clock->now() < deadline;
+			pr_frame_arrived = false;
+			return pr_medium_busy;
+		}
+
+		void set_medium_busy() {
+			// Only the idle -> busy change wakes send_frame() up, further frames heard meanwhile do not
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			if(pr_medium_busy) return;
+			pr_medium_busy = true;
+			pr_busy_time = pr_clock->now();
+			pr_clock->notify_all(pr_medium_cond);
+		}
+
+		void update_nav(uint16_t duration) {
+			// Durations are carried unscaled (us), like the parameters of this block
+			if(duration == 0 or duration > 0x7fff) return; // Bit 15 set: not a duration (802.11-2016, 9.2.4.2)
+
+			decltype(clock::now()) nav = pr_clock->now() + std::chrono::microseconds(duration*pr_alpha);
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			if(nav > pr_nav) pr_nav = nav;
+		}
+
+		bool nav_idle() {
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			return pr_clock->now() >= pr_nav;
+		}
+
+		bool wait_nav() {
+			// Returns true if the NAV was set, once it has expired
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			long remaining;
+			bool deferred = false;
+			while(true) { // NAV may be extended meanwhile
+				remaining = std::chrono::duration_cast<std::chrono::microseconds>(pr_nav - pr_clock->now()).count();
+				if(remaining <= 0) break;
+				if(!deferred and pr_debug) std::cout << "NAV is set. Deferring for " << remaining << " (us)." << std::endl << std::flush;
+				deferred = true;
+				pr_clock->wait_until(lock, pr_medium_cond, pr_nav, [] { return false; });
+			}
+			return deferred;
+		}
+
+		void set_duration(pmt::pmt_t frame, uint16_t duration) {
+			// Patches the duration field of a frame about to be sent. FCS, if present, is updated for those 2 bytes only.
+			pmt::pmt_t cdr = pmt::cdr(frame);
+			uint8_t *f = (uint8_t*)pmt::blob_data(cdr);
+			size_t len = pmt::blob_length(cdr);
+			mac_header *h = (mac_header*)f;
+
+			if(h->duration == duration) return;
+			if(pmt::dict_has_key(pmt::car(frame), pmt::mp("crc_included"))) {
+				uint32_t fcs;
+				memcpy(&fcs, f + len - 4, sizeof(uint32_t));
+				fcs = crc32_patch(fcs, len - 4, 2, f + 2, (const uint8_t*)&duration, sizeof(uint16_t));
+				memcpy(f + len - 4, &fcs, sizeof(uint32_t));
+			}
+			h->duration = duration;
+		}
+
+		void clear_medium_busy() {
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			pr_medium_busy = false;
+		}
+
+		int general_work(int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items) {
+			// Power stream (dB), kept for is_channel_busy(). Nothing is produced.
+			if(ninput_items.empty()) return 0; // Stream not connected
+			if(pr_cs_samp_rate > 0) pr_power.push((const float*)input_items[0], ninput_items[0]);
+			consume_each(ninput_items[0]);
+			return 0;
+		}
+
+		bool is_channel_busy(int threshold, int time) {
+			/*
+			 * With a power stream connected, the average over the last "time" us is read from the
+			 * local ring right away. Otherwise (or while the stream has not delivered enough samples
+			 * yet) the external CS block is asked, and this thread sleeps until it answers.
+			 */
+			pr_stats.inc(STAT_CS_REQUESTS);
+
+			if(pr_cs_samp_rate > 0) {
+				float avg;
+				size_t n = std::max((size_t)1, (size_t)(time*pr_cs_samp_rate/1e6));
+				if(pr_power.average(n, avg)) {
+					pr_avg_power = avg;
+					if(pr_debug) std::cout << "Avg power over the last " << time << " (us) = " << pr_avg_power << " (dB)." << std::endl;
+					if(pr_avg_power < threshold) return false;
+					pr_stats.inc(STAT_CS_BUSY);
+					return true;
+				}
+			}
+
+			if(pr_debug) std::cout << "Request carrier sensing for " << time << " (us)." << std::endl;
+
+			// Raised before the request goes, so that an answer coming right away is not taken for an older one
+			boost::unique_lock<boost::mutex> lock(pr_mu1);
+			pr_sensing = true;
+			publish_held(msg_port_request_to_cs, pmt::string_to_symbol(std::to_string((float)time)));
+			pr_clock->wait(lock, pr_cs_cond, [this] { return !pr_sensing; });
+
+			if(pr_debug) std::cout << "Avg power from medium = " << pr_avg_power << " (dB)." << std::endl;
+
+			if(pr_avg_power < threshold) {
+				return false;
+			} else {
+				pr_stats.inc(STAT_CS_BUSY);
+				return true;
+			}
+		}
+
+		void frame_from_phy(pmt::pmt_t frame) {
+			mac_clock::scoped_release release(*pr_clock); // Held by the sender, see publish_held()
+			pmt::pmt_t cdr = pmt::cdr(frame);
+			mac_header *h = (mac_header*)pmt::blob_data(cdr);
+
+			set_medium_busy(); // Freezes the backoff countdown, if any
+
+			bool is_mine, is_broadcast;
+			if(memcmp(h->addr1, pr_broadcast_addr, 6) == 0) {
+				is_broadcast = true;
+			} else {
+				is_broadcast = false;
+			}
+			if(memcmp(h->addr1, pr_mac_addr, 6) == 0) {
+				is_mine = true;
+			} else {
+				is_mine = false;
+			}
+
+			if(!is_mine and !is_broadcast) {
+				// Virtual carrier sense: the medium stays reserved for the rest of the exchange announced
+				update_nav(h->duration);
+				if(pr_debug) std::cout << "This frame is not for me. Drop it!" << std::endl << std::flush;
+				return;
+			}
+
+			switch(h->frame_control) {
+				case FC_DATA: {
+					if(is_mine) {
+						if(pr_debug) std::cout << "Data frame belongs to me. Ack sent!" << std::endl << std::flush;
+						pmt::pmt_t ack = generate_ack_frame(frame);
+						publish_held(msg_port_frame_to_phy, ack);
+						pr_stats.inc(STAT_ACKS_SENT);
+
+						// A retransmission (our ACK was lost) is acked again, but not delivered twice
+						if(pr_dup.is_duplicate(h->addr2, h->seq_nr, pr_clock->now())) {
+							pr_stats.inc(STAT_DUPLICATES);
+							if(pr_debug) std::cout << "Duplicate frame. Not delivered to app." << std::endl << std::flush;
+						} else {
+							message_port_pub(msg_port_frame_to_app, frame);
+							pr_stats.inc(STAT_RX_FRAMES);
+						}
+					}
+				} break;
+
+				case FC_AMPDU: {
+					if(is_mine) receive_ampdu(frame);
+				} break;
+
+				case FC_RTS: {
+					// Answered only if this station does not know of another exchange going on
+					if(is_mine and nav_idle()) {
+						int duration = h->duration - pr_nav_sifs - airtime(CONTROL_FRAME_LEN);
+						publish_held(msg_port_frame_to_phy, generate_frame(NULL, 0, FC_CTS, h->seq_nr, h->addr2, std::max(duration, 0)));
+						if(pr_debug) std::cout << "RTS for me. CTS sent!" << std::endl << std::flush;
+					}
+				} break;
+
+				case FC_CTS: {
+					boost::unique_lock<boost::mutex> lock(pr_mu3);
+					if(is_mine and pr_ack_expected == FC_CTS and h->seq_nr == pr_frame_seq_nr) {
+						pr_acked = true;
+						pr_clock->notify_all(pr_ack_cond);
+						if(pr_debug) std::cout << "CTS for me!" << std::endl << std::flush;
+					}
+				} break;
+
+				case FC_ACK: {
+					boost::unique_lock<boost::mutex> lock(pr_mu3);
+					if(is_mine and pr_ack_expected == FC_ACK and h->seq_nr == pr_frame_seq_nr) {
+						pr_acked = true;
+						pr_ack_bitmap = 1;
+						pr_clock->notify_all(pr_ack_cond); // Wakes send_frame() up before the ACK timeout
+						pr_stats.inc(STAT_ACKS_RECEIVED);
+						if(pr_debug) std::cout << "Ack for me!" << std::endl << std::flush;
+					}
+				} break;
+
+				case FC_BLOCK_ACK: {
+					boost::unique_lock<boost::mutex> lock(pr_mu3);
+					if(is_mine and pr_ack_expected == FC_BLOCK_ACK and h->seq_nr == pr_frame_seq_nr and pmt::blob_length(cdr) >= 24 + sizeof(uint16_t)) {
+						memcpy(&pr_ack_bitmap, (uint8_t*)pmt::blob_data(cdr) + 24, sizeof(uint16_t));
+						pr_acked = true;
+						pr_clock->notify_all(pr_ack_cond);
+						pr_stats.inc(STAT_ACKS_RECEIVED);
+						if(pr_debug) std::cout << "Block ack for me! Bitmap = " << std::hex << pr_ack_bitmap << std::dec << std::endl << std::flush;
+					}
+				} break;
+					
+				case FC_METRICS: {
+					if(is_mine) {
+						pmt::pmt_t ack = generate_ack_frame(frame);
+						publish_held(msg_port_frame_to_phy, ack);
+					}
+				} break;
+
+				case FC_PROTOCOL: {
+					// TODO
+				} break;
+
+				default: {
+					if(pr_debug) std::cout << "Unkown frame type." << std::endl << std::flush;
+					return;
+				}
+			}
+		}
+
+		void receive_ampdu(pmt::pmt_t frame) {
+			// Subframes with a valid FCS are delivered and reported in the block ACK. Others will be sent again.
+			pmt::pmt_t cdr = pmt::cdr(frame);
+			uint8_t *psdu = (uint8_t*)pmt::blob_data(cdr);
+			mac_header *h = (mac_header*)psdu;
+			size_t len = pmt::blob_length(cdr);
+			ampdu_subframe subframes[AMPDU_MAX_SUBFRAMES];
+			uint16_t bitmap = 0;
+			int n;
+
+			if(len < 24 + sizeof(uint32_t)) return;
+			n = ampdu_parse(psdu + 24, len - 24 - sizeof(uint32_t), subframes, AMPDU_MAX_SUBFRAMES);
+
+			for(int i = 0; i < n; i++) {
+				if(!subframes[i].fcs_ok) continue;
+				bitmap |= 1 << subframes[i].index;
+
+				uint8_t *mpdu = psdu + 24 + subframes[i].offset;
+				mac_header *sub = (mac_header*)mpdu;
+				if(pr_dup.is_duplicate(sub->addr2, sub->seq_nr, pr_clock->now())) {
+					pr_stats.inc(STAT_DUPLICATES);
+					if(pr_debug) std::cout << "Duplicate subframe. Not delivered to app." << std::endl << std::flush;
+					continue;
+				}
+				message_port_pub(msg_port_frame_to_app, pmt::cons(pr_crc_dict, pmt::make_blob(mpdu, subframes[i].length)));
+				pr_stats.inc(STAT_RX_FRAMES);
+			}
+
+			if(pr_debug) std::cout << "A-MPDU with " << n << " subframes. Block ack sent! Bitmap = " << std::hex << bitmap << std::dec << std::endl << std::flush;
+			publish_held(msg_port_frame_to_phy, generate_frame((uint8_t*)&bitmap, sizeof(uint16_t), FC_BLOCK_ACK, h->seq_nr, h->addr2, 0x0000));
+			pr_stats.inc(STAT_ACKS_SENT);
+		}
+
+		void cs_in(pmt::pmt_t msg) {
+			mac_clock::scoped_release release(*pr_clock);
+			boost::unique_lock<boost::mutex> lock(pr_mu1);
+			pr_avg_power = pmt::to_float(msg);
+			
+			pr_sensing = false;
+			pr_clock->notify_all(pr_cs_cond);
+		}
+
+		virtual void publish_held(pmt::pmt_t port, pmt::pmt_t msg) {
+			// Frames and CS requests: under a virtual clock, time stands still until every receiver has handled msg.
+			// qa_csma_ca overrides it to stand for the PHY and the CS block.
+			pr_clock->hold(pmt::length(message_subscribers(port)));
+			message_port_pub(port, msg);
+		}
+
+		pmt::pmt_t generate_ack_frame(pmt::pmt_t frame) {
+			mac_header *frame_header = (mac_header*)pmt::blob_data(pmt::cdr(frame));
+
+			// Only the fields that depend on the received frame are patched on the prebuilt ACK.
+			// ACK closes the exchange, so it reserves the medium no further.
+			pmt::pmt_t ack = pr_ack.build(frame_header->addr2, frame_header->addr3, 0x0000, frame_header->seq_nr);
+
+			if (pr_debug) std::cout << "Seq num of rx frame = " << frame_header->seq_nr << std::endl;
+
+			return ack;
+		}
+
+		pmt::pmt_t generate_frame(uint8_t *msdu, int msdu_size, uint16_t fc, uint16_t seq_nr, uint8_t *dst_addr, uint16_t duration) {
+			// Inputs: (data, data size, frame control, sequence number, destination address, NAV duration)
+			mac_header header;
+			header.frame_control = fc;
+			header.duration = duration;
+			header.seq_nr = seq_nr;
+
+			memcpy(header.addr1, dst_addr, 6);
+			memcpy(header.addr2, pr_mac_addr, 6);
+			memcpy(header.addr3, pr_broadcast_addr, 6);
+
+			uint8_t psdu[AMPDU_MAX_LEN];
+			memcpy(psdu, &header, 24); // Header is 24 bytes long
+			if(msdu_size > 0) memcpy(psdu + 24, msdu, msdu_size);
+
+			uint32_t fcs = crc32(psdu, 24 + msdu_size);
+
+			memcpy(psdu + 24 + msdu_size, &fcs, sizeof(uint32_t));
+
+			// Building frame from cdr & car
+			return pmt::cons(pr_crc_dict, pmt::make_blob(psdu, 24 + msdu_size + sizeof(uint32_t)));
+		}
+
+	private:
+		int pr_slot_time, pr_sifs, pr_difs, pr_frame_id, pr_alpha, pr_threshold;
+		bool pr_debug, pr_aggregation, pr_sensing, pr_acked, pr_medium_busy, pr_frame_arrived;
+		float pr_avg_power;
+		double pr_cs_samp_rate; // Samples/s of the power stream input, 0 if CS is done by an external block
+		power_ring pr_power;
+		boost::condition_variable pr_cs_cond, pr_medium_cond, pr_ack_cond;
+		boost::mutex pr_mu1, pr_mu2, pr_mu3;
+		boost::shared_ptr<gr::thread::thread> thread_send_frame;
+
+		// Input ports
+		pmt::pmt_t msg_port_frame_from_buff = pmt::mp("frame from buffer");
+		pmt::pmt_t msg_port_frame_from_phy = pmt::mp("frame from phy");
+		pmt::pmt_t msg_port_cs_in = pmt::mp("cs in");
+		pmt::pmt_t msg_port_stats_request = pmt::mp("stats request");
+
+		// Output ports
+		pmt::pmt_t msg_port_frame_to_phy = pmt::mp("frame to phy");
+		pmt::pmt_t msg_port_frame_request = pmt::mp("frame request");
+		pmt::pmt_t msg_port_request_to_cs = pmt::mp("request to cs");
+		pmt::pmt_t msg_port_frame_to_app = pmt::mp("frame to app");
+		pmt::pmt_t msg_port_stats = pmt::mp("stats");
+
+		// MAC addr 
+		uint8_t pr_mac_addr[6], pr_broadcast_addr[6];
+
+		// Frame to be sent
+		uint16_t pr_frame_seq_nr;
+
+		// Access categories, indexed by AC_*. Only touched by send_frame().
+		std::vector<access_category> pr_ac;
+		uint16_t pr_ampdu_seq;
+
+		// Answer send_frame() is waiting for (FC_ACK, FC_BLOCK_ACK or 0) and subframes acked so far. Guarded by pr_mu3.
+		uint16_t pr_ack_expected, pr_ack_bitmap;
+
+		pmt::pmt_t pr_crc_dict = pmt::dict_add(pmt::make_dict(), pmt::mp("crc_included"), pmt::PMT_T);
+
+		// Local buffer. Producer: frame_from_buff(), consumer: send_frame().
+		spsc_ring<pmt::pmt_t> pr_buff;
+
+		decltype(clock::now()) pr_busy_time; // When the medium was found busy during the countdown
+
+		// Virtual carrier sense. pr_nav is guarded by pr_mu2.
+		uint16_t pr_nav_duration; // (us, unscaled) SIFS + ACK, announced by unicast data frames
+		int pr_nav_sifs; // (us, unscaled)
+
+		// Frames longer than this (bytes) are preceded by RTS/CTS. Negative: never.
+		int pr_rts_threshold;
+		decltype(clock::now()) pr_nav; // Medium is reserved by other stations until then
+
+		// Prebuilt ACK frame
+		ack_template pr_ack;
+
+		// Received (transmitter, seq_nr)
+		dup_cache pr_dup;
+
+		// Time source: real time unless the block was made with a virtual clock
+		mac_clock::sptr pr_clock;
+
+		mac_stats pr_stats{STAT_TX_ATTEMPTS, STAT_RETRIES, STAT_ACKS_RECEIVED, STAT_ACKS_SENT, STAT_RX_FRAMES, STAT_DUPLICATES,
+			STAT_DROPS_RETRY_LIMIT, STAT_DROPS_MEDIUM_BUSY, STAT_DROPS_QUEUE_FULL, STAT_CS_REQUESTS, STAT_CS_BUSY, STAT_QUEUE_HIGH_WATER};
+
+		// Per frame stage latencies, recorded by send_frame()
+		latency_histogram pr_lat_queue; // Enqueued -> taken by the MAC
+		latency_histogram pr_lat_access; // Taken by the MAC -> first transmission
+		latency_histogram pr_lat_ack; // First transmission -> ACK (unicast only)
+		latency_histogram pr_lat_total; // Enqueued -> ACK
+		latency_histogram pr_lat_drop; // Enqueued -> dropped
+		pmt::pmt_t pr_enqueued_key = pmt::mp("enqueued");
+};
+
+#endif /* INCLUDED_MACPROTOCOLS_CSMA_CA_IMPL_H */
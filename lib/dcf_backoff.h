@@ -0,0 +1,109 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_DCF_BACKOFF_H
+#define INCLUDED_MACPROTOCOLS_DCF_BACKOFF_H
+
+#include <chrono>
+#include <cstdlib>
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Backoff procedure of the IEEE 802.11 DCF (802.11-2016, 10.3.4.3).
+		 *
+		 * The counter is decremented once per idle slot. Slots are not sensed one by one: while the
+		 * countdown is running, the remaining slots are derived from the clock, so the counter
+		 * reaches zero at deadline(). When the medium turns busy the counter is frozen with the
+		 * slots already elapsed, and it only resumes after the medium has been idle for DIFS again.
+		 * The contention window is doubled on a missed ACK and reset after a success, never because
+		 * the medium was found busy.
+		 */
+		class dcf_backoff {
+			typedef std::chrono::high_resolution_clock clock;
+
+			public:
+				// cw_min and cw_max are the window sizes, i.e. aCWmin + 1 and aCWmax + 1
+				dcf_backoff(unsigned int cw_min, unsigned int cw_max, int slot_time)
+					: d_cw_min(cw_min), d_cw_max(cw_max), d_cw(cw_min), d_slots(0), d_slot_time(slot_time), d_counting(false) {}
+
+				// Backoff = Random() x aSlotTime, Random = [0, cw - 1]
+				void draw() {
+					d_slots = rand() % d_cw;
+				}
+
+				// Medium has been idle for DIFS; the countdown runs from "now" on.
+				void resume(clock::time_point now) {
+					d_resume = now;
+					d_counting = true;
+				}
+
+				// Medium became busy at "when". Keep the slots that were not counted yet.
+				void freeze(clock::time_point when) {
+					if(!d_counting) return;
+					d_slots = remaining(when);
+					d_counting = false;
+				}
+
+				unsigned int remaining(clock::time_point now) const {
+					if(!d_counting or now <= d_resume) return d_slots;
+					long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - d_resume).count() / d_slot_time;
+					return elapsed >= (long)d_slots ? 0 : d_slots - elapsed;
+				}
+
+				// Time at which the counter reaches zero, provided that the medium remains idle
+				clock::time_point deadline() const {
+					return d_resume + std::chrono::microseconds((long)d_slots*d_slot_time);
+				}
+
+				bool counting() const {
+					return d_counting;
+				}
+
+				// Frame was acked (or it was a broadcast): reset the window and draw a post-backoff.
+				void success() {
+					d_cw = d_cw_min;
+					d_counting = false;
+					draw();
+				}
+
+				// ACK is missing: double the window and draw a new backoff for the retransmission.
+				void collision() {
+					d_cw = d_cw*2 > d_cw_max ? d_cw_max : d_cw*2;
+					d_counting = false;
+					draw();
+				}
+
+				unsigned int cw() const {
+					return d_cw;
+				}
+
+			private:
+				unsigned int d_cw_min, d_cw_max, d_cw, d_slots;
+				int d_slot_time;
+				bool d_counting;
+				clock::time_point d_resume;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_DCF_BACKOFF_H */
@@ -0,0 +1,123 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_DUP_CACHE_H
+#define INCLUDED_MACPROTOCOLS_DUP_CACHE_H
+
+#include "ampdu.h"
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+
+#define DUP_CACHE_SIZE 64 // Transmitters tracked, power of 2
+#define DUP_CACHE_PROBES 8 // Max linear probing distance
+#define DUP_CACHE_DEPTH AMPDU_MAX_SUBFRAMES // Last sequence numbers kept per transmitter: a whole A-MPDU, resent after a lost block ACK
+#define DUP_CACHE_TIMEOUT 10000000 // (us) Entries not refreshed for this long are forgotten
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Receive-side duplicate detection (802.11-2016, 10.3.2.11), keyed by (addr2, seq_nr).
+		 *
+		 * When an ACK is lost the transmitter sends the same frame again. It must be acked again,
+		 * but it must not reach the upper layer twice. Each transmitter owns one entry of a small
+		 * open-addressed table holding its last DUP_CACHE_DEPTH sequence numbers, as many as an
+		 * A-MPDU carries: when its block ACK is lost, all of its subframes come again (a block-ack
+		 * scoreboard, 802.11-2016, 10.24.7.3). Stale entries are reused, and when the probing window
+		 * is full the least recently seen one is evicted.
+		 *
+		 * Not thread-safe: it is meant to be used from the handler of "frame from phy" only.
+		 */
+		class dup_cache {
+			typedef std::chrono::high_resolution_clock clock;
+
+			public:
+				dup_cache(long timeout_us = DUP_CACHE_TIMEOUT) : d_timeout(timeout_us) {
+					for(int i = 0; i < DUP_CACHE_SIZE; i++) d_table[i] = entry();
+				}
+
+				// True if (addr, seq_nr) was seen recently. Otherwise, it is recorded and false is returned.
+				bool is_duplicate(const uint8_t *addr, uint16_t seq_nr, clock::time_point now) {
+					entry *e = find(addr, now);
+
+					for(int i = 0; i < e->count; i++) {
+						if(e->seqs[i] == seq_nr) {
+							e->last_seen = now;
+							return true;
+						}
+					}
+
+					e->seqs[e->next] = seq_nr;
+					e->next = (e->next + 1) % DUP_CACHE_DEPTH;
+					if(e->count < DUP_CACHE_DEPTH) e->count++;
+					e->last_seen = now;
+					return false;
+				}
+
+			private:
+				struct entry {
+					uint8_t addr[6];
+					bool used;
+					uint8_t count, next;
+					uint16_t seqs[DUP_CACHE_DEPTH];
+					clock::time_point last_seen;
+				};
+
+				bool expired(const entry &e, clock::time_point now) const {
+					return std::chrono::duration_cast<std::chrono::microseconds>(now - e.last_seen).count() > d_timeout;
+				}
+
+				// Entry of addr, a recycled one if addr is unknown
+				entry* find(const uint8_t *addr, clock::time_point now) {
+					// FNV-1a over the MAC address
+					uint32_t hash = 2166136261u;
+					for(int i = 0; i < 6; i++) hash = (hash ^ addr[i])*16777619u;
+
+					entry *victim = NULL;
+					for(int i = 0; i < DUP_CACHE_PROBES; i++) {
+						entry *e = &d_table[(hash + i) & (DUP_CACHE_SIZE - 1)];
+
+						if(!e->used) { // End of the probing chain, addr is not in the table
+							if(!victim) victim = e;
+							break;
+						}
+						if(memcmp(e->addr, addr, 6) == 0) {
+							if(expired(*e, now)) e->count = 0;
+							return e;
+						}
+						if(!victim or (victim->used and e->last_seen < victim->last_seen)) victim = e;
+					}
+
+					memcpy(victim->addr, addr, 6);
+					victim->used = true;
+					victim->count = 0;
+					victim->next = 0;
+					return victim;
+				}
+
+				long d_timeout;
+				entry d_table[DUP_CACHE_SIZE];
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_DUP_CACHE_H */
@@ -0,0 +1,57 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_EDCA_H
+#define INCLUDED_MACPROTOCOLS_EDCA_H
+
+#include <pmt/pmt.h>
+
+// EDCA access categories (802.11-2016, 10.22.2), lowest priority first
+#define AC_BK 0 // Background
+#define AC_BE 1 // Best effort
+#define AC_VI 2 // Video
+#define AC_VO 3 // Voice
+#define NUM_AC 4
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Access category of a frame, from the user priority (0-7, 802.1D) found under the "priority"
+		 * key of its metadata dict. Frames without a valid priority are best effort.
+		 */
+		inline int edca_access_category(pmt::pmt_t frame) {
+			static const int up_to_ac[8] = {AC_BE, AC_BK, AC_BK, AC_BE, AC_VI, AC_VI, AC_VO, AC_VO};
+			static const pmt::pmt_t key = pmt::mp("priority");
+
+			pmt::pmt_t car = pmt::car(frame);
+			if(!pmt::is_dict(car)) return AC_BE;
+
+			pmt::pmt_t up = pmt::dict_ref(car, key, pmt::PMT_NIL);
+			if(!pmt::is_integer(up)) return AC_BE;
+
+			long p = pmt::to_long(up);
+			return p >= 0 and p < 8 ? up_to_ac[p] : AC_BE;
+		}
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_EDCA_H */
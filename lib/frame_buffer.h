@@ -47,6 +47,9 @@ namespace gr {
        * creating new instances.
        */
       static sptr make(int buff_size, bool arp, uint8_t portid, bool debug);
+
+      //! Counters of the block (dict name -> uint64), also published on the "stats" port on request
+      virtual pmt::pmt_t stats() = 0;
     };
 
   } // namespace macprotocols
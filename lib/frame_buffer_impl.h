@@ -0,0 +1,351 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Implementation class of the frame_buffer block, see frame_buffer.cc. Only included by
+ * frame_buffer.cc and by bench_macprotocols.cc, which drives its handlers directly.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_FRAME_BUFFER_IMPL_H
+#define INCLUDED_MACPROTOCOLS_FRAME_BUFFER_IMPL_H
+
+#include <gnuradio/io_signature.h>
+#include "frame_buffer.h"
+#include <string.h>
+#include "crc32.h"
+#include "edca.h"
+#include "mac_stats.h"
+#include "latency_histogram.h"
+#include <boost/circular_buffer.hpp>
+#include <pmt/pmt.h>
+
+// ARP table path
+#ifndef ARP_CACHE
+#define ARP_CACHE "/proc/net/arp"
+#endif
+#define NUM_REQ_PORTS 3
+
+using namespace gr::macprotocols;
+
+class frame_buffer_impl : public frame_buffer {
+  public:
+
+    frame_buffer_impl(int buff_size, bool arp, uint8_t portid, bool debug)
+      : gr::block("frame_buffer",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::make(0, 0, 0)),
+              pr_buff_size(buff_size), pr_arp(arp), pr_portid(portid), pr_debug(debug){
+
+      // Init buffer
+      pr_circ_buff.rset_capacity(pr_buff_size);
+      std::cout << "Buffer capacity = " << pr_circ_buff.capacity() << std::endl << std::flush;
+
+      // Inpurt msg ports
+      message_port_register_in(msg_port_appin);
+      set_msg_handler(msg_port_appin, boost::bind(&frame_buffer_impl::appin, this, _1));
+
+      message_port_register_in(msg_port_ctrlin);
+      set_msg_handler(msg_port_ctrlin, boost::bind(&frame_buffer_impl::ctrlin, this, _1));
+
+      message_port_register_in(msg_port_req0);
+      set_msg_handler(msg_port_req0, boost::bind(&frame_buffer_impl::req0, this, _1));
+
+      message_port_register_in(msg_port_req1);
+      set_msg_handler(msg_port_req1, boost::bind(&frame_buffer_impl::req1, this, _1));
+
+      message_port_register_in(msg_port_req2);
+      set_msg_handler(msg_port_req2, boost::bind(&frame_buffer_impl::req2, this, _1));
+
+      message_port_register_in(msg_port_broad);
+      set_msg_handler(msg_port_broad, boost::bind(&frame_buffer_impl::broad, this, _1));
+
+      message_port_register_in(msg_port_metrics);
+      set_msg_handler(msg_port_metrics, boost::bind(&frame_buffer_impl::metrics, this, _1));
+
+      message_port_register_in(msg_port_stats_request);
+      set_msg_handler(msg_port_stats_request, boost::bind(&frame_buffer_impl::stats_request, this, _1));
+
+      // Output msg ports
+      message_port_register_out(msg_port_frame0);
+      message_port_register_out(msg_port_frame1);
+      message_port_register_out(msg_port_frame2);
+      message_port_register_out(msg_port_bsz_out);
+      message_port_register_out(msg_port_stats);
+
+      // No MAC has advertised free slots yet
+      for(int i = 0; i < NUM_REQ_PORTS; i++) pr_credits[i] = 0;
+
+      pr_num_prio = 0;
+    }
+
+    void appin(pmt::pmt_t frame) {
+      // Data from upper layer
+      if(pr_arp) {
+        uint8_t ip_dst[4], mac[6];
+        pmt::pmt_t cdr = pmt::cdr(frame);
+        uint8_t *f = (uint8_t*) pmt::blob_data(cdr);
+        int frame_len = pmt::blob_length(cdr);
+        memcpy(ip_dst, f + 48, 4);
+
+        if(lookup_arp(ip_dst, mac)) {
+          if(pr_debug) std::cout << "Dest MAC = ";
+          for(int i = 0; i < 5; i++) if(pr_debug) std::cout << +mac[i] << ":";
+          if(pr_debug) std::cout << +mac[5] << std::endl << std::flush;
+
+          uint32_t fcs;
+          if(pmt::dict_has_key(pmt::car(frame), pmt::mp("crc_included"))) {
+            // FCS is valid already, so only the 6 bytes rewritten are processed
+            memcpy(&fcs, f + frame_len - 4, sizeof(uint32_t));
+            fcs = crc32_patch(fcs, frame_len - 4, 4, f + 4, mac, 6);
+            memcpy(f + 4, mac, 6);
+          } else {
+            memcpy(f + 4, mac, 6);
+            fcs = crc32(f, frame_len - 4);
+          }
+
+          memcpy(f + frame_len - 4, &fcs, sizeof(uint32_t));
+
+          cdr = pmt::make_blob(f, frame_len);
+          pmt::pmt_t car = pmt::make_dict();
+          car = pmt::dict_add(car, pmt::mp("crc_included"), pmt::PMT_T);
+
+          frame = pmt::cons(car, cdr);
+        } else {
+          if(pr_debug) std::cout << "Unknown dest MAC" << std::endl << std::flush;
+        }
+      }
+
+      if(pr_circ_buff.size() >= pr_buff_size) {
+        pr_stats.inc(STAT_DROPS_QUEUE_FULL);
+        if(pr_debug) std::cout << "BUFFER IS FULL!" << std::endl << std::flush;
+      } else {
+        // Arrival time, the MAC measures queueing and end-to-end latencies from it
+        pmt::pmt_t car = pmt::car(frame);
+        if(!pmt::is_dict(car)) car = pmt::make_dict();
+        frame = pmt::cons(pmt::dict_add(car, pr_enqueued_key, pmt::from_uint64(latency_stamp())), pmt::cdr(frame));
+
+        pr_circ_buff.push_back(frame);
+        if(edca_access_category(frame) > AC_BE) pr_num_prio++;
+        pr_stats.inc(STAT_ENQUEUED);
+        pr_stats.high_water(STAT_QUEUE_HIGH_WATER, pr_circ_buff.size());
+
+        // Report buffer size
+        report_buffsize();
+
+        push_frames();
+      }
+    }
+
+    bool lookup_arp(uint8_t *ip, uint8_t *mac) {
+      char line[256], buff[256];
+      int intip[4], intmac[6];
+      uint8_t int8ip[4];
+
+      FILE *fp = fopen(ARP_CACHE, "r");
+      if(fgets(line, sizeof(line), fp)) {} // Skips first line
+
+      while(fgets(line, sizeof(line), fp)) {
+        sscanf(line, "%d.%d.%d.%d %s %s %x:%x:%x:%x:%x:%x %s\n",
+          &intip[0], &intip[1], &intip[2], &intip[3], buff, buff + 32,
+          &intmac[0], &intmac[1], &intmac[2], &intmac[3], &intmac[4], &intmac[5], buff + 64);
+
+        for(int i = 0; i < 4; i++) int8ip[i] = (uint8_t) intip[i];
+        if(memcmp(ip, int8ip, 4) == 0) {
+          for(int i = 0; i < 6; i++) mac[i] = (uint8_t) intmac[i];
+          fclose(fp);
+          return true;
+        }
+      }
+      fclose(fp);
+      return false;
+    }
+
+    void ctrlin(pmt::pmt_t ctrl_msg) {
+      std::string str = pmt::symbol_to_string(ctrl_msg);
+      
+      if(str == "portid-1") pr_portid = -1; // This means there is no chosen protocol
+      else if(str == "portid0") pr_portid = 0;
+      else if(str == "portid1") pr_portid = 1;
+      else if(str == "portid2") pr_portid = 2;
+      else return;
+
+      if(pr_debug) std::cout << "Port id = " << (int)pr_portid << std::endl << std::flush;
+
+      push_frames(); // New port may already hold credits
+    }
+
+    // REQUEST PORTS
+    /* A MAC pulls frames from the buffer by publishing on its "frame request" port.
+       Two kinds of request are accepted:
+         1. Symbol "get frame": one-shot pull, a frame is sent only if the buffer is not empty;
+         2. Integer n (credit): the MAC has n more free slots in its local buffer. Credits are
+            kept per port and frames are pushed as soon as they arrive in appin(), so the MAC
+            does not need to poll the buffer.
+    */
+
+    void req0(pmt::pmt_t msg) {
+      request(0, msg);
+    }
+
+    void req1(pmt::pmt_t msg) {
+      request(1, msg);
+    }
+
+    void req2(pmt::pmt_t msg) {
+      request(2, msg);
+    }
+
+    void request(uint8_t portid, pmt::pmt_t msg) {
+      if(pmt::is_integer(msg)) {
+        pr_credits[portid] += pmt::to_long(msg);
+        if(pr_debug) std::cout << "Port " << (int)portid << " has " << pr_credits[portid] << " credits." << std::endl << std::flush;
+      } else if(pmt::is_symbol(msg) and pmt::symbol_to_string(msg) == "get frame" and pr_portid == portid) {
+        if(pr_circ_buff.size() > 0) send_frame(portid);
+      }
+
+      push_frames();
+    }
+
+    void push_frames() {
+      // Serves the active port while it has credits left
+      if(pr_portid >= NUM_REQ_PORTS) return;
+
+      while(pr_credits[pr_portid] > 0 and pr_circ_buff.size() > 0) {
+        send_frame(pr_portid);
+        pr_credits[pr_portid]--;
+      }
+    }
+
+    void send_frame(uint8_t portid) {
+      size_t i = next_frame();
+      message_port_pub(*pr_frame_ports[portid], pr_circ_buff[i]);
+      if(edca_access_category(pr_circ_buff[i]) > AC_BE) pr_num_prio--;
+      if(i == 0) pr_circ_buff.pop_front();
+      else pr_circ_buff.erase(pr_circ_buff.begin() + i);
+      pr_stats.inc(STAT_DEQUEUED);
+
+      // Report buffer size
+      report_buffsize();
+
+      if(pr_debug) std::cout << "Frame was sent from BUFFER. Buffer size = " << pr_circ_buff.size() << std::endl << std::flush;
+    }
+
+    size_t next_frame() {
+      /* Frames of a higher access category (priority key, see edca.h) overtake the others, so that a
+         MAC running EDCA gets them first. Most of the time no such frame is queued and the head is taken. */
+      if(pr_num_prio == 0) return 0;
+
+      size_t best = 0;
+      int best_ac = edca_access_category(pr_circ_buff[0]);
+      for(size_t i = 1; i < pr_circ_buff.size() and best_ac < AC_VO; i++) {
+        int ac = edca_access_category(pr_circ_buff[i]);
+        if(ac > best_ac) {
+          best = i;
+          best_ac = ac;
+        }
+      }
+      return best;
+    }
+
+    void push_front(pmt::pmt_t frame) {
+      // A full circular buffer drops its last frame to make room
+      if(pr_circ_buff.full()) {
+        if(edca_access_category(pr_circ_buff.back()) > AC_BE) pr_num_prio--;
+        pr_stats.inc(STAT_DROPS_QUEUE_FULL);
+      }
+      pr_circ_buff.push_front(frame);
+      if(edca_access_category(frame) > AC_BE) pr_num_prio++;
+      pr_stats.inc(STAT_ENQUEUED);
+      pr_stats.high_water(STAT_QUEUE_HIGH_WATER, pr_circ_buff.size());
+    }
+
+    void broad(pmt::pmt_t broad_frame) { // Broadcasting frame, it bypasses the queue
+      push_front(broad_frame);
+
+      // Report buffer size
+      report_buffsize();
+
+      push_frames();
+    }
+
+    void metrics(pmt::pmt_t metrics_frame) { // Metrics' frame, it bypasses the queue
+      push_front(metrics_frame);
+
+      push_frames();
+    }
+
+    pmt::pmt_t stats() {
+      return pr_stats.snapshot();
+    }
+
+    void stats_request(pmt::pmt_t msg) {
+      message_port_pub(msg_port_stats, stats());
+    }
+  
+  private:
+    // Internal variables
+    bool pr_arp, pr_debug;
+    uint8_t pr_portid;
+
+    // Buffer from upper layer
+    int pr_buff_size;
+    boost::circular_buffer<pmt::pmt_t> pr_circ_buff;
+
+    // Free slots advertised by the MAC on each request port
+    long pr_credits[NUM_REQ_PORTS];
+
+    // Queued frames whose access category is above best effort
+    int pr_num_prio;
+
+    mac_stats pr_stats{STAT_ENQUEUED, STAT_DEQUEUED, STAT_DROPS_QUEUE_FULL, STAT_QUEUE_HIGH_WATER};
+
+    pmt::pmt_t pr_enqueued_key = pmt::mp("enqueued");
+
+    // Input ports
+    pmt::pmt_t msg_port_appin   = pmt::mp("app in");
+    pmt::pmt_t msg_port_ctrlin  = pmt::mp("ctrl in");
+    pmt::pmt_t msg_port_req0    = pmt::mp("req in 0");
+    pmt::pmt_t msg_port_req1    = pmt::mp("req in 1");
+    pmt::pmt_t msg_port_req2    = pmt::mp("req in 2");
+    pmt::pmt_t msg_port_broad   = pmt::mp("broad in");
+    pmt::pmt_t msg_port_metrics = pmt::mp("metrics in");
+    pmt::pmt_t msg_port_stats_request = pmt::mp("stats request");
+
+    // Output ports
+    pmt::pmt_t msg_port_frame0  = pmt::mp("frame out 0");
+    pmt::pmt_t msg_port_frame1  = pmt::mp("frame out 1");
+    pmt::pmt_t msg_port_frame2  = pmt::mp("frame out 2");
+    pmt::pmt_t msg_port_bsz_out = pmt::mp("bsz out"); // buffer size request output
+    pmt::pmt_t msg_port_stats   = pmt::mp("stats");
+    pmt::pmt_t *pr_frame_ports[NUM_REQ_PORTS] = {&msg_port_frame0, &msg_port_frame1, &msg_port_frame2};
+
+    void report_buffsize() {
+      /*This reports the buffer size to the metrics generator block.
+        The buffer size is reported when:
+          1. A new packet is added to buffer;
+          2. A packet is removed from buffer;
+      */
+      float bsz = pr_circ_buff.size();
+
+      message_port_pub(msg_port_bsz_out, pmt::from_float(bsz));
+    }
+};
+
+#endif /* INCLUDED_MACPROTOCOLS_FRAME_BUFFER_IMPL_H */
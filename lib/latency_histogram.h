@@ -0,0 +1,125 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_LATENCY_HISTOGRAM_H
+#define INCLUDED_MACPROTOCOLS_LATENCY_HISTOGRAM_H
+
+#include <pmt/pmt.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#define LATENCY_SUB_BITS 5 // 32 linear sub-buckets per power of two: ~3% relative error
+#define LATENCY_MAX_MSB 40 // Values from 2^41 ns (~36 min) on land in the last bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_MSB - LATENCY_SUB_BITS + 2) << LATENCY_SUB_BITS)
+
+namespace gr {
+	namespace macprotocols {
+
+		// Time stamps carried by frames between blocks ("enqueued" key of the metadata dict), in ns
+		inline uint64_t latency_stamp() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+		}
+
+		/*
+		 * Log-linear (HDR style) histogram of latencies in ns. Values below 2^LATENCY_SUB_BITS get a
+		 * bucket each, every power of two above is split in 2^LATENCY_SUB_BITS equal buckets, so the
+		 * error relative to the value is bounded whatever its magnitude. Recording is a couple of
+		 * relaxed atomic adds, no lock: the send thread records while anyone reads percentiles.
+		 */
+		class latency_histogram {
+			public:
+				latency_histogram() {
+					for(int i = 0; i < LATENCY_BUCKETS; i++) d_counts[i].store(0, std::memory_order_relaxed);
+					d_total.store(0, std::memory_order_relaxed);
+					d_max.store(0, std::memory_order_relaxed);
+				}
+
+				void record(int64_t ns) {
+					uint64_t value = ns > 0 ? ns : 0;
+					d_counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+					d_total.fetch_add(1, std::memory_order_relaxed);
+
+					uint64_t cur = d_max.load(std::memory_order_relaxed);
+					while(value > cur and !d_max.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+				}
+
+				template<class duration>
+				void record(duration d) {
+					record((int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+				}
+
+				uint64_t count() const { return d_total.load(std::memory_order_relaxed); }
+
+				// Highest value of the bucket holding the q-quantile (0 < q <= 1), so tails are never underestimated
+				uint64_t percentile(double q) const {
+					uint64_t total = 0, seen = 0, target;
+					for(int i = 0; i < LATENCY_BUCKETS; i++) total += d_counts[i].load(std::memory_order_relaxed);
+					if(total == 0) return 0;
+
+					target = (uint64_t)(q*total + 0.999999);
+					if(target == 0) target = 1;
+
+					for(int i = 0; i < LATENCY_BUCKETS; i++) {
+						seen += d_counts[i].load(std::memory_order_relaxed);
+						if(seen < target) continue;
+						if(i == LATENCY_BUCKETS - 1) break; // Unbounded last bucket: only the max is known not to be too low
+						return std::min(highest(i), d_max.load(std::memory_order_relaxed));
+					}
+					return d_max.load(std::memory_order_relaxed);
+				}
+
+				// Dict count, p50, p99, p999, max (ns)
+				pmt::pmt_t snapshot() const {
+					pmt::pmt_t dict = pmt::make_dict();
+					dict = pmt::dict_add(dict, pmt::mp("count"), pmt::from_uint64(count()));
+					dict = pmt::dict_add(dict, pmt::mp("p50"), pmt::from_uint64(percentile(0.5)));
+					dict = pmt::dict_add(dict, pmt::mp("p99"), pmt::from_uint64(percentile(0.99)));
+					dict = pmt::dict_add(dict, pmt::mp("p999"), pmt::from_uint64(percentile(0.999)));
+					dict = pmt::dict_add(dict, pmt::mp("max"), pmt::from_uint64(d_max.load(std::memory_order_relaxed)));
+					return dict;
+				}
+
+			private:
+				static int index(uint64_t value) {
+					if(value < (1u << LATENCY_SUB_BITS)) return value;
+
+					int msb = 63 - __builtin_clzll(value);
+					if(msb > LATENCY_MAX_MSB) return LATENCY_BUCKETS - 1;
+
+					int shift = msb - LATENCY_SUB_BITS;
+					return ((shift + 1) << LATENCY_SUB_BITS) + (int)((value >> shift) - (1u << LATENCY_SUB_BITS));
+				}
+
+				static uint64_t highest(int index) {
+					int bucket = index >> LATENCY_SUB_BITS, sub = index & ((1 << LATENCY_SUB_BITS) - 1);
+					if(bucket == 0) return sub;
+					return (((uint64_t)(1 << LATENCY_SUB_BITS) + sub + 1) << (bucket - 1)) - 1;
+				}
+
+				std::atomic<uint64_t> d_counts[LATENCY_BUCKETS];
+				std::atomic<uint64_t> d_total, d_max;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_LATENCY_HISTOGRAM_H */
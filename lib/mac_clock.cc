@@ -0,0 +1,329 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <macprotocols/mac_clock.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+
+// Last stretch of spin_until() that is spun rather than slept, bounds in ns
+#define SPIN_MIN_MARGIN 5000
+#define SPIN_MAX_MARGIN 2000000
+#define SPIN_START_MARGIN 50000
+#define SPIN_STEP 8 // Margin moves by 1/SPIN_STEP of itself
+#define SPIN_QUANTILE 0.995 // Share of the sleeps that should wake up before the deadline
+#define SPIN_DOWN_RATIO ((1 - SPIN_QUANTILE)/SPIN_QUANTILE) // Step down of the margin, relative to a step up
+#define SPIN_CALIBRATION_SLEEPS 50
+
+namespace gr {
+	namespace macprotocols {
+
+		namespace {
+
+			/*
+			 * spin_until() sleeps until shortly before the deadline and spins only through the end, so
+			 * that a node waiting for its slot no longer keeps a core busy. How early it wakes up is
+			 * learnt from the wake up delays of its own sleeps, measured a few times when the clock is
+			 * made and then on every call: the margin follows a high quantile of them, in steps relative
+			 * to itself, so a rare wake up that is late by milliseconds does not turn the sleep back into
+			 * a spin, while a machine with slow wake ups is learnt in a few dozen sleeps.
+			 * Threads of every block update the same margin, races between them only lose a sample.
+			 */
+			class realtime_clock : public mac_clock {
+				public:
+					realtime_clock() : d_margin(SPIN_START_MARGIN) {
+						for(int i = 0; i < SPIN_CALIBRATION_SLEEPS; i++) {
+							time_point t = now() + std::chrono::microseconds(100);
+							sleep_abs(t);
+							learn(std::chrono::duration_cast<std::chrono::nanoseconds>(now() - t));
+						}
+					}
+
+					time_point now() {
+						return std::chrono::high_resolution_clock::now();
+					}
+
+					void sleep_until(time_point t) {
+						long remaining;
+						while((remaining = std::chrono::duration_cast<std::chrono::microseconds>(t - now()).count()) > 0) {
+							boost::this_thread::sleep(boost::posix_time::microseconds(remaining));
+						}
+					}
+
+					void spin_until(time_point t) {
+						time_point wake_up = t - std::chrono::nanoseconds(margin());
+						if(now() < wake_up) {
+							sleep_abs(wake_up);
+							learn(std::chrono::duration_cast<std::chrono::nanoseconds>(now() - wake_up));
+						}
+						while(now() < t) {}
+					}
+
+					bool wait_until(boost::unique_lock<boost::mutex> &lock, boost::condition_variable &cond,
+							time_point deadline, const std::function<bool()> &pred) {
+						long remaining;
+						while(!pred()) {
+							if(deadline == time_point::max()) {
+								cond.wait(lock);
+								continue;
+							}
+							remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now()).count();
+							if(remaining <= 0) return false;
+							cond.timed_wait(lock, boost::posix_time::microseconds(remaining));
+						}
+						return true;
+					}
+
+				private:
+					std::atomic<int64_t> d_margin; // ns
+
+					// One sleep to t, no retry on signals: spin_until() covers the rest anyway
+					void sleep_abs(time_point t) {
+#ifdef __linux__
+						// high_resolution_clock need not be CLOCK_MONOTONIC, so t is moved over to it
+						int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - now()).count();
+						if(ns <= 0) return;
+
+						struct timespec ts;
+						clock_gettime(CLOCK_MONOTONIC, &ts);
+						ns += ts.tv_nsec;
+						ts.tv_sec += ns/1000000000;
+						ts.tv_nsec = ns%1000000000;
+						clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+#else
+						long remaining = std::chrono::duration_cast<std::chrono::microseconds>(t - now()).count();
+						if(remaining > 0) boost::this_thread::sleep(boost::posix_time::microseconds(remaining));
+#endif
+					}
+
+					void learn(std::chrono::nanoseconds late) {
+						// Tracks the SPIN_QUANTILE quantile: up a step when woken later than the margin, down a bit otherwise.
+						// At the quantile, both moves even out: (1 - q)*step = q*SPIN_DOWN_RATIO*step.
+						std::chrono::nanoseconds m(d_margin.load(std::memory_order_relaxed));
+						std::chrono::nanoseconds step = m/SPIN_STEP;
+						if(late > m) m += step;
+						else m -= std::chrono::duration_cast<std::chrono::nanoseconds>(step*SPIN_DOWN_RATIO); // Rounded toward zero
+						m = std::max(std::chrono::nanoseconds(SPIN_MIN_MARGIN), std::min(m, std::chrono::nanoseconds(SPIN_MAX_MARGIN)));
+						d_margin.store(m.count(), std::memory_order_relaxed);
+					}
+
+					int64_t margin() const {
+						return d_margin.load(std::memory_order_relaxed);
+					}
+			};
+
+		} // namespace
+
+		mac_clock::sptr mac_clock::realtime() {
+			static mac_clock::sptr clock(new realtime_clock());
+			return clock;
+		}
+
+		virtual_clock::sptr virtual_clock::make(time_point start) {
+			if(start == time_point()) start = std::chrono::high_resolution_clock::now();
+			return virtual_clock::sptr(new virtual_clock(start));
+		}
+
+		virtual_clock::virtual_clock(time_point start) : d_now(start), d_next_id(0), d_blocked(0), d_holds(0) {}
+
+		mac_clock::time_point virtual_clock::now() {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			return d_now;
+		}
+
+		void virtual_clock::sleep_until(time_point t) {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			if(d_now >= t) return;
+
+			uint64_t id = enqueue(t, NULL, NULL);
+			std::vector<waiter> due = advance_if_idle();
+			if(!due.empty()) {
+				lock.unlock();
+				wake(due);
+				lock.lock();
+			}
+
+			try {
+				while(d_now < t) d_cond.wait(lock);
+			} catch(boost::thread_interrupted &) {
+				dequeue(id); // The block is stopping: this thread waits no more
+				throw;
+			}
+			dequeue(id);
+		}
+
+		void virtual_clock::spin_until(time_point t) {
+			sleep_until(t); // Nothing to gain from spinning on simulated time
+		}
+
+		bool virtual_clock::wait_until(boost::unique_lock<boost::mutex> &lock, boost::condition_variable &cond,
+				time_point deadline, const std::function<bool()> &pred) {
+			// The caller holds lock all along, except while waiting, so the clock notifies cond under it
+			boost::unique_lock<boost::mutex> clock_lock(d_mu, boost::defer_lock);
+			std::vector<waiter> due;
+			uint64_t id;
+
+			while(!pred()) {
+				clock_lock.lock();
+				if(d_now >= deadline) return false;
+				id = enqueue(deadline, lock.mutex(), &cond);
+				due = advance_if_idle();
+				clock_lock.unlock();
+
+				if(due.empty()) {
+					try {
+						cond.wait(lock);
+					} catch(boost::thread_interrupted &) {
+						clock_lock.lock();
+						dequeue(id);
+						throw;
+					}
+				} else {
+					lock.unlock();
+					wake(due);
+					lock.lock();
+				}
+
+				clock_lock.lock();
+				dequeue(id);
+				clock_lock.unlock();
+			}
+			return true;
+		}
+
+		void virtual_clock::attach() {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			d_threads.insert(boost::this_thread::get_id());
+		}
+
+		void virtual_clock::detach() {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			d_threads.erase(boost::this_thread::get_id());
+			std::vector<waiter> due = advance_if_idle();
+			lock.unlock();
+			wake(due);
+		}
+
+		void virtual_clock::hold(int n) {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			d_holds += n;
+		}
+
+		void virtual_clock::release() {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			d_holds--;
+			std::vector<waiter> due = advance_if_idle();
+			lock.unlock();
+			wake(due);
+		}
+
+		void virtual_clock::notify_all(boost::condition_variable &cond) {
+			// The waiters on cond run again from now on, not only once they got their mutex back and left wait_until()
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			for(size_t i = 0; i < d_waiters.size(); i++) {
+				waiter &w = d_waiters[i];
+				if(w.cond != &cond or w.woken) continue;
+				w.woken = true;
+				if(w.attached) d_blocked--;
+			}
+			lock.unlock();
+			cond.notify_all();
+		}
+
+		void virtual_clock::advance(duration d) {
+			boost::unique_lock<boost::mutex> lock(d_mu);
+			d_now += d;
+			std::vector<waiter> due = collect_due();
+			lock.unlock();
+			wake(due);
+		}
+
+		uint64_t virtual_clock::enqueue(time_point deadline, boost::mutex *mu, boost::condition_variable *cond) {
+			waiter w;
+			w.deadline = deadline;
+			w.mu = mu;
+			w.cond = cond;
+			w.id = d_next_id++;
+			w.attached = d_threads.count(boost::this_thread::get_id()) > 0;
+			w.woken = false;
+
+			if(w.attached) d_blocked++;
+			d_waiters.push_back(w);
+			return w.id;
+		}
+
+		void virtual_clock::dequeue(uint64_t id) {
+			for(size_t i = 0; i < d_waiters.size(); i++) {
+				if(d_waiters[i].id != id) continue;
+				if(d_waiters[i].attached and !d_waiters[i].woken) d_blocked--;
+				d_waiters.erase(d_waiters.begin() + i);
+				return;
+			}
+		}
+
+		std::vector<virtual_clock::waiter> virtual_clock::advance_if_idle() {
+			// Time moves only when no attached thread can make progress anymore
+			std::vector<waiter> due;
+			time_point next = time_point::max();
+
+			if(d_threads.empty() or d_blocked < (int)d_threads.size() or d_holds > 0) return due;
+
+			for(size_t i = 0; i < d_waiters.size(); i++) {
+				if(!d_waiters[i].woken and d_waiters[i].deadline < next) next = d_waiters[i].deadline;
+			}
+			if(next == time_point::max()) return due; // Everybody waits for something else than time
+
+			if(next > d_now) d_now = next;
+			return collect_due();
+		}
+
+		std::vector<virtual_clock::waiter> virtual_clock::collect_due() {
+			// Waiters are kept in the order they started waiting
+			std::vector<waiter> due;
+			for(size_t i = 0; i < d_waiters.size(); i++) {
+				waiter &w = d_waiters[i];
+				if(w.woken or w.deadline > d_now) continue;
+				w.woken = true;
+				if(w.attached) d_blocked--;
+				due.push_back(w);
+			}
+			return due;
+		}
+
+		void virtual_clock::wake(const std::vector<waiter> &due) {
+			// Without d_mu: waiters hold their own mutex while taking d_mu
+			for(size_t i = 0; i < due.size(); i++) {
+				if(due[i].mu == NULL) {
+					boost::unique_lock<boost::mutex> lock(d_mu);
+					d_cond.notify_all();
+				} else {
+					boost::unique_lock<boost::mutex> lock(*due[i].mu);
+					due[i].cond->notify_all();
+				}
+			}
+		}
+
+	} // namespace macprotocols
+} // namespace gr
@@ -0,0 +1,117 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_MAC_STATS_H
+#define INCLUDED_MACPROTOCOLS_MAC_STATS_H
+
+#include <pmt/pmt.h>
+#include <atomic>
+#include <initializer_list>
+#include <stdint.h>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+// Counters. Each block exports the ones that make sense for it.
+#define STAT_TX_ATTEMPTS 0 // Frames handed to the PHY, retransmissions included
+#define STAT_RETRIES 1 // Retransmissions only
+#define STAT_ACKS_RECEIVED 2
+#define STAT_ACKS_SENT 3
+#define STAT_RX_FRAMES 4 // Frames delivered to the upper layer
+#define STAT_DUPLICATES 5 // Retransmitted frames received again, acked but not delivered
+#define STAT_DROPS_RETRY_LIMIT 6
+#define STAT_DROPS_MEDIUM_BUSY 7
+#define STAT_DROPS_QUEUE_FULL 8
+#define STAT_CS_REQUESTS 9
+#define STAT_CS_BUSY 10 // CS requests that found the channel busy
+#define STAT_QUEUE_HIGH_WATER 11
+#define STAT_ENQUEUED 12
+#define STAT_DEQUEUED 13
+#define STAT_DROPS_OVERSIZE 14 // Frames that could never fit a comm slot
+#define NUM_STATS 15
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Telemetry counters of a block. They are bumped from the threads doing the work with relaxed
+		 * atomics, and read by whoever asks for a snapshot, so the hot paths never take a lock nor
+		 * print anything. Each counter sits CACHE_LINE_SIZE bytes away from the next one: counters
+		 * written by different threads (e.g. TX attempts by the send thread, ACKs by the message
+		 * handler) never share a cache line, whatever the alignment of the block object.
+		 */
+		class mac_stats {
+			public:
+				// Only the listed counters (STAT_*) show up in snapshot()
+				mac_stats(std::initializer_list<int> exported) : d_exported(0) {
+					for(int i = 0; i < NUM_STATS; i++) d_counters[i].value.store(0, std::memory_order_relaxed);
+					for(int stat : exported) d_exported |= 1u << stat;
+				}
+
+				void inc(int stat, uint64_t n = 1) {
+					d_counters[stat].value.fetch_add(n, std::memory_order_relaxed);
+				}
+
+				// Keeps the largest value ever reported
+				void high_water(int stat, uint64_t value) {
+					std::atomic<uint64_t> &c = d_counters[stat].value;
+					uint64_t cur = c.load(std::memory_order_relaxed);
+					while(value > cur and !c.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+				}
+
+				uint64_t get(int stat) const {
+					return d_counters[stat].value.load(std::memory_order_relaxed);
+				}
+
+				// Dict name -> uint64. Counters are read one by one, so they are not a consistent cut.
+				pmt::pmt_t snapshot() const {
+					static const char *names[NUM_STATS] = {"tx_attempts", "retries", "acks_received", "acks_sent", "rx_frames",
+						"duplicates", "drops_retry_limit", "drops_medium_busy", "drops_queue_full", "cs_requests", "cs_busy",
+						"queue_high_water", "enqueued", "dequeued", "drops_oversize"};
+					pmt::pmt_t dict = pmt::make_dict();
+
+					for(int i = 0; i < NUM_STATS; i++) {
+						if(d_exported & (1u << i)) dict = pmt::dict_add(dict, pmt::mp(names[i]), pmt::from_uint64(get(i)));
+					}
+
+					if(d_exported & (1u << STAT_CS_REQUESTS)) {
+						uint64_t requests = get(STAT_CS_REQUESTS);
+						double ratio = requests ? (double)get(STAT_CS_BUSY)/requests : 0;
+						dict = pmt::dict_add(dict, pmt::mp("busy_ratio"), pmt::from_double(ratio));
+					}
+
+					return dict;
+				}
+
+			private:
+				struct counter {
+					std::atomic<uint64_t> value;
+					char pad[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+				};
+
+				counter d_counters[NUM_STATS];
+				uint32_t d_exported;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_MAC_STATS_H */
@@ -26,14 +26,18 @@
 #include "naive_tdma.h"
 #include <boost/thread.hpp>
 #include <chrono>
-#include <boost/crc.hpp>
-#include <boost/circular_buffer.hpp>
+#include "crc32.h"
+#include "ack_template.h"
+#include "dup_cache.h"
+#include "mac_stats.h"
+#include "spsc_ring.h"
+#include "tdma_beacon.h"
+#include "sync_model.h"
 
 #define MAX_NUM_NODES 12
 #define GUARD_INTERVAL 1000 // 10ms, mostly on Gnu Radio (empirical)
 #define MAX_RETRIES 5
 #define MAX_LOCAL_BUFF 3
-#define AVG_BLOCK_DELAY 1000 // us, so 1ms
 
 #define FC_ACK 0x2B00
 #define FC_DATA 0x0008
@@ -50,11 +54,11 @@ class naive_tdma_impl : public naive_tdma {
 	typedef std::chrono::high_resolution_clock clock;
 
 	public:
-		naive_tdma_impl(bool is_coord, std::vector<uint8_t> src_mac, int slot_time, int alpha, bool debug)
+		naive_tdma_impl(bool is_coord, std::vector<uint8_t> src_mac, int slot_time, int alpha, bool debug, mac_clock::sptr clock)
 			: gr::block("naive_tdma",
 			gr::io_signature::make(0, 0, 0),
 			gr::io_signature::make(0, 0, 0)),
-			pr_is_coord(is_coord), pr_debug(debug),  pr_slot_time(alpha * slot_time){
+			pr_is_coord(is_coord), pr_debug(debug),  pr_slot_time(alpha * slot_time), pr_buff(MAX_LOCAL_BUFF), pr_ack(src_mac.data(), FC_ACK), pr_clock(clock) {
 
 			pr_act_nodes_count = 0;
 
@@ -69,6 +73,7 @@ class naive_tdma_impl : public naive_tdma {
 
 			pr_is_skip = false;
 			pr_acked = true;
+			pr_short_id = BEACON_NO_ID;
 
 			// Inputs
 			message_port_register_in(msg_port_frame_from_buff);
@@ -77,13 +82,14 @@ class naive_tdma_impl : public naive_tdma {
 			message_port_register_in(msg_port_frame_from_phy);
 			set_msg_handler(msg_port_frame_from_phy, boost::bind(&naive_tdma_impl::frame_from_phy, this, _1));
 
+			message_port_register_in(msg_port_stats_request);
+			set_msg_handler(msg_port_stats_request, boost::bind(&naive_tdma_impl::stats_request, this, _1));
+
 			// Outputs
 			message_port_register_out(msg_port_frame_to_phy);
 			message_port_register_out(msg_port_frame_request);
 			message_port_register_out(msg_port_frame_to_app);
-
-			// Set local buffer capacity, should be the smallest possible
-			pr_buff.rset_capacity(MAX_LOCAL_BUFF);
+			message_port_register_out(msg_port_stats);
 
 			// For fixed TDMA
 			pr_act_nodes_count = MAX_NUM_NODES;
@@ -92,47 +98,44 @@ class naive_tdma_impl : public naive_tdma {
 		bool start() {
 			if(pr_is_coord) thread_sync = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&naive_tdma_impl::sync_func, this)));
 			thread_send_frame = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&naive_tdma_impl::send_frame, this)));
-			thread_check_buff = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&naive_tdma_impl::check_buff, this)));
 
-			return block::start();
-		}
+			// Advertise the whole local buffer to frame buffer. From now on, it pushes frames as soon as they arrive.
+			message_port_pub(msg_port_frame_request, pmt::from_long(MAX_LOCAL_BUFF));
 
-		void check_buff() {
-			// TODO: Find a more efficient way to get data from buffer only if block is iddle and buffer not empty
-			while(true) {
-				if(pr_buff.size() < MAX_LOCAL_BUFF) {
-					message_port_pub(msg_port_frame_request, pmt::string_to_symbol("get frame"));
-					usleep(3 * AVG_BLOCK_DELAY);
-				} else {
-					usleep((pr_sync_time + pr_comm_time) * (MAX_LOCAL_BUFF*0.8));
-				}
-			}
+			return block::start();
 		}
 
 		void frame_from_buff(pmt::pmt_t frame) {
-			if(pr_buff.size() < MAX_LOCAL_BUFF) {
-				pr_buff.push_back(frame);
-				pr_frame_ready_cond.notify_all(); // In case send_frame() is waiting for a new frame
-			} else {
+			if(!pr_buff.push(frame)) { // push() wakes send_frame() up in case it is waiting for a new frame
+				pr_stats.inc(STAT_DROPS_QUEUE_FULL);
 				if(pr_debug) std::cout << "Local buffer is already FULL!" << std::endl << std::flush;
 			}
+			pr_stats.high_water(STAT_QUEUE_HIGH_WATER, pr_buff.size());
+		}
+
+		pmt::pmt_t stats() {
+			return pr_stats.snapshot();
+		}
+
+		void stats_request(pmt::pmt_t msg) {
+			message_port_pub(msg_port_stats, stats());
 		}
 
 		void send_frame() {
 			pmt::pmt_t cdr;
 			mac_header *h;
 			int count;
-			decltype(clock::now()) tnow;
-			float wait_time, dt;
+			decltype(clock::now()) tx_time;
 			bool is_broadcast, is_skip;
-			boost::unique_lock<boost::mutex> lock0(pr_mu0);
-			boost::unique_lock<boost::mutex> lock1(pr_mu1);
+			boost::unique_lock<boost::mutex> lock1(pr_mu1, boost::defer_lock); // Only held while waiting for the super frame
 
+			pr_clock->attach();
 			while(true) {
 				// Waiting for either a new frame or a skip frame
-				while(pr_buff.size() <= 0 and !pr_is_skip) pr_frame_ready_cond.wait(lock0);
-
-				if(!pr_is_skip) pr_frame = pr_buff[0]; // If it is not true, pr_frame was got from "case FC_SYNC:"
+				if(!pr_is_skip) {
+					pr_buff.wait_nonempty(*pr_clock);
+					pr_frame = pr_buff.front(); // If it is not true, pr_frame was got from "case FC_SYNC:"
+				}
 
 				cdr = pmt::cdr(pr_frame);
 				h = (mac_header*)pmt::blob_data(cdr);
@@ -147,20 +150,23 @@ class naive_tdma_impl : public naive_tdma {
 
 				// Attempt to transmit
 				while(!pr_acked and count < MAX_RETRIES) {
-					while(!pr_tx) pr_tx_cond.wait(lock1); // Has super frame started? Wait for it!
+					lock1.lock();
+					pr_clock->wait(lock1, pr_tx_cond, [this] { return pr_tx; }); // Has super frame started? Wait for it!
 					pr_tx = false;
+					tx_time = pr_sync0 + std::chrono::microseconds((long)(pr_sync_time + pr_tx_order * pr_comm_time));
+					lock1.unlock();
 
 					if(pr_acked) break;
 
 					// Wait for my comm slot for tx
-					wait_time = pr_sync_time + pr_tx_order * pr_comm_time;
-					do {
-						tnow = clock::now();
-						dt = (float) std::chrono::duration_cast<std::chrono::microseconds>(tnow - pr_sync0).count();
-					} while(dt < wait_time);
+					pr_clock->spin_until(tx_time);
 
 					if(!pr_acked) {
-						message_port_pub(msg_port_frame_to_phy, pr_frame);
+						publish_held(msg_port_frame_to_phy, pr_frame);
+						if(!pr_is_skip) {
+							pr_stats.inc(STAT_TX_ATTEMPTS);
+							if(count > 0) pr_stats.inc(STAT_RETRIES);
+						}
 						count++;
 
 						if(is_broadcast or pr_is_skip) {
@@ -170,18 +176,23 @@ class naive_tdma_impl : public naive_tdma {
 						if (pr_debug) std::cout << "Transmitted frame seq number: " << pr_frame_seq_nr << std::endl << std::flush;
 					}
 
-					usleep(pr_comm_time + GUARD_INTERVAL*0.8);
+					pr_clock->sleep_for(std::chrono::microseconds((long)(pr_comm_time + GUARD_INTERVAL*0.8)));
 				}
+				if(!pr_acked) pr_stats.inc(STAT_DROPS_RETRY_LIMIT);
 				if(pr_debug and count >= MAX_RETRIES) std::cout << "Max # of attempts exceeded. Drop the frame!" << std::endl << std::flush;
 
 				// Resetting counters
-				if(!pr_is_skip) pr_buff.pop_front();
+				if(!pr_is_skip) {
+					pr_buff.pop();
+					message_port_pub(msg_port_frame_request, pmt::from_long(1)); // One local slot is free again
+				}
 				pr_is_skip = false;
 				pr_acked = false;
 			}
 		}
 
 		void frame_from_phy(pmt::pmt_t frame) {
+			mac_clock::scoped_release release(*pr_clock); // Held by the sender, see publish_held()
 			pmt::pmt_t cdr = pmt::cdr(frame);
 			mac_header *h = (mac_header*)pmt::blob_data(cdr);
 
@@ -215,15 +226,25 @@ class naive_tdma_impl : public naive_tdma {
 				case FC_DATA: {
 					if(is_mine) {
 						if(pr_debug) std::cout << "ACK was sent!" << std::endl << std::flush;
-						message_port_pub(msg_port_frame_to_phy, generate_ack_frame(frame));
-						message_port_pub(msg_port_frame_to_app, frame);
+						publish_held(msg_port_frame_to_phy, generate_ack_frame(frame));
+						pr_stats.inc(STAT_ACKS_SENT);
+
+						// A retransmission (our ACK was lost) is acked again, but not delivered twice
+						if(pr_dup.is_duplicate(h->addr2, h->seq_nr, pr_clock->now())) {
+							pr_stats.inc(STAT_DUPLICATES);
+							if(pr_debug) std::cout << "Duplicate frame. Not delivered to app." << std::endl << std::flush;
+						} else {
+							message_port_pub(msg_port_frame_to_app, frame);
+							pr_stats.inc(STAT_RX_FRAMES);
+						}
 					}
 				} break;
 
 				case FC_ACK: {
 					if(is_mine) {
-						if((h->seq_nr == pr_frame_seq_nr) and !pr_acked and (pr_buff.size() > 0)) {
+						if((h->seq_nr == pr_frame_seq_nr) and !pr_acked and !pr_buff.empty()) {
 							pr_acked = true;
+							pr_stats.inc(STAT_ACKS_RECEIVED);
 							if(pr_debug) std::cout << "Frame was acked properly!" << std::endl << std::flush;
 						} else {
 							if(pr_debug) std::cout << "ACK duplicated!" << std::endl << std::flush;
@@ -234,32 +255,35 @@ class naive_tdma_impl : public naive_tdma {
 				case FC_SYNC: {
 					if(!pr_is_coord and is_broadcast) {
 						if(pr_debug) std::cout << "Beginning of super frame." << std::endl << std::flush;
-						pr_sync0 = clock::now();
+						decltype(clock::now()) now = pr_clock->now();
+						decltype(clock::now()) sync0 = now;
 
 						uint8_t *f = (uint8_t*)pmt::blob_data(cdr);
 						int len = pmt::blob_length(cdr) - 24; // Strips header
-						uint8_t msg[len];
-						memcpy(msg, f + 24, len);
+						size_t used = pr_sync_beacon.decode(f + 24, len, pr_mac_addr, pr_short_id);
+						if(used == 0) {
+							if(pr_debug) std::cout << "Malformed SYNC frame." << std::endl << std::flush;
+							break;
+						}
+
+						// The superframe is timed after the coordinator's stamp and our model of its clock (see sync_model.h)
+						if(len - (long)used >= SYNC_STAMP_LEN) sync0 = pr_sync_model.observe(beacon::get64(f + 24 + used), frame, now);
 
 						// Find out transmission order
-						int non = len/6; // Number of nodes
-						pr_tx_order = non + 1; // In case this node is not listed, it will be the last one to transmit
-						for(int i = 0; i < non; i++) {
-							if(memcmp(pr_mac_addr, msg + i*6, 6) == 0) {
-								pr_tx_order = i + 1;
-								break;
-							}
-						}
+						int non = pr_sync_beacon.count(); // Number of nodes
+						int position = pr_sync_beacon.position();
+						boost::unique_lock<boost::mutex> lock(pr_mu1);
+						pr_sync0 = sync0;
+						pr_tx_order = position >= 0 ? position + 1 : non + 1; // In case this node is not listed (or does not know its short ID yet), it will be the last one to transmit
 
-						if(pr_buff.size() > 0) { // There is a frame to be transmitted
+						if(!pr_buff.empty()) { // There is a frame to be transmitted
 							pr_tx = true;
-							pr_tx_cond.notify_all();
+							pr_clock->notify_all(pr_tx_cond);
 						} /*else { // No frame to be transmitted; transmit SKIP msg
 							uint8_t *msdu;
 							pr_frame = generate_frame(msdu, 0, FC_SKIP, 0x0000, h->addr2);
 							pr_is_skip = true;
 							pr_tx = true;
-							pr_frame_ready_cond.notify_all();
 						}*/
 					}
 				} break;
@@ -273,7 +297,7 @@ class naive_tdma_impl : public naive_tdma {
 				case FC_METRICS: {
 					if(is_mine) {
 						if(pr_debug) std::cout << "ACK was sent! [Metric]" << std::endl << std::flush;
-						message_port_pub(msg_port_frame_to_phy, generate_ack_frame(frame));
+						publish_held(msg_port_frame_to_phy, generate_ack_frame(frame));
 					}
 				} break;
 
@@ -288,16 +312,22 @@ class naive_tdma_impl : public naive_tdma {
 		}
 
 		void sync_func() {
-			uint8_t *msdu;
-			int msdu_size; 
+			std::vector<uint8_t> msdu;
+			std::vector<uint16_t> ids;
+			std::vector<beacon_assoc> assocs(1);
+			int next_assoc = 0;
 			pmt::pmt_t sync_frame;
 			float sleep_time;
+			decltype(clock::now()) sync0;
+
+			// Short ID of a node: its position in pr_act_nodes + 1
+			for(int i = 0; i < pr_act_nodes_count; i++) ids.push_back(i + 1);
 
 			pr_tx_order = 0; // First slot is always allocated to coordinator 
+			pr_clock->attach();
 			while(true) {
 				// Super frame has just started
 				if(pr_debug) std::cout << "Beginning of super frame." << std::endl << std::flush;
-				pr_sync0 = clock::now();
 
 				/* Build sync frame. It holds the tx order.
 					1st slot: coordinator (1st is the best for sync reasons)
@@ -305,32 +335,46 @@ class naive_tdma_impl : public naive_tdma {
 					3rd slot: node2
 					...
 					i-th slot: reserved to new nodes
+					The order never changes, so the frame is mostly the header (see tdma_beacon.h), plus the
+					short ID of one node, each in turn.
 				*/
-				msdu_size = 6 * pr_act_nodes_count;
-				msdu = pr_act_nodes;
-				sync_frame = generate_frame(msdu, msdu_size, FC_SYNC, 0x0000, pr_broadcast_addr);
-				message_port_pub(msg_port_frame_to_phy, sync_frame);
+				memcpy(assocs[0].addr, pr_act_nodes + 6*next_assoc, 6);
+				assocs[0].id = next_assoc + 1;
+				next_assoc = (next_assoc + 1) % pr_act_nodes_count;
+
+				pr_sync_encoder.encode(ids, assocs, msdu);
+				sync0 = pr_clock->now();
+				beacon::put64(msdu, sync_model::us(sync0)); // Nodes time the superframe after it
+				sync_frame = generate_frame(msdu.data(), msdu.size(), FC_SYNC, 0x0000, pr_broadcast_addr);
+				publish_held(msg_port_frame_to_phy, sync_frame);
 
 				// Reset counters
 				sleep_time = pr_sync_time + pr_comm_time * (pr_act_nodes_count + 1); // +2: 1 slot reserved to coord; 1 slot reserved to new nodes
 				//pr_act_nodes_count = 0;
 
-				if(pr_buff.size() > 0) { 
+				boost::unique_lock<boost::mutex> lock(pr_mu1);
+				pr_sync0 = sync0;
+				if(!pr_buff.empty()) { 
 					pr_tx = true;
-					pr_tx_cond.notify_all();
+					pr_clock->notify_all(pr_tx_cond);
 				}
+				lock.unlock();
 				// Wait until super frame ends to start a new one
-				usleep(sleep_time + GUARD_INTERVAL); // Accuracy should not be crucial here.
+				pr_clock->sleep_for(std::chrono::microseconds((long)(sleep_time + GUARD_INTERVAL))); // Accuracy should not be crucial here.
 			}
 		}
 
+		void publish_held(pmt::pmt_t port, pmt::pmt_t msg) {
+			// Frames: under a virtual clock, time stands still until every receiver has handled msg
+			pr_clock->hold(pmt::length(message_subscribers(port)));
+			message_port_pub(port, msg);
+		}
+
 		pmt::pmt_t generate_ack_frame(pmt::pmt_t frame) {
-			pmt::pmt_t car_frame = pmt::car(frame);
-			pmt::pmt_t cdr_frame = pmt::cdr(frame);
-			
-			mac_header *header = (mac_header*)pmt::blob_data(cdr_frame);
-			uint8_t msdu[0];
-			pmt::pmt_t ack = generate_frame(msdu, 0, FC_ACK, header->seq_nr, header->addr2);
+			mac_header *header = (mac_header*)pmt::blob_data(pmt::cdr(frame));
+
+			// Same as generate_frame(msdu, 0, FC_ACK, seq_nr, addr2), but only seq_nr and addr1 are patched on the prebuilt ACK.
+			pmt::pmt_t ack = pr_ack.build(header->addr2, pr_broadcast_addr, 0x0000, header->seq_nr);
 
 			return ack;
 		}
@@ -350,9 +394,7 @@ class naive_tdma_impl : public naive_tdma {
 		memcpy(psdu, &header, 24); // Header is 24 bytes long
 		memcpy(psdu + 24, msdu, msdu_size); 
 
-		boost::crc_32_type result;
-		result.process_bytes(&psdu, 24 + msdu_size);
-		uint32_t fcs = result.checksum();
+		uint32_t fcs = crc32(psdu, 24 + msdu_size);
 
 		memcpy(psdu + 24 + msdu_size, &fcs, sizeof(uint32_t));
 
@@ -376,34 +418,59 @@ class naive_tdma_impl : public naive_tdma {
 				0x12,0x34,0x56,0x78,0x90,0xaf, 0x12,0x34,0x56,0x78,0x90,0xba, 0x12,0x34,0x56,0x78,0x90,0xbb, 0x12,0x34,0x56,0x78,0x90,0xbc,
 				0x12,0x34,0x56,0x78,0x90,0xbd, 0x12,0x34,0x56,0x78,0x90,0xbe};
 		int pr_act_nodes_count; 
+		beacon_encoder pr_sync_encoder;
+
+		// Own short ID and the last SYNC set (node)
+		uint16_t pr_short_id;
+		beacon_decoder pr_sync_beacon;
+		sync_model pr_sync_model; // The coordinator's clock
 		uint16_t pr_frame_seq_nr;
 
 		// Output ports
 		pmt::pmt_t msg_port_frame_to_phy = pmt::mp("frame to phy");
 		pmt::pmt_t msg_port_frame_request = pmt::mp("frame request");
 		pmt::pmt_t msg_port_frame_to_app = pmt::mp("frame to app");
+		pmt::pmt_t msg_port_stats = pmt::mp("stats");
 
 		// Input ports
 		pmt::pmt_t msg_port_frame_from_buff = pmt::mp("frame from buffer");
 		pmt::pmt_t msg_port_frame_from_phy = pmt::mp("frame from phy");
+		pmt::pmt_t msg_port_stats_request = pmt::mp("stats request");
 
 		// Conditional variables
-		boost::condition_variable pr_tx_cond, pr_frame_ready_cond;
+		boost::condition_variable pr_tx_cond;
 
 		// Locks
-		boost::mutex pr_mu0, pr_mu1;
+		boost::mutex pr_mu1; // Guards pr_tx, pr_sync0 and pr_tx_order
+
+		// Time source: real time unless the block was made with a virtual clock
+		mac_clock::sptr pr_clock;
 
 		// Threads
-		boost::shared_ptr<gr::thread::thread> thread_check_buff, thread_send_frame, thread_sync;
+		boost::shared_ptr<gr::thread::thread> thread_send_frame, thread_sync;
 
-		// Local buffer
-		boost::circular_buffer<pmt::pmt_t> pr_buff;
+		// Local buffer. Producer: frame_from_buff(), consumer: send_frame().
+		spsc_ring<pmt::pmt_t> pr_buff;
 
 		// Frame to be sent
 		pmt::pmt_t pr_frame;
+
+		// Prebuilt ACK frame
+		ack_template pr_ack;
+
+		// Received (transmitter, seq_nr)
+		dup_cache pr_dup;
+
+		mac_stats pr_stats{STAT_TX_ATTEMPTS, STAT_RETRIES, STAT_ACKS_RECEIVED, STAT_ACKS_SENT, STAT_RX_FRAMES, STAT_DUPLICATES,
+			STAT_DROPS_RETRY_LIMIT, STAT_DROPS_QUEUE_FULL, STAT_QUEUE_HIGH_WATER};
 };
 
 naive_tdma::sptr
 naive_tdma::make(bool is_coord, std::vector<uint8_t> src_mac, int slot_time, int alpha, bool debug) {
-	return gnuradio::get_initial_sptr(new naive_tdma_impl(is_coord, src_mac, slot_time, alpha, debug));
+	return make(is_coord, src_mac, slot_time, alpha, debug, mac_clock::realtime());
+}
+
+naive_tdma::sptr
+naive_tdma::make(bool is_coord, std::vector<uint8_t> src_mac, int slot_time, int alpha, bool debug, mac_clock::sptr clock) {
+	return gnuradio::get_initial_sptr(new naive_tdma_impl(is_coord, src_mac, slot_time, alpha, debug, clock));
 }
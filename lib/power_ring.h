@@ -0,0 +1,109 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_POWER_RING_H
+#define INCLUDED_MACPROTOCOLS_POWER_RING_H
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#define POWER_RING_SIZE 65536 // Samples kept, power of 2
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Most recent samples of a power stream, for carrier sensing without leaving the MAC block.
+		 *
+		 * The writer is the scheduler thread running general_work(), readers ask for the average of
+		 * the last n samples (e.g. DIFS worth of them). Samples are never consumed: the writer just
+		 * overwrites the oldest ones. A reader copies nothing, it sums in place with volk and then
+		 * checks the writer did not lap the window meanwhile, retrying if it did. As in a seqlock,
+		 * the writer announces how far it is about to write (d_writing) before it touches a sample,
+		 * so a window being overwritten while it is summed is caught even before the write ends.
+		 */
+		class power_ring {
+			public:
+				power_ring() : d_samples(POWER_RING_SIZE), d_written(0), d_writing(0) {}
+
+				// Writer only
+				void push(const float *in, size_t n) {
+					uint64_t w = d_written.load(std::memory_order_relaxed);
+
+					if(n > POWER_RING_SIZE) { // Only the newest samples matter
+						w += n - POWER_RING_SIZE;
+						in += n - POWER_RING_SIZE;
+						n = POWER_RING_SIZE;
+					}
+
+					d_writing.store(w + n, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_release); // Announced before any sample changes
+
+					size_t pos = w & (POWER_RING_SIZE - 1);
+					size_t first = std::min(n, (size_t)POWER_RING_SIZE - pos);
+					std::copy(in, in + first, d_samples.begin() + pos);
+					std::copy(in + first, in + n, d_samples.begin());
+
+					d_written.store(w + n, std::memory_order_release);
+				}
+
+				// Average of the last n samples. False if fewer than n samples were written so far.
+				bool average(size_t n, float &avg) const {
+					if(n == 0 or n > POWER_RING_SIZE/2) return false;
+
+					while(true) {
+						uint64_t w = d_written.load(std::memory_order_acquire);
+						if(w < n) return false;
+
+						size_t start = (w - n) & (POWER_RING_SIZE - 1);
+						size_t first = std::min(n, (size_t)POWER_RING_SIZE - start);
+						float sum = 0, part;
+
+						volk_32f_accumulator_s32f(&sum, &d_samples[start], first);
+						if(first < n) {
+							volk_32f_accumulator_s32f(&part, &d_samples[0], n - first);
+							sum += part;
+						}
+
+						// The window is intact as long as the writer did not reach it, not even with a write in progress
+						std::atomic_thread_fence(std::memory_order_acquire);
+						if(d_writing.load(std::memory_order_relaxed) - w <= POWER_RING_SIZE - n) {
+							avg = sum/n;
+							return true;
+						}
+					}
+				}
+
+				uint64_t written() const { return d_written.load(std::memory_order_acquire); }
+
+			private:
+				std::vector<float> d_samples;
+				std::atomic<uint64_t> d_written; // Samples written since start
+				std::atomic<uint64_t> d_writing; // Samples written once the write in progress ends
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_POWER_RING_H */
@@ -0,0 +1,106 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_ack_template.h"
+#include "ack_template.h"
+#include <cstdlib>
+
+#define FC_ACK 0x2B00
+
+namespace gr {
+  namespace macprotocols {
+
+    static const uint8_t src_mac[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x01};
+
+    static uint16_t field16(const uint8_t *psdu, size_t offset)
+    {
+      uint16_t v;
+      memcpy(&v, psdu + offset, sizeof(uint16_t));
+      return v;
+    }
+
+    void
+    qa_ack_template::t1()
+    {
+      ack_template tmpl(src_mac, FC_ACK);
+      const uint8_t addr1[6] = {1, 2, 3, 4, 5, 6}, addr3[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+      pmt::pmt_t ack = tmpl.build(addr1, addr3, 44, 0x1230);
+      CPPUNIT_ASSERT_EQUAL((size_t)ACK_LEN, pmt::blob_length(pmt::cdr(ack)));
+      CPPUNIT_ASSERT(pmt::dict_has_key(pmt::car(ack), pmt::mp("crc_included")));
+
+      const uint8_t *psdu = (const uint8_t*)pmt::blob_data(pmt::cdr(ack));
+      CPPUNIT_ASSERT_EQUAL((uint16_t)FC_ACK, field16(psdu, 0));
+      CPPUNIT_ASSERT_EQUAL((uint16_t)44, field16(psdu, ACK_OFFSET_DURATION));
+      CPPUNIT_ASSERT(memcmp(psdu + ACK_OFFSET_ADDR1, addr1, 6) == 0);
+      CPPUNIT_ASSERT(memcmp(psdu + ACK_OFFSET_ADDR2, src_mac, 6) == 0);
+      CPPUNIT_ASSERT(memcmp(psdu + ACK_OFFSET_ADDR3, addr3, 6) == 0);
+      CPPUNIT_ASSERT_EQUAL((uint16_t)0x1230, field16(psdu, ACK_OFFSET_SEQ_NR));
+
+      uint32_t fcs;
+      memcpy(&fcs, psdu + ACK_HEADER_LEN, sizeof(uint32_t));
+      CPPUNIT_ASSERT_EQUAL(crc32(psdu, ACK_HEADER_LEN), fcs);
+    }
+
+    void
+    qa_ack_template::t2()
+    {
+      ack_template tmpl(src_mac, FC_ACK);
+      uint8_t addr1[6], addr3[6];
+      pmt::pmt_t first;
+
+      srand(5);
+      for(int k = 0; k < 10000; k++) {
+        for(int i = 0; i < 6; i++) {
+          addr1[i] = rand() & 0xff;
+          addr3[i] = rand() & 0xff;
+        }
+        uint16_t duration = rand() & 0x7fff, seq_nr = rand() & 0xffff;
+
+        pmt::pmt_t ack = tmpl.build(addr1, addr3, duration, seq_nr);
+        const uint8_t *psdu = (const uint8_t*)pmt::blob_data(pmt::cdr(ack));
+        CPPUNIT_ASSERT(memcmp(psdu + ACK_OFFSET_ADDR1, addr1, 6) == 0);
+        CPPUNIT_ASSERT(memcmp(psdu + ACK_OFFSET_ADDR3, addr3, 6) == 0);
+        CPPUNIT_ASSERT_EQUAL(duration, field16(psdu, ACK_OFFSET_DURATION));
+        CPPUNIT_ASSERT_EQUAL(seq_nr, field16(psdu, ACK_OFFSET_SEQ_NR));
+
+        uint32_t fcs;
+        memcpy(&fcs, psdu + ACK_HEADER_LEN, sizeof(uint32_t));
+        CPPUNIT_ASSERT_EQUAL(crc32(psdu, ACK_HEADER_LEN), fcs);
+
+        // Every ACK has its own blob, all of them share the dict
+        if(k == 0) first = ack;
+        else {
+          CPPUNIT_ASSERT(pmt::car(ack) == pmt::car(first));
+          CPPUNIT_ASSERT(pmt::cdr(ack) != pmt::cdr(first));
+        }
+      }
+
+      // The first ACK was not overwritten by the next ones
+      const uint8_t *psdu = (const uint8_t*)pmt::blob_data(pmt::cdr(first));
+      uint32_t fcs;
+      memcpy(&fcs, psdu + ACK_HEADER_LEN, sizeof(uint32_t));
+      CPPUNIT_ASSERT_EQUAL(crc32(psdu, ACK_HEADER_LEN), fcs);
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,137 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_ampdu.h"
+#include "ampdu.h"
+#include "crc32.h"
+#include <cstdlib>
+#include <string.h>
+#include <vector>
+
+namespace gr {
+  namespace macprotocols {
+
+    // MPDU of len bytes, FCS included, filled with fill
+    static std::vector<uint8_t> make_mpdu(size_t len, uint8_t fill)
+    {
+      std::vector<uint8_t> mpdu(len, fill);
+      uint32_t fcs = crc32(mpdu.data(), len - 4);
+      memcpy(&mpdu[len - 4], &fcs, sizeof(uint32_t));
+      return mpdu;
+    }
+
+    // Aggregate payload of subframes of the given lengths, subframe i filled with i. offsets: where each MPDU starts.
+    static std::vector<uint8_t> make_payload(const std::vector<size_t> &lens, std::vector<size_t> &offsets)
+    {
+      std::vector<uint8_t> payload;
+      offsets.clear();
+      for(size_t i = 0; i < lens.size(); i++) {
+        std::vector<uint8_t> mpdu = make_mpdu(lens[i], i);
+        size_t pos = payload.size();
+        payload.resize(pos + ampdu_subframe_len(lens[i]));
+        CPPUNIT_ASSERT_EQUAL(ampdu_subframe_len(lens[i]), ampdu_write_subframe(&payload[pos], i, mpdu.data(), lens[i]));
+        offsets.push_back(pos + AMPDU_DELIMITER_LEN);
+      }
+      return payload;
+    }
+
+    void
+    qa_ampdu::t1()
+    {
+      CPPUNIT_ASSERT_EQUAL((size_t)32, ampdu_subframe_len(28));
+      CPPUNIT_ASSERT_EQUAL((size_t)36, ampdu_subframe_len(29));
+      CPPUNIT_ASSERT_EQUAL((size_t)36, ampdu_subframe_len(32));
+
+      std::vector<size_t> lens, offsets;
+      for(int i = 0; i < AMPDU_MAX_SUBFRAMES; i++) lens.push_back(AMPDU_MIN_MPDU_LEN + 5*i);
+      std::vector<uint8_t> payload = make_payload(lens, offsets);
+
+      ampdu_subframe sub[AMPDU_MAX_SUBFRAMES];
+      CPPUNIT_ASSERT_EQUAL(AMPDU_MAX_SUBFRAMES, ampdu_parse(payload.data(), payload.size(), sub, AMPDU_MAX_SUBFRAMES));
+      for(int i = 0; i < AMPDU_MAX_SUBFRAMES; i++) {
+        CPPUNIT_ASSERT_EQUAL(i, sub[i].index);
+        CPPUNIT_ASSERT_EQUAL(offsets[i], sub[i].offset);
+        CPPUNIT_ASSERT_EQUAL(lens[i], sub[i].length);
+        CPPUNIT_ASSERT(sub[i].fcs_ok);
+        CPPUNIT_ASSERT_EQUAL((uint8_t)i, payload[sub[i].offset]);
+      }
+    }
+
+    void
+    qa_ampdu::t2()
+    {
+      std::vector<size_t> lens(4, 100), offsets;
+      std::vector<uint8_t> payload = make_payload(lens, offsets);
+      payload[offsets[2] + 50] ^= 0x01;
+
+      ampdu_subframe sub[4];
+      CPPUNIT_ASSERT_EQUAL(4, ampdu_parse(payload.data(), payload.size(), sub, 4));
+      for(int i = 0; i < 4; i++) CPPUNIT_ASSERT_EQUAL(i != 2, sub[i].fcs_ok);
+    }
+
+    void
+    qa_ampdu::t3()
+    {
+      std::vector<size_t> lens(4, 60), offsets;
+      std::vector<uint8_t> payload = make_payload(lens, offsets);
+
+      // Length bits of the second delimiter: its CRC-8 no longer matches
+      payload[offsets[1] - AMPDU_DELIMITER_LEN] ^= 0x04;
+
+      ampdu_subframe sub[4];
+      CPPUNIT_ASSERT_EQUAL(3, ampdu_parse(payload.data(), payload.size(), sub, 4));
+      CPPUNIT_ASSERT_EQUAL(0, sub[0].index);
+      CPPUNIT_ASSERT_EQUAL(2, sub[1].index);
+      CPPUNIT_ASSERT_EQUAL(offsets[2], sub[1].offset);
+      CPPUNIT_ASSERT_EQUAL(3, sub[2].index);
+      for(int i = 0; i < 3; i++) CPPUNIT_ASSERT(sub[i].fcs_ok);
+    }
+
+    void
+    qa_ampdu::t4()
+    {
+      std::vector<size_t> lens(3, 80), offsets;
+      std::vector<uint8_t> payload = make_payload(lens, offsets);
+      ampdu_subframe sub[AMPDU_MAX_SUBFRAMES];
+
+      // The last MPDU is cut short: only the first two are whole
+      CPPUNIT_ASSERT_EQUAL(2, ampdu_parse(payload.data(), offsets[2] + 79, sub, AMPDU_MAX_SUBFRAMES));
+      CPPUNIT_ASSERT_EQUAL(1, ampdu_parse(payload.data(), payload.size(), sub, 1));
+      CPPUNIT_ASSERT_EQUAL(0, ampdu_parse(payload.data(), 3, sub, AMPDU_MAX_SUBFRAMES));
+
+      // Whatever the bytes, subframes lie within the payload
+      srand(8);
+      std::vector<uint8_t> noise(AMPDU_MAX_LEN);
+      for(int k = 0; k < 1000; k++) {
+        for(size_t i = 0; i < noise.size(); i++) noise[i] = rand() & 0xff;
+        if(k % 2) memcpy(noise.data(), payload.data(), payload.size()); // Valid start, garbage after
+        size_t len = rand() % noise.size();
+        int n = ampdu_parse(noise.data(), len, sub, AMPDU_MAX_SUBFRAMES);
+        for(int i = 0; i < n; i++) {
+          CPPUNIT_ASSERT(sub[i].length >= AMPDU_MIN_MPDU_LEN);
+          CPPUNIT_ASSERT(sub[i].offset + sub[i].length <= len);
+        }
+      }
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
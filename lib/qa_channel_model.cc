@@ -0,0 +1,141 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_channel_model.h"
+#include "channel_model.h"
+
+#define NODES 3
+#define BYTE_TIME 1.0 // (us)
+#define PREAMBLE 20 // (us)
+#define PROP_DELAY 5 // (us)
+#define IDLE_POWER -90
+#define BUSY_POWER -30
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef channel_model::time_point time_point;
+
+    static time_point at(long us)
+    {
+      return time_point(std::chrono::seconds(1000)) + std::chrono::microseconds(us);
+    }
+
+    static pmt::pmt_t frame(size_t len)
+    {
+      std::vector<uint8_t> psdu(len, 0x55);
+      return pmt::cons(pmt::make_dict(), pmt::make_blob(psdu.data(), psdu.size()));
+    }
+
+    void
+    qa_channel_model::t1()
+    {
+      channel_model model(NODES, BYTE_TIME, PREAMBLE, PROP_DELAY, IDLE_POWER, BUSY_POWER);
+
+      // On the air over [0, 120] and [50, 170]
+      boost::shared_ptr<channel_model::transmission> a = model.transmit(0, at(0), frame(100), 100);
+      boost::shared_ptr<channel_model::transmission> b = model.transmit(1, at(50), frame(100), 100);
+      CPPUNIT_ASSERT(a->end == at(120));
+      CPPUNIT_ASSERT(a->collided);
+      CPPUNIT_ASSERT(b->collided);
+
+      // Starts as the last one ends
+      boost::shared_ptr<channel_model::transmission> c = model.transmit(2, at(170), frame(100), 100);
+      CPPUNIT_ASSERT(!c->collided);
+      boost::shared_ptr<channel_model::transmission> d = model.transmit(0, at(1000), frame(10), 10);
+      CPPUNIT_ASSERT(!d->collided);
+      CPPUNIT_ASSERT(!c->collided);
+    }
+
+    void
+    qa_channel_model::t2()
+    {
+      channel_model model(NODES, BYTE_TIME, PREAMBLE, PROP_DELAY, IDLE_POWER, BUSY_POWER);
+
+      // A TXOP of node 0: the second frame is handed over before the first one is over
+      boost::shared_ptr<channel_model::transmission> a = model.transmit(0, at(0), frame(100), 100);
+      boost::shared_ptr<channel_model::transmission> b = model.transmit(0, at(60), frame(100), 100);
+      CPPUNIT_ASSERT(!a->collided);
+      CPPUNIT_ASSERT(!b->collided);
+
+      // Another node only hits the frame still on the air
+      boost::shared_ptr<channel_model::transmission> c = model.transmit(1, at(150), frame(100), 100);
+      CPPUNIT_ASSERT(!a->collided);
+      CPPUNIT_ASSERT(b->collided);
+      CPPUNIT_ASSERT(c->collided);
+    }
+
+    void
+    qa_channel_model::t3()
+    {
+      channel_model model(NODES, BYTE_TIME, PREAMBLE, PROP_DELAY, IDLE_POWER, BUSY_POWER);
+      channel_model::event e;
+
+      CPPUNIT_ASSERT(model.empty());
+      boost::shared_ptr<channel_model::transmission> tx = model.transmit(0, at(0), frame(100), 100); // Reaches 1 and 2 at 125
+      model.sense(2, at(10), 50); // Answered at 60
+      model.sense(0, at(25), 100); // At 125 as well, after the deliveries
+
+      CPPUNIT_ASSERT(model.next() == at(60));
+      e = model.pop();
+      CPPUNIT_ASSERT(!e.tx);
+      CPPUNIT_ASSERT_EQUAL(2, e.node);
+      CPPUNIT_ASSERT_EQUAL(50L, e.window);
+
+      e = model.pop();
+      CPPUNIT_ASSERT(e.when == at(125));
+      CPPUNIT_ASSERT(e.tx == tx);
+      CPPUNIT_ASSERT_EQUAL(1, e.node);
+
+      e = model.pop();
+      CPPUNIT_ASSERT(e.when == at(125));
+      CPPUNIT_ASSERT(e.tx == tx);
+      CPPUNIT_ASSERT_EQUAL(2, e.node);
+
+      e = model.pop();
+      CPPUNIT_ASSERT(e.when == at(125));
+      CPPUNIT_ASSERT(!e.tx);
+      CPPUNIT_ASSERT_EQUAL(0, e.node);
+      CPPUNIT_ASSERT(model.empty());
+    }
+
+    void
+    qa_channel_model::t4()
+    {
+      channel_model model(NODES, BYTE_TIME, PREAMBLE, PROP_DELAY, IDLE_POWER, BUSY_POWER);
+
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(IDLE_POWER, model.average_power(1, at(0), at(100)), 1e-3);
+
+      // On the air over [0, 120] at node 0, [5, 125] at the others
+      model.transmit(0, at(0), frame(100), 100);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(BUSY_POWER, model.average_power(0, at(0), at(120)), 1e-3);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(BUSY_POWER, model.average_power(1, at(5), at(125)), 1e-3);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(IDLE_POWER, model.average_power(1, at(125), at(225)), 1e-3);
+
+      // Busy 120 us out of 250, overlapping frames counted once
+      model.transmit(2, at(30), frame(20), 20); // [35, 75] at node 1, within the first one
+      double mw = 0.48*std::pow(10, BUSY_POWER/10.0) + 0.52*std::pow(10, IDLE_POWER/10.0);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(10*std::log10(mw), model.average_power(1, at(0), at(250)), 1e-3);
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,50 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_CHANNEL_MODEL_H_
+#define _QA_CHANNEL_MODEL_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    class qa_channel_model : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_channel_model);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST(t4);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t1(); // Frames of two nodes overlapping collide, frames apart do not
+      void t2(); // Back to back frames of one node do not collide with each other
+      void t3(); // Deliveries to every other node and CS answers, in time order
+      void t4(); // Average power over a CS window
+    };
+
+  } /* namespace macprotocols */
+} /* namespace gr */
+
+#endif /* _QA_CHANNEL_MODEL_H_ */
@@ -0,0 +1,122 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_crc32.h"
+#include "crc32.h"
+#include <boost/crc.hpp>
+#include <cstdlib>
+#include <vector>
+
+namespace gr {
+  namespace macprotocols {
+
+    static uint32_t reference_crc32(const uint8_t *data, size_t len)
+    {
+      boost::crc_32_type crc;
+      crc.process_bytes(data, len);
+      return crc.checksum();
+    }
+
+    static std::vector<uint8_t> random_bytes(size_t len)
+    {
+      std::vector<uint8_t> v(len);
+      for(size_t i = 0; i < len; i++) v[i] = rand() & 0xff;
+      return v;
+    }
+
+    void
+    qa_crc32::t1()
+    {
+      CPPUNIT_ASSERT_EQUAL(0xCBF43926u, crc32("123456789", 9));
+      CPPUNIT_ASSERT_EQUAL(0u, crc32(NULL, 0));
+
+      // Every length up to a few folding blocks, at every alignment of a 16 bytes vector
+      srand(6);
+      std::vector<uint8_t> buf = random_bytes(1024 + 16);
+      for(size_t offset = 0; offset < 16; offset++) {
+        for(size_t len = 0; len <= 1024; len++) {
+          CPPUNIT_ASSERT_EQUAL(reference_crc32(&buf[offset], len), crc32(&buf[offset], len));
+        }
+      }
+
+      // A full-sized frame
+      std::vector<uint8_t> frame = random_bytes(1528);
+      CPPUNIT_ASSERT_EQUAL(reference_crc32(frame.data(), frame.size()), crc32(frame.data(), frame.size()));
+    }
+
+    void
+    qa_crc32::t2()
+    {
+      srand(7);
+      std::vector<uint8_t> buf = random_bytes(2048);
+      const uint8_t *p = buf.data() + 1; // Misaligned on purpose
+      for(size_t len = 0; len < buf.size(); len += 1 + len/8) {
+        uint32_t state = rand();
+        uint32_t expected = crc32_raw_bytewise(state, p, len);
+        CPPUNIT_ASSERT_EQUAL(expected, crc32_raw_slice8(state, p, len));
+        CPPUNIT_ASSERT_EQUAL(expected, crc32_raw_slice16(state, p, len));
+        CPPUNIT_ASSERT_EQUAL(expected, crc32_raw_hw(state, p, len));
+      }
+    }
+
+    void
+    qa_crc32::t3()
+    {
+      srand(8);
+      std::vector<uint8_t> buf = random_bytes(600);
+      uint32_t whole = crc32(buf.data(), buf.size());
+      for(size_t split = 0; split <= buf.size(); split += 7) {
+        CPPUNIT_ASSERT_EQUAL(whole, crc32_update(crc32(buf.data(), split), buf.data() + split, buf.size() - split));
+      }
+
+      // Shifting the register over n bytes is processing n zero bytes
+      std::vector<uint8_t> zeros(300, 0);
+      size_t n[] = {0, 1, 3, 14, 64, 300};
+      for(int i = 0; i < 6; i++) {
+        crc32_shift shift(n[i]);
+        for(int k = 0; k < 100; k++) {
+          uint32_t state = rand();
+          CPPUNIT_ASSERT_EQUAL(crc32_raw_bytewise(state, zeros.data(), n[i]), shift(state));
+        }
+      }
+    }
+
+    void
+    qa_crc32::t4()
+    {
+      srand(9);
+      for(int k = 0; k < 2000; k++) {
+        size_t len = 1 + rand() % 1528;
+        size_t offset = rand() % len;
+        size_t n = rand() % (len - offset + 1);
+        std::vector<uint8_t> buf = random_bytes(len);
+        std::vector<uint8_t> old_bytes(buf.begin() + offset, buf.begin() + offset + n);
+        std::vector<uint8_t> new_bytes = random_bytes(n);
+
+        uint32_t crc = crc32(buf.data(), len);
+        std::copy(new_bytes.begin(), new_bytes.end(), buf.begin() + offset);
+        CPPUNIT_ASSERT_EQUAL(crc32(buf.data(), len), crc32_patch(crc, len, offset, old_bytes.data(), new_bytes.data(), n));
+      }
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
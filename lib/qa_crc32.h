@@ -0,0 +1,50 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_CRC32_H_
+#define _QA_CRC32_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    class qa_crc32 : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_crc32);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST(t4);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t1(); // Check value, and boost::crc_32_type over every length and alignment
+      void t2(); // Raw kernels agree with each other
+      void t3(); // crc32_update() and crc32_shift
+      void t4(); // crc32_patch() against a full recomputation
+    };
+
+  } /* namespace macprotocols */
+} /* namespace gr */
+
+#endif /* _QA_CRC32_H_ */
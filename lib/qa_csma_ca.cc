@@ -0,0 +1,474 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_csma_ca.h"
+#include "csma_ca_impl.h"
+#include <boost/thread/barrier.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+#define SLOT_TIME 9 // (us)
+#define SIFS 16 // (us)
+#define DIFS 34 // (us)
+#define ALPHA 10
+#define THRESHOLD -60 // (dB)
+#define IDLE_POWER -90 // (dB)
+#define BUSY_POWER -30 // (dB)
+#define ACK_DELAY 30 // (us) The peer answers well before the ACK timeout
+#define ACK_TIMEOUT ((SIFS + SLOT_TIME + 1)*ALPHA) // (us) SIFS + slot + RxPHYDelay, scaled
+#define NAV_DURATION (SIFS + SLOT_TIME + 1) // (us) Announced by unicast data frames
+#define RTS_THRESHOLD 50 // (bytes)
+#define CONTROL_AIRTIME 64 // (us) RTS, CTS and ACK: 28 bytes
+#define DATA_AIRTIME 160 // (us) 100 bytes
+#define SETTLE 10000 // (us) Long enough for every test to be over
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef mac_clock::time_point time_point;
+
+    static const uint8_t node_addr[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x01};
+    static const uint8_t peer_addr[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x02};
+    static const uint8_t other_addr[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x03};
+    static const uint8_t broadcast_addr[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+    static pmt::pmt_t frame(uint16_t fc, const uint8_t *addr1, const uint8_t *addr2, uint16_t seq_nr, uint16_t duration, size_t len)
+    {
+      std::vector<uint8_t> psdu(len, 0);
+      mac_header *h = (mac_header*)psdu.data();
+      h->frame_control = fc;
+      h->duration = duration;
+      memcpy(h->addr1, addr1, 6);
+      memcpy(h->addr2, addr2, 6);
+      memset(h->addr3, 0xff, 6);
+      h->seq_nr = seq_nr;
+      return pmt::cons(pmt::make_dict(), pmt::make_blob(psdu.data(), psdu.size()));
+    }
+
+    static const mac_header *header(pmt::pmt_t frame)
+    {
+      return (const mac_header*)pmt::blob_data(pmt::cdr(frame));
+    }
+
+    // A message the MAC sent, and when
+    struct sent_msg {
+      bool cs; // CS request, otherwise frame to the PHY
+      pmt::pmt_t msg;
+      long when; // (us) since the test started
+    };
+
+    /*
+     * csma_ca whose PHY and CS block are the test. Every frame and CS request it sends is kept, and
+     * a peer thread answers them: CS requests with IDLE_POWER once their window is over (BUSY_POWER
+     * for the first busy_answers ones), data frames and RTS for peer_addr with an ACK or CTS ACK_DELAY
+     * later, but those listed in unanswered (by their rank among them).
+     */
+    class test_mac : public csma_ca_impl
+    {
+    public:
+      test_mac(virtual_clock::sptr clock, int rts_threshold)
+        : gr::block("csma_ca", gr::io_signature::make(0, 1, sizeof(float)), gr::io_signature::make(0, 0, 0)),
+          csma_ca_impl(std::vector<uint8_t>(node_addr, node_addr + 6), SLOT_TIME, SIFS, DIFS, ALPHA, THRESHOLD, false, false, 0, rts_threshold, clock),
+          busy_answers(0), d_clock(clock), d_start(clock->now()), d_done(false), d_requests(0) {}
+
+      void publish_held(pmt::pmt_t port, pmt::pmt_t msg)
+      {
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        d_sent.push_back(sent_msg{pmt::is_symbol(msg), msg, us(d_clock->now())});
+        d_clock->notify_all(d_cond);
+      }
+
+      // Starts the MAC and the peer, with frames already queued (see frame_from_buff())
+      void run()
+      {
+        boost::barrier attached(2);
+
+        d_clock->hold(); // Until the send thread is on the clock too
+        d_peer = boost::thread([this, &attached] {
+          mac_clock::scoped_attach attach(*d_clock);
+          attached.wait();
+          answer();
+        });
+        attached.wait();
+        start();
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        d_clock->wait(lock, d_cond, [this] { return !d_sent.empty(); });
+        lock.unlock();
+        d_clock->release();
+      }
+
+      void finish()
+      {
+        stop();
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        d_done = true;
+        d_clock->notify_all(d_cond);
+        lock.unlock();
+        d_peer.join();
+      }
+
+      long us(time_point t)
+      {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - d_start).count();
+      }
+
+      uint64_t stat(const char *name)
+      {
+        return pmt::to_uint64(pmt::dict_ref(stats(), pmt::mp(name), pmt::PMT_NIL));
+      }
+
+      // Field of a latency histogram (ns)
+      uint64_t latency(const char *name, const char *field)
+      {
+        pmt::pmt_t hist = pmt::dict_ref(stats(), pmt::mp(name), pmt::PMT_NIL);
+        return pmt::to_uint64(pmt::dict_ref(hist, pmt::mp(field), pmt::PMT_NIL));
+      }
+
+      // Frames with Frame Control fc the MAC sent (CS requests if fc is 0)
+      std::vector<sent_msg> sent(uint16_t fc)
+      {
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        std::vector<sent_msg> v;
+        for(size_t i = 0; i < d_sent.size(); i++) {
+          if(fc == 0 ? d_sent[i].cs : !d_sent[i].cs and header(d_sent[i].msg)->frame_control == fc) v.push_back(d_sent[i]);
+        }
+        return v;
+      }
+
+      std::vector<sent_msg> sent_all()
+      {
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        return d_sent;
+      }
+
+      std::set<int> unanswered;
+      int busy_answers;
+
+    private:
+      void answer()
+      {
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        size_t next = 0;
+
+        while(true) {
+          d_clock->wait(lock, d_cond, [this, &next] { return d_done or next < d_sent.size(); });
+          if(next == d_sent.size()) return;
+          sent_msg m = d_sent[next++];
+          lock.unlock();
+
+          if(m.cs) {
+            long window = std::stof(pmt::symbol_to_string(m.msg));
+            d_clock->sleep_until(d_start + std::chrono::microseconds(m.when + window));
+            d_clock->hold(); // As the CS block would have been, see publish_held()
+            cs_in(pmt::from_float(busy_answers-- > 0 ? BUSY_POWER : IDLE_POWER));
+          } else {
+            const mac_header *h = header(m.msg);
+            if(memcmp(h->addr1, peer_addr, 6) == 0 and (h->frame_control == FC_DATA or h->frame_control == FC_RTS) and !unanswered.count(d_requests++)) {
+              uint16_t fc = h->frame_control == FC_DATA ? FC_ACK : FC_CTS;
+              pmt::pmt_t reply = frame(fc, node_addr, peer_addr, h->seq_nr, 0, 28);
+              d_clock->sleep_until(d_start + std::chrono::microseconds(m.when + ACK_DELAY));
+              d_clock->hold();
+              frame_from_phy(reply);
+            }
+          }
+          lock.lock();
+        }
+      }
+
+      virtual_clock::sptr d_clock;
+      time_point d_start;
+      boost::mutex d_mu;
+      boost::condition_variable d_cond;
+      std::vector<sent_msg> d_sent;
+      bool d_done;
+      int d_requests; // Data frames and RTS for the peer so far
+      boost::thread d_peer;
+    };
+
+    static boost::shared_ptr<test_mac> make_mac(virtual_clock::sptr clock, int rts_threshold = -1)
+    {
+      return boost::shared_ptr<test_mac>(new test_mac(clock, rts_threshold));
+    }
+
+    void
+    qa_csma_ca::t1()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 2, 0, 100));
+      mac->run();
+      clock->sleep_for(std::chrono::microseconds(SETTLE));
+      mac->finish();
+
+      // CS, data 1, CS, data 2: the second CS goes as soon as the ACK is in
+      std::vector<sent_msg> data = mac->sent(FC_DATA), cs = mac->sent(0);
+      CPPUNIT_ASSERT_EQUAL((size_t)2, data.size());
+      CPPUNIT_ASSERT_EQUAL((size_t)2, cs.size());
+      CPPUNIT_ASSERT_EQUAL(1, (int)header(data[0].msg)->seq_nr);
+      CPPUNIT_ASSERT_EQUAL(2, (int)header(data[1].msg)->seq_nr);
+      CPPUNIT_ASSERT_EQUAL(data[0].when + ACK_DELAY, cs[1].when);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->stat("tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->stat("acks_received"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->stat("retries"));
+    }
+
+    void
+    qa_csma_ca::t2()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+
+      mac->unanswered.insert(0);
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->run();
+      clock->sleep_for(std::chrono::microseconds(SETTLE));
+      mac->finish();
+
+      // The first attempt waits for the whole ACK timeout, the second one is acked
+      std::vector<sent_msg> data = mac->sent(FC_DATA), cs = mac->sent(0);
+      CPPUNIT_ASSERT_EQUAL((size_t)2, data.size());
+      CPPUNIT_ASSERT_EQUAL(data[0].when + ACK_TIMEOUT, cs[1].when);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("retries"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("acks_received"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->stat("drops_retry_limit"));
+    }
+
+    void
+    qa_csma_ca::t3()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+      CPPUNIT_ASSERT(mac->nav_idle());
+
+      // Bit 15 set: an AID, not a duration
+      clock->hold();
+      mac->frame_from_phy(frame(FC_DATA, other_addr, peer_addr, 1, 0x8000 | 100, 100));
+      CPPUNIT_ASSERT(mac->nav_idle());
+
+      // Frames for this station and broadcast ones are not about a third party's exchange
+      clock->hold();
+      mac->frame_from_phy(frame(FC_DATA, node_addr, peer_addr, 1, 100, 100));
+      clock->hold();
+      mac->frame_from_phy(frame(FC_DATA, broadcast_addr, peer_addr, 2, 100, 100));
+      CPPUNIT_ASSERT(mac->nav_idle());
+
+      // Reserved for 100 us, scaled by alpha, from the time the frame is heard
+      clock->hold();
+      mac->frame_from_phy(frame(FC_DATA, other_addr, peer_addr, 2, 100, 100));
+      CPPUNIT_ASSERT(!mac->nav_idle());
+
+      // A shorter duration heard meanwhile does not cut it
+      clock->hold();
+      mac->frame_from_phy(frame(FC_ACK, other_addr, peer_addr, 2, 10, 28));
+      clock->advance(std::chrono::microseconds(100*ALPHA - 1));
+      CPPUNIT_ASSERT(!mac->nav_idle());
+      clock->advance(std::chrono::microseconds(1));
+      CPPUNIT_ASSERT(mac->nav_idle());
+    }
+
+    void
+    qa_csma_ca::t4()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      time_point start = clock->now();
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+      boost::barrier attached(2);
+
+      clock->hold();
+      mac->frame_from_phy(frame(FC_RTS, other_addr, peer_addr, 1, 100, 28)); // Until 1000
+      clock->hold();
+      boost::thread extender([&] {
+        mac_clock::scoped_attach attach(*clock);
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(600));
+        clock->hold();
+        mac->frame_from_phy(frame(FC_CTS, other_addr, peer_addr, 1, 90, 28)); // Until 1500
+      });
+      mac_clock::scoped_attach attach(*clock);
+      attached.wait();
+      clock->release();
+
+      CPPUNIT_ASSERT(mac->wait_nav());
+      CPPUNIT_ASSERT_EQUAL(1500L, mac->us(clock->now()));
+      extender.join();
+      CPPUNIT_ASSERT(!mac->wait_nav());
+      CPPUNIT_ASSERT_EQUAL(1500L, mac->us(clock->now()));
+    }
+
+    void
+    qa_csma_ca::t5()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->frame_from_buff(frame(FC_DATA, broadcast_addr, node_addr, 2, 0, 100));
+      mac->run();
+      clock->sleep_for(std::chrono::microseconds(SETTLE));
+      mac->finish();
+
+      std::vector<sent_msg> data = mac->sent(FC_DATA);
+      CPPUNIT_ASSERT_EQUAL((size_t)2, data.size());
+      CPPUNIT_ASSERT_EQUAL(NAV_DURATION, (int)header(data[0].msg)->duration);
+      CPPUNIT_ASSERT_EQUAL(0, (int)header(data[1].msg)->duration);
+    }
+
+    void
+    qa_csma_ca::t6()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock, RTS_THRESHOLD);
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 2, 0, RTS_THRESHOLD));
+      mac->run();
+      clock->sleep_for(std::chrono::microseconds(SETTLE));
+      mac->finish();
+
+      // RTS, CTS, SIFS, data: the RTS reserves the medium for everything after it
+      std::vector<sent_msg> rts = mac->sent(FC_RTS), data = mac->sent(FC_DATA);
+      CPPUNIT_ASSERT_EQUAL((size_t)1, rts.size());
+      CPPUNIT_ASSERT_EQUAL((size_t)2, data.size());
+      CPPUNIT_ASSERT_EQUAL(rts[0].when + ACK_DELAY + SIFS*ALPHA, data[0].when);
+      CPPUNIT_ASSERT_EQUAL(3*SIFS + 2*CONTROL_AIRTIME + DATA_AIRTIME, (int)header(rts[0].msg)->duration);
+      CPPUNIT_ASSERT(memcmp(header(rts[0].msg)->addr1, peer_addr, 6) == 0);
+
+      // Not above the threshold: straight after its CS
+      CPPUNIT_ASSERT(rts[0].when < data[1].when);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->stat("acks_received"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->stat("retries"));
+    }
+
+    void
+    qa_csma_ca::t7()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock, RTS_THRESHOLD);
+
+      for(int i = 0; i < MAX_RETRIES; i++) mac->unanswered.insert(i);
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->run();
+      clock->sleep_for(std::chrono::seconds(1)); // Backoffs up to the largest CW
+      mac->finish();
+
+      CPPUNIT_ASSERT_EQUAL((size_t)MAX_RETRIES, mac->sent(FC_RTS).size());
+      CPPUNIT_ASSERT(mac->sent(FC_DATA).empty());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->stat("tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("drops_retry_limit"));
+    }
+
+    void
+    qa_csma_ca::t8()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<test_mac> mac = make_mac(clock, RTS_THRESHOLD);
+      int duration = 3*SIFS + 2*CONTROL_AIRTIME + DATA_AIRTIME;
+
+      // The CTS reserves what is left of the exchange, addressed to the RTS sender
+      clock->hold();
+      mac->frame_from_phy(frame(FC_RTS, node_addr, peer_addr, 7, duration, 28));
+      std::vector<sent_msg> cts = mac->sent(FC_CTS);
+      CPPUNIT_ASSERT_EQUAL((size_t)1, cts.size());
+      CPPUNIT_ASSERT(memcmp(header(cts[0].msg)->addr1, peer_addr, 6) == 0);
+      CPPUNIT_ASSERT_EQUAL(7, (int)header(cts[0].msg)->seq_nr);
+      CPPUNIT_ASSERT_EQUAL(duration - SIFS - CONTROL_AIRTIME, (int)header(cts[0].msg)->duration);
+
+      // Another exchange is going on: no CTS
+      clock->hold();
+      mac->frame_from_phy(frame(FC_DATA, other_addr, peer_addr, 1, 100, 100));
+      clock->hold();
+      mac->frame_from_phy(frame(FC_RTS, node_addr, peer_addr, 8, duration, 28));
+      CPPUNIT_ASSERT_EQUAL((size_t)1, mac->sent(FC_CTS).size());
+    }
+
+    void
+    qa_csma_ca::t9()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+
+      mac->busy_answers = 1;
+      mac->unanswered.insert(0);
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 2, 0, 100));
+      mac->run();
+      clock->sleep_for(std::chrono::microseconds(SETTLE));
+      clock->hold();
+      mac->frame_from_phy(frame(FC_DATA, node_addr, peer_addr, 9, 0, 100));
+      mac->finish();
+
+      // Busy once, then a lost ACK: 4 CS requests, 3 data frames
+      pmt::pmt_t stats = mac->stats();
+      CPPUNIT_ASSERT_EQUAL((uint64_t)mac->sent(0).size(), mac->stat("cs_requests"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, mac->stat("cs_requests"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("cs_busy"));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.25, pmt::to_double(pmt::dict_ref(stats, pmt::mp("busy_ratio"), pmt::PMT_NIL)), 1e-9);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, mac->stat("tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("retries"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->stat("acks_received"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("acks_sent"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, mac->stat("rx_frames"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->stat("drops_retry_limit"));
+    }
+
+    void
+    qa_csma_ca::t10()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      mac_clock::scoped_attach attach(*clock);
+      boost::shared_ptr<test_mac> mac = make_mac(clock);
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 0, 100));
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 2, 0, 100));
+      mac->run();
+      clock->sleep_for(std::chrono::microseconds(SETTLE));
+      mac->finish();
+
+      // Frame 1 is taken at 0, frame 2 once frame 1 is acked
+      std::vector<sent_msg> data = mac->sent(FC_DATA);
+      CPPUNIT_ASSERT_EQUAL((size_t)2, data.size());
+      uint64_t access1 = data[0].when*1000, access2 = (data[1].when - data[0].when - ACK_DELAY)*1000;
+
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->latency("latency_access", "count"));
+      CPPUNIT_ASSERT_EQUAL(std::max(access1, access2), mac->latency("latency_access", "max"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->latency("latency_ack", "count"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)ACK_DELAY*1000, mac->latency("latency_ack", "p50"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)ACK_DELAY*1000, mac->latency("latency_ack", "max"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, mac->latency("latency_total", "count"));
+      CPPUNIT_ASSERT_EQUAL(std::max(access1, access2) + ACK_DELAY*1000, mac->latency("latency_total", "max"));
+
+      // Frame buffer stamps are in real time, not comparable to a virtual clock
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->latency("latency_queue", "count"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, mac->latency("latency_drop", "count"));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
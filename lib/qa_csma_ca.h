@@ -0,0 +1,62 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_CSMA_CA_H_
+#define _QA_CSMA_CA_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    class qa_csma_ca : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_csma_ca);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST(t4);
+      CPPUNIT_TEST(t5);
+      CPPUNIT_TEST(t6);
+      CPPUNIT_TEST(t7);
+      CPPUNIT_TEST(t8);
+      CPPUNIT_TEST(t9);
+      CPPUNIT_TEST(t10);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t1(); // An ACK wakes the sender up right away, the next frame does not wait for the ACK timeout
+      void t2(); // The ACK timeout still bounds the wait when the ACK is lost
+      void t3(); // NAV is set by frames for other stations only, for the duration they announce
+      void t4(); // wait_nav() defers until the NAV is over, extended meanwhile
+      void t5(); // Unicast data frames announce SIFS + ACK, broadcast ones nothing
+      void t6(); // Frames above the RTS threshold go SIFS after the CTS, the others without RTS
+      void t7(); // Without CTS, the frame never goes out and is dropped at the retry limit
+      void t8(); // An RTS for this station is answered with a CTS, unless the NAV is set
+      void t9(); // stats() counts the exchanges and the CS requests that found the channel busy
+      void t10(); // Latencies of each stage of a frame, on the block clock
+    };
+
+  } /* namespace macprotocols */
+} /* namespace gr */
+
+#endif /* _QA_CSMA_CA_H_ */
@@ -0,0 +1,106 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_dcf_backoff.h"
+#include "dcf_backoff.h"
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef std::chrono::high_resolution_clock::time_point time_point;
+    typedef std::chrono::microseconds us;
+
+    void
+    qa_dcf_backoff::t1()
+    {
+      dcf_backoff dcf(16, 1024, 9);
+      time_point t0;
+
+      CPPUNIT_ASSERT_EQUAL(16u, dcf.cw());
+      for(int i = 0; i < 1000; i++) {
+        dcf.draw();
+        CPPUNIT_ASSERT(dcf.remaining(t0) < 16);
+      }
+    }
+
+    void
+    qa_dcf_backoff::t2()
+    {
+      dcf_backoff dcf(16, 1024, 9);
+      time_point t0 = time_point() + us(1000000);
+      unsigned int slots;
+
+      srand(1);
+      do {
+        dcf.draw();
+        slots = dcf.remaining(t0);
+      } while(slots < 4);
+      CPPUNIT_ASSERT(!dcf.counting());
+
+      // Idle medium: one slot less every 9 us, zero at the deadline
+      dcf.resume(t0);
+      CPPUNIT_ASSERT(dcf.counting());
+      CPPUNIT_ASSERT(dcf.deadline() == t0 + us(9*slots));
+      CPPUNIT_ASSERT_EQUAL(slots, dcf.remaining(t0 - us(5)));
+      CPPUNIT_ASSERT_EQUAL(slots - 1, dcf.remaining(t0 + us(9)));
+      CPPUNIT_ASSERT_EQUAL(slots - 2, dcf.remaining(t0 + us(2*9 + 8)));
+      CPPUNIT_ASSERT_EQUAL(0u, dcf.remaining(dcf.deadline()));
+      CPPUNIT_ASSERT_EQUAL(0u, dcf.remaining(dcf.deadline() + us(1000)));
+
+      // Busy in the middle of the third slot: that slot is not counted
+      dcf.freeze(t0 + us(2*9 + 4));
+      CPPUNIT_ASSERT(!dcf.counting());
+      CPPUNIT_ASSERT_EQUAL(slots - 2, dcf.remaining(t0 + us(100000)));
+
+      // Freezing again changes nothing
+      dcf.freeze(t0 + us(100000));
+      CPPUNIT_ASSERT_EQUAL(slots - 2, dcf.remaining(t0));
+
+      // The countdown goes on with the slots left
+      time_point t1 = t0 + us(500);
+      dcf.resume(t1);
+      CPPUNIT_ASSERT(dcf.deadline() == t1 + us(9*(slots - 2)));
+    }
+
+    void
+    qa_dcf_backoff::t3()
+    {
+      dcf_backoff dcf(16, 1024, 9);
+      unsigned int expected[] = {32, 64, 128, 256, 512, 1024, 1024, 1024};
+
+      dcf.resume(time_point());
+      for(int i = 0; i < 8; i++) {
+        dcf.collision();
+        CPPUNIT_ASSERT_EQUAL(expected[i], dcf.cw());
+        CPPUNIT_ASSERT(!dcf.counting());
+        CPPUNIT_ASSERT(dcf.remaining(time_point()) < expected[i]);
+      }
+
+      dcf.resume(time_point());
+      dcf.success();
+      CPPUNIT_ASSERT_EQUAL(16u, dcf.cw());
+      CPPUNIT_ASSERT(!dcf.counting());
+      CPPUNIT_ASSERT(dcf.remaining(time_point()) < 16);
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,118 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_dup_cache.h"
+#include "dup_cache.h"
+#include <cstdlib>
+#include <set>
+#include <utility>
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef std::chrono::high_resolution_clock::time_point time_point;
+    typedef std::chrono::microseconds us;
+
+    static void station_addr(uint8_t *addr, int n)
+    {
+      uint8_t base[6] = {0x12, 0x34, 0x56, 0x78, 0x00, 0x00};
+      memcpy(addr, base, 6);
+      addr[4] = n >> 8;
+      addr[5] = n & 0xff;
+    }
+
+    void
+    qa_dup_cache::t1()
+    {
+      dup_cache cache;
+      uint8_t a[6], b[6];
+      time_point now;
+
+      station_addr(a, 1);
+      station_addr(b, 2);
+      CPPUNIT_ASSERT(!cache.is_duplicate(a, 100, now));
+      CPPUNIT_ASSERT(cache.is_duplicate(a, 100, now + us(10)));
+      CPPUNIT_ASSERT(cache.is_duplicate(a, 100, now + us(20)));
+      CPPUNIT_ASSERT(!cache.is_duplicate(b, 100, now + us(30))); // Same number, other transmitter
+      CPPUNIT_ASSERT(!cache.is_duplicate(a, 101, now + us(40)));
+      CPPUNIT_ASSERT(cache.is_duplicate(b, 100, now + us(50)));
+    }
+
+    void
+    qa_dup_cache::t2()
+    {
+      dup_cache cache;
+      uint8_t a[6];
+      time_point now;
+
+      station_addr(a, 1);
+      for(int i = 0; i < AMPDU_MAX_SUBFRAMES; i++) CPPUNIT_ASSERT(!cache.is_duplicate(a, i, now));
+
+      // The block ACK was lost: every subframe comes again
+      for(int i = 0; i < AMPDU_MAX_SUBFRAMES; i++) CPPUNIT_ASSERT(cache.is_duplicate(a, i, now));
+
+      // One more pushes the oldest out
+      CPPUNIT_ASSERT(!cache.is_duplicate(a, AMPDU_MAX_SUBFRAMES, now));
+      CPPUNIT_ASSERT(cache.is_duplicate(a, 1, now));
+      CPPUNIT_ASSERT(!cache.is_duplicate(a, 0, now));
+    }
+
+    void
+    qa_dup_cache::t3()
+    {
+      dup_cache cache(1000);
+      uint8_t a[6];
+      time_point now;
+
+      station_addr(a, 1);
+      CPPUNIT_ASSERT(!cache.is_duplicate(a, 7, now));
+      CPPUNIT_ASSERT(cache.is_duplicate(a, 7, now + us(1000))); // Refreshes the entry
+      CPPUNIT_ASSERT(cache.is_duplicate(a, 7, now + us(2000)));
+      CPPUNIT_ASSERT(!cache.is_duplicate(a, 7, now + us(3001)));
+    }
+
+    void
+    qa_dup_cache::t4()
+    {
+      dup_cache cache;
+      std::set<std::pair<int, int> > seen;
+      time_point now;
+      uint8_t addr[6];
+      int hits = 0;
+
+      srand(7);
+      for(int k = 0; k < 100000; k++) {
+        int station = rand() % (2*DUP_CACHE_SIZE);
+        int seq = rand() % 64;
+        station_addr(addr, station);
+        now += us(1);
+
+        bool duplicate = cache.is_duplicate(addr, seq, now);
+        bool was_seen = !seen.insert(std::make_pair(station, seq)).second;
+        CPPUNIT_ASSERT(!duplicate or was_seen);
+        if(duplicate) hits++;
+      }
+      CPPUNIT_ASSERT(hits > 0);
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
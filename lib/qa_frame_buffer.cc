@@ -0,0 +1,106 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_frame_buffer.h"
+#include "frame_buffer_impl.h"
+
+#define BUFF_SIZE 4
+
+namespace gr {
+  namespace macprotocols {
+
+    static pmt::pmt_t frame()
+    {
+      uint8_t psdu[64] = {0};
+      return pmt::cons(pmt::make_dict(), pmt::make_blob(psdu, sizeof(psdu)));
+    }
+
+    static uint64_t stat(frame_buffer_impl &buff, const char *name)
+    {
+      return pmt::to_uint64(pmt::dict_ref(buff.stats(), pmt::mp(name), pmt::PMT_NIL));
+    }
+
+    void
+    qa_frame_buffer::t1()
+    {
+      boost::shared_ptr<frame_buffer_impl> ptr(new frame_buffer_impl(BUFF_SIZE, false, 0, false));
+      frame_buffer_impl &buff = *ptr;
+
+      // Nobody asked for frames yet
+      for(int i = 0; i < 3; i++) buff.appin(frame());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, stat(buff, "enqueued"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, stat(buff, "dequeued"));
+
+      // Two free slots: two frames go, the third one waits
+      buff.req0(pmt::from_long(2));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, stat(buff, "dequeued"));
+      buff.appin(frame());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, stat(buff, "dequeued"));
+
+      // Credits beyond the queue are kept, later frames go as they arrive, until they run out
+      buff.req0(pmt::from_long(3));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, stat(buff, "dequeued"));
+      buff.appin(frame());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)5, stat(buff, "dequeued"));
+      buff.appin(frame());
+      buff.appin(frame());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)5, stat(buff, "dequeued"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)7, stat(buff, "enqueued"));
+    }
+
+    void
+    qa_frame_buffer::t2()
+    {
+      boost::shared_ptr<frame_buffer_impl> ptr(new frame_buffer_impl(BUFF_SIZE, false, 0, false));
+      frame_buffer_impl &buff = *ptr;
+
+      // Port 1 is not the active one: its credits wait
+      buff.req1(pmt::from_long(2));
+      buff.appin(frame());
+      buff.appin(frame());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, stat(buff, "dequeued"));
+
+      // A one-shot request of another port does nothing either, one of the active port takes a frame
+      buff.req1(pmt::mp("get frame"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, stat(buff, "dequeued"));
+      buff.req0(pmt::mp("get frame"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stat(buff, "dequeued"));
+      buff.req0(pmt::mp("get frame"));
+      buff.req0(pmt::mp("get frame")); // Nothing left
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, stat(buff, "dequeued"));
+
+      // Switching to port 1 serves its credits at once
+      buff.appin(frame());
+      buff.appin(frame());
+      buff.appin(frame());
+      buff.ctrlin(pmt::mp("portid1"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, stat(buff, "dequeued"));
+
+      // One frame left: a full buffer takes three more and drops the others
+      for(int i = 0; i < BUFF_SIZE + 2; i++) buff.appin(frame());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)8, stat(buff, "enqueued"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, stat(buff, "drops_queue_full"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)BUFF_SIZE, stat(buff, "queue_high_water"));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
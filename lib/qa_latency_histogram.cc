@@ -0,0 +1,97 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_latency_histogram.h"
+#include "latency_histogram.h"
+#include <cstdlib>
+
+namespace gr {
+  namespace macprotocols {
+
+    static uint64_t field(pmt::pmt_t dict, const char *name)
+    {
+      return pmt::to_uint64(pmt::dict_ref(dict, pmt::mp(name), pmt::PMT_NIL));
+    }
+
+    void
+    qa_latency_histogram::t1()
+    {
+      latency_histogram h;
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, h.percentile(0.5));
+
+      for(int64_t v = 0; v < (1 << LATENCY_SUB_BITS); v++) h.record(v);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)(1 << LATENCY_SUB_BITS), h.count());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, h.percentile(1.0/(1 << LATENCY_SUB_BITS)));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)15, h.percentile(0.5));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)31, h.percentile(1));
+
+      // A clock step backwards must not wrap around
+      h.record((int64_t)-5);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)31, h.percentile(1));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, h.percentile(2.0/33));
+      h.record(std::chrono::microseconds(3));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3000, h.percentile(1));
+    }
+
+    void
+    qa_latency_histogram::t2()
+    {
+      // With a larger value next to it, the median is the top of the bucket of v
+      srand(3);
+      for(int k = 0; k < 10000; k++) {
+        uint64_t v = (uint64_t)rand() >> (rand() % 31);
+        latency_histogram h;
+        h.record((int64_t)v);
+        h.record((int64_t)1 << 40);
+
+        uint64_t p = h.percentile(0.5);
+        CPPUNIT_ASSERT(p >= v);
+        CPPUNIT_ASSERT(p - v <= v >> LATENCY_SUB_BITS);
+      }
+    }
+
+    void
+    qa_latency_histogram::t3()
+    {
+      latency_histogram h;
+
+      // 1 .. 1000 us
+      for(int64_t us = 1; us <= 1000; us++) h.record(std::chrono::microseconds(us));
+      pmt::pmt_t dict = h.snapshot();
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1000, field(dict, "count"));
+      CPPUNIT_ASSERT(field(dict, "p50") >= 500000 and field(dict, "p50") <= 500000 + (500000 >> LATENCY_SUB_BITS));
+      CPPUNIT_ASSERT(field(dict, "p99") >= 990000 and field(dict, "p99") <= 990000 + (990000 >> LATENCY_SUB_BITS));
+      CPPUNIT_ASSERT(field(dict, "p999") >= 999000 and field(dict, "p999") <= 999000 + (999000 >> LATENCY_SUB_BITS));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1000000, h.percentile(1)); // Capped by the max
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1000000, field(dict, "max"));
+
+      // Beyond 2^(LATENCY_MAX_MSB + 1) ns, the max stands for the whole last bucket
+      int64_t huge = (int64_t)1 << 50;
+      h.record(huge);
+      h.record(huge + 1);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)huge + 1, h.percentile(1));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)huge + 1, field(h.snapshot(), "max"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)huge + 1, h.percentile(0.9985));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,333 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_mac_clock.h"
+#include <macprotocols/mac_clock.h>
+#include <boost/thread/barrier.hpp>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef mac_clock::time_point time_point;
+
+    // Who got where, in simulated us since the start of the test
+    class trace
+    {
+    public:
+      trace(mac_clock &clock, time_point start) : d_clock(clock), d_start(start) {}
+
+      void log(const std::string &who)
+      {
+        boost::unique_lock<boost::mutex> lock(d_mu);
+        d_log.push_back(std::make_pair(who, us(d_clock.now())));
+      }
+
+      long us(time_point t)
+      {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - d_start).count();
+      }
+
+      std::vector<std::pair<std::string, long> > d_log;
+
+    private:
+      mac_clock &d_clock;
+      time_point d_start;
+      boost::mutex d_mu;
+    };
+
+    void
+    qa_mac_clock::t1()
+    {
+      time_point start = time_point(std::chrono::seconds(1000));
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      trace tr(*clock, start);
+      boost::barrier attached(3);
+
+      // Held until both threads are attached, or the first one would run ahead alone
+      clock->hold();
+      boost::thread a([&] {
+        clock->attach();
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(300));
+        tr.log("a");
+        clock->detach();
+      });
+      boost::thread b([&] {
+        clock->attach();
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(100));
+        tr.log("b");
+        clock->spin_until(start + std::chrono::microseconds(400));
+        tr.log("b");
+        clock->detach();
+      });
+      attached.wait();
+      clock->release();
+      a.join();
+      b.join();
+
+      CPPUNIT_ASSERT_EQUAL((size_t)3, tr.d_log.size());
+      CPPUNIT_ASSERT(tr.d_log[0] == std::make_pair(std::string("b"), 100L));
+      CPPUNIT_ASSERT(tr.d_log[1] == std::make_pair(std::string("a"), 300L));
+      CPPUNIT_ASSERT(tr.d_log[2] == std::make_pair(std::string("b"), 400L));
+      CPPUNIT_ASSERT(clock->now() == start + std::chrono::microseconds(400));
+
+      // Without attached threads, time only moves on request
+      clock->advance(std::chrono::microseconds(50));
+      CPPUNIT_ASSERT(clock->now() == start + std::chrono::microseconds(450));
+    }
+
+    void
+    qa_mac_clock::t2()
+    {
+      time_point start = time_point(std::chrono::seconds(1000));
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      trace tr(*clock, start);
+      boost::mutex mu;
+      boost::condition_variable cond;
+      bool flag = false, got = true;
+
+      // Nobody notifies: false, right at the deadline
+      boost::thread a([&] {
+        clock->attach();
+        boost::unique_lock<boost::mutex> lock(mu);
+        got = clock->wait_until(lock, cond, start + std::chrono::microseconds(250), [&] { return flag; });
+        tr.log("a");
+        clock->detach();
+      });
+      a.join();
+      CPPUNIT_ASSERT(!got);
+      CPPUNIT_ASSERT_EQUAL(250L, tr.d_log.back().second);
+
+      // An attached thread notifies at 100: true, at 100
+      boost::barrier attached(3);
+      clock->hold();
+      boost::thread b([&] {
+        clock->attach();
+        attached.wait();
+        boost::unique_lock<boost::mutex> lock(mu);
+        got = clock->wait_until(lock, cond, start + std::chrono::microseconds(1000), [&] { return flag; });
+        tr.log("b");
+        clock->detach();
+      });
+      boost::thread c([&] {
+        clock->attach();
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(350));
+        boost::unique_lock<boost::mutex> lock(mu);
+        flag = true;
+        clock->notify_all(cond);
+        lock.unlock();
+        clock->detach();
+      });
+      attached.wait();
+      clock->release();
+      b.join();
+      c.join();
+      CPPUNIT_ASSERT(got);
+      CPPUNIT_ASSERT_EQUAL(350L, tr.d_log.back().second);
+    }
+
+    void
+    qa_mac_clock::t3()
+    {
+      time_point start = time_point(std::chrono::seconds(1000));
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      trace tr(*clock, start);
+      boost::barrier attached(2);
+
+      clock->hold();
+      boost::thread a([&] {
+        clock->attach();
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(100));
+        tr.log("a");
+        clock->detach();
+      });
+      attached.wait();
+
+      // A frame in flight: however long it takes, the sleeping thread is not woken meanwhile
+      clock->hold(2);
+      clock->release();
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+      CPPUNIT_ASSERT(clock->now() == start);
+      CPPUNIT_ASSERT(tr.d_log.empty());
+      clock->release();
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+      CPPUNIT_ASSERT(clock->now() == start);
+
+      {
+        mac_clock::scoped_release release(*clock);
+      }
+      a.join();
+      CPPUNIT_ASSERT_EQUAL((size_t)1, tr.d_log.size());
+      CPPUNIT_ASSERT_EQUAL(100L, tr.d_log[0].second);
+    }
+
+    void
+    qa_mac_clock::t4()
+    {
+      /*
+       * A message handler (this thread, not attached) answers a thread waiting with a timeout while
+       * another one sleeps until earlier than that. Once the handler releases the clock, the answered
+       * thread must see the answer at the time it came, before the sleeper is due.
+       */
+      time_point start = time_point(std::chrono::seconds(1000));
+      for(int k = 0; k < 200; k++) {
+        virtual_clock::sptr clock = virtual_clock::make(start);
+        trace tr(*clock, start);
+        boost::barrier attached(3);
+        boost::mutex mu;
+        boost::condition_variable cond;
+        bool acked = false, waiting = false;
+
+        clock->hold();
+        boost::thread sender([&] {
+          clock->attach();
+          attached.wait();
+          boost::unique_lock<boost::mutex> lock(mu);
+          waiting = true;
+          bool got = clock->wait_until(lock, cond, start + std::chrono::microseconds(1000), [&] { return acked; });
+          lock.unlock();
+          tr.log(got ? "acked" : "timeout");
+          clock->detach();
+        });
+        boost::thread sleeper([&] {
+          clock->attach();
+          attached.wait();
+          clock->sleep_until(start + std::chrono::microseconds(10));
+          tr.log("sleeper");
+          clock->detach();
+        });
+        attached.wait();
+
+        // The ACK is on its way: held once more by its sender, released by its handler
+        clock->hold();
+        clock->release();
+        while(true) {
+          boost::unique_lock<boost::mutex> lock(mu);
+          if(waiting) break;
+          lock.unlock();
+          boost::this_thread::yield();
+        }
+        {
+          mac_clock::scoped_release release(*clock);
+          boost::unique_lock<boost::mutex> lock(mu);
+          acked = true;
+          clock->notify_all(cond);
+        }
+        sender.join();
+        sleeper.join();
+
+        CPPUNIT_ASSERT_EQUAL((size_t)2, tr.d_log.size());
+        std::sort(tr.d_log.begin(), tr.d_log.end(), [](const std::pair<std::string, long> &a, const std::pair<std::string, long> &b) { return a.second < b.second; });
+        CPPUNIT_ASSERT(tr.d_log[0] == std::make_pair(std::string("acked"), 0L));
+        CPPUNIT_ASSERT(tr.d_log[1] == std::make_pair(std::string("sleeper"), 10L));
+      }
+    }
+
+    void
+    qa_mac_clock::t5()
+    {
+      mac_clock::sptr clock = mac_clock::realtime();
+      std::vector<long> slept, spun;
+
+      for(int k = 0; k < 20; k++) {
+        time_point t = clock->now() + std::chrono::microseconds(2000);
+        clock->sleep_until(t);
+        slept.push_back(std::chrono::duration_cast<std::chrono::microseconds>(clock->now() - t).count());
+
+        t = clock->now() + std::chrono::microseconds(2000);
+        clock->spin_until(t);
+        spun.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock->now() - t).count());
+      }
+      std::sort(slept.begin(), slept.end());
+      std::sort(spun.begin(), spun.end());
+
+      // Never early. Late by the wake up latency of the OS when sleeping, by next to nothing when spinning.
+      CPPUNIT_ASSERT(slept[0] >= 0);
+      CPPUNIT_ASSERT(spun[0] >= 0);
+      CPPUNIT_ASSERT(slept[slept.size()/2] < 10000);
+      CPPUNIT_ASSERT(spun[spun.size()/2] < 50000); // ns
+
+      // A timed wait nobody notifies lasts its whole timeout
+      boost::mutex mu;
+      boost::condition_variable cond;
+      boost::unique_lock<boost::mutex> lock(mu);
+      time_point t = clock->now() + std::chrono::microseconds(3000);
+      CPPUNIT_ASSERT(!clock->wait_until(lock, cond, t, [] { return false; }));
+      CPPUNIT_ASSERT(clock->now() >= t);
+    }
+
+    void
+    qa_mac_clock::t6()
+    {
+      time_point start = time_point(std::chrono::seconds(1000));
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      trace tr(*clock, start);
+      boost::barrier attached(4);
+      boost::mutex mu;
+      boost::condition_variable cond;
+
+      // A block stopping: its threads are interrupted in the middle of their waits
+      clock->hold();
+      boost::thread a([&] {
+        mac_clock::scoped_attach attach(*clock);
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(1000));
+        tr.log("a");
+      });
+      boost::thread b([&] {
+        mac_clock::scoped_attach attach(*clock);
+        attached.wait();
+        boost::unique_lock<boost::mutex> lock(mu);
+        clock->wait_until(lock, cond, start + std::chrono::microseconds(500), [] { return false; });
+        tr.log("b");
+      });
+      boost::thread c([&] {
+        mac_clock::scoped_attach attach(*clock);
+        attached.wait();
+        clock->sleep_until(start + std::chrono::microseconds(100));
+        tr.log("c");
+        clock->sleep_until(start + std::chrono::microseconds(2000));
+        tr.log("c");
+      });
+      attached.wait();
+      a.interrupt();
+      b.interrupt();
+      a.join();
+      b.join();
+      clock->release();
+      c.join();
+
+      // The others go on, and their old deadlines are gone
+      CPPUNIT_ASSERT_EQUAL((size_t)2, tr.d_log.size());
+      CPPUNIT_ASSERT(tr.d_log[0] == std::make_pair(std::string("c"), 100L));
+      CPPUNIT_ASSERT(tr.d_log[1] == std::make_pair(std::string("c"), 2000L));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
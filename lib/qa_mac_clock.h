@@ -0,0 +1,54 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_MAC_CLOCK_H_
+#define _QA_MAC_CLOCK_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    class qa_mac_clock : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_mac_clock);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST(t4);
+      CPPUNIT_TEST(t5);
+      CPPUNIT_TEST(t6);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t1(); // Virtual time jumps from deadline to deadline, once every attached thread waits
+      void t2(); // wait_until() times out exactly at its deadline, or returns as soon as notified
+      void t3(); // Time stands still while held
+      void t4(); // A notified thread runs before time moves on
+      void t5(); // Real-time clock: sleep_until() and spin_until() return at their deadline, not before
+      void t6(); // Threads interrupted in a wait leave the virtual clock running for the others
+    };
+
+  } /* namespace macprotocols */
+} /* namespace gr */
+
+#endif /* _QA_MAC_CLOCK_H_ */
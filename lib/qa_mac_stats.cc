@@ -0,0 +1,97 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_mac_stats.h"
+#include "mac_stats.h"
+#include <boost/thread/thread.hpp>
+#include <vector>
+
+#define THREADS 4
+#define INCREMENTS 100000
+
+namespace gr {
+  namespace macprotocols {
+
+    static uint64_t stat(pmt::pmt_t dict, const char *name)
+    {
+      return pmt::to_uint64(pmt::dict_ref(dict, pmt::mp(name), pmt::PMT_NIL));
+    }
+
+    void
+    qa_mac_stats::t1()
+    {
+      mac_stats stats{STAT_TX_ATTEMPTS, STAT_CS_REQUESTS, STAT_CS_BUSY, STAT_QUEUE_HIGH_WATER};
+
+      // No request yet: the ratio is 0, not NaN
+      pmt::pmt_t dict = stats.snapshot();
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, stat(dict, "tx_attempts"));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, pmt::to_double(pmt::dict_ref(dict, pmt::mp("busy_ratio"), pmt::PMT_NIL)), 1e-9);
+
+      stats.inc(STAT_TX_ATTEMPTS, 3);
+      stats.inc(STAT_RETRIES); // Counted, but not exported
+      stats.inc(STAT_CS_REQUESTS, 4);
+      stats.inc(STAT_CS_BUSY);
+      stats.high_water(STAT_QUEUE_HIGH_WATER, 7);
+      stats.high_water(STAT_QUEUE_HIGH_WATER, 5);
+
+      dict = stats.snapshot();
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, stat(dict, "tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, stat(dict, "cs_requests"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stat(dict, "cs_busy"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)7, stat(dict, "queue_high_water"));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.25, pmt::to_double(pmt::dict_ref(dict, pmt::mp("busy_ratio"), pmt::PMT_NIL)), 1e-9);
+      CPPUNIT_ASSERT(!pmt::dict_has_key(dict, pmt::mp("retries")));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stats.get(STAT_RETRIES));
+
+      // Blocks without CS have no ratio
+      mac_stats buffer_stats{STAT_ENQUEUED, STAT_DEQUEUED};
+      dict = buffer_stats.snapshot();
+      CPPUNIT_ASSERT(pmt::dict_has_key(dict, pmt::mp("enqueued")));
+      CPPUNIT_ASSERT(!pmt::dict_has_key(dict, pmt::mp("busy_ratio")));
+      CPPUNIT_ASSERT(!pmt::dict_has_key(dict, pmt::mp("tx_attempts")));
+    }
+
+    void
+    qa_mac_stats::t2()
+    {
+      mac_stats stats{STAT_TX_ATTEMPTS, STAT_ACKS_RECEIVED, STAT_QUEUE_HIGH_WATER};
+      std::vector<boost::shared_ptr<boost::thread> > threads;
+
+      // As the send thread and the message handler of a block do, on counters of their own and on a shared one
+      for(int t = 0; t < THREADS; t++) {
+        threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread([&stats, t] {
+          for(int i = 0; i < INCREMENTS; i++) {
+            stats.inc(t % 2 ? STAT_ACKS_RECEIVED : STAT_TX_ATTEMPTS);
+            stats.high_water(STAT_QUEUE_HIGH_WATER, t*INCREMENTS + i);
+          }
+        })));
+      }
+      for(int t = 0; t < THREADS; t++) threads[t]->join();
+
+      pmt::pmt_t dict = stats.snapshot();
+      CPPUNIT_ASSERT_EQUAL((uint64_t)THREADS/2*INCREMENTS, stat(dict, "tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)THREADS/2*INCREMENTS, stat(dict, "acks_received"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)THREADS*INCREMENTS - 1, stat(dict, "queue_high_water"));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -26,11 +26,47 @@
  */
 
 #include "qa_macprotocols.h"
+#include "qa_dcf_backoff.h"
+#include "qa_spsc_ring.h"
+#include "qa_crc32.h"
+#include "qa_dup_cache.h"
+#include "qa_ampdu.h"
+#include "qa_station_table.h"
+#include "qa_tdma_beacon.h"
+#include "qa_sync_model.h"
+#include "qa_mac_clock.h"
+#include "qa_channel_model.h"
+#include "qa_tdma.h"
+#include "qa_csma_ca.h"
+#include "qa_ack_template.h"
+#include "qa_frame_buffer.h"
+#include "qa_mac_stats.h"
+#include "qa_latency_histogram.h"
+#include "qa_tx_schedule.h"
+#include "qa_slot_reservation.h"
 
 CppUnit::TestSuite *
 qa_macprotocols::suite()
 {
   CppUnit::TestSuite *s = new CppUnit::TestSuite("macprotocols");
+  s->addTest(gr::macprotocols::qa_dcf_backoff::suite());
+  s->addTest(gr::macprotocols::qa_spsc_ring::suite());
+  s->addTest(gr::macprotocols::qa_crc32::suite());
+  s->addTest(gr::macprotocols::qa_dup_cache::suite());
+  s->addTest(gr::macprotocols::qa_ampdu::suite());
+  s->addTest(gr::macprotocols::qa_station_table::suite());
+  s->addTest(gr::macprotocols::qa_tdma_beacon::suite());
+  s->addTest(gr::macprotocols::qa_sync_model::suite());
+  s->addTest(gr::macprotocols::qa_mac_clock::suite());
+  s->addTest(gr::macprotocols::qa_channel_model::suite());
+  s->addTest(gr::macprotocols::qa_tdma::suite());
+  s->addTest(gr::macprotocols::qa_csma_ca::suite());
+  s->addTest(gr::macprotocols::qa_ack_template::suite());
+  s->addTest(gr::macprotocols::qa_frame_buffer::suite());
+  s->addTest(gr::macprotocols::qa_mac_stats::suite());
+  s->addTest(gr::macprotocols::qa_latency_histogram::suite());
+  s->addTest(gr::macprotocols::qa_tx_schedule::suite());
+  s->addTest(gr::macprotocols::qa_slot_reservation::suite());
 
   return s;
 }
@@ -0,0 +1,110 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_slot_reservation.h"
+#include "slot_reservation.h"
+
+namespace gr {
+  namespace macprotocols {
+
+    void
+    qa_slot_reservation::t1()
+    {
+      slot_reservation r(3);
+
+      // Not listed by the SYNC, nothing reserved: a REQ asking for 3 superframes, granted
+      CPPUNIT_ASSERT(!r.sync(false, true));
+      CPPUNIT_ASSERT_EQUAL((uint8_t)3, r.request(true));
+      r.alloc(true);
+      CPPUNIT_ASSERT_EQUAL(2, r.left());
+
+      // The next two SYNCs leave the node out, it stays silent
+      CPPUNIT_ASSERT(r.sync(false, true));
+      CPPUNIT_ASSERT(r.sync(false, true));
+      CPPUNIT_ASSERT_EQUAL(0, r.left());
+
+      // Then it is listed again, and renews
+      CPPUNIT_ASSERT(!r.sync(true, true));
+      CPPUNIT_ASSERT_EQUAL((uint8_t)3, r.request(true));
+      r.alloc(true);
+      CPPUNIT_ASSERT_EQUAL(2, r.left());
+
+      // Listed while holding one: the coordinator ended it
+      CPPUNIT_ASSERT(!r.sync(true, true));
+      CPPUNIT_ASSERT_EQUAL(0, r.left());
+
+      r.request(true);
+      r.alloc(true);
+      r.reset();
+      CPPUNIT_ASSERT(!r.sync(false, true));
+    }
+
+    void
+    qa_slot_reservation::t2()
+    {
+      // Asked for, but the ALLOC does not list the node
+      slot_reservation r(3);
+      r.request(true);
+      r.alloc(false);
+      CPPUNIT_ASSERT_EQUAL(0, r.left());
+
+      // A SKIP asks for nothing, so an ALLOC listing the node anyway grants nothing
+      CPPUNIT_ASSERT_EQUAL((uint8_t)0, r.request(false));
+      r.alloc(true);
+      CPPUNIT_ASSERT_EQUAL(0, r.left());
+
+      // Granted by an ALLOC, but only the next one follows the REQ
+      r.request(true);
+      r.alloc(false);
+      r.alloc(true);
+      CPPUNIT_ASSERT_EQUAL(0, r.left());
+
+      // A single superframe is what a plain REQ gets, and no more than RESERVE_MAX can be asked for
+      slot_reservation one(1), none(0), many(1000);
+      CPPUNIT_ASSERT_EQUAL((uint8_t)0, one.request(true));
+      CPPUNIT_ASSERT_EQUAL((uint8_t)0, none.request(true));
+      CPPUNIT_ASSERT_EQUAL((uint8_t)RESERVE_MAX, many.request(true));
+      one.alloc(true);
+      CPPUNIT_ASSERT_EQUAL(0, one.left());
+    }
+
+    void
+    qa_slot_reservation::t3()
+    {
+      slot_reservation r(100);
+      r.request(true);
+      r.alloc(true);
+
+      // Frames keep it alive
+      for(int i = 0; i < RESERVE_IDLE - 1; i++) CPPUNIT_ASSERT(r.sync(false, false));
+      CPPUNIT_ASSERT(r.sync(false, true));
+      for(int i = 0; i < RESERVE_IDLE - 1; i++) CPPUNIT_ASSERT(r.sync(false, false));
+      CPPUNIT_ASSERT_EQUAL(100 - 1 - (2*RESERVE_IDLE - 1), r.left());
+
+      // Idle once more: the SYNC is answered, with a SKIP
+      CPPUNIT_ASSERT(!r.sync(false, false));
+      CPPUNIT_ASSERT_EQUAL(0, r.left());
+      CPPUNIT_ASSERT_EQUAL((uint8_t)0, r.request(false));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_spsc_ring.h"
+#include "spsc_ring.h"
+
+namespace gr {
+  namespace macprotocols {
+
+    void
+    qa_spsc_ring::t1()
+    {
+      spsc_ring<int> ring(3); // 4 slots, 3 usable
+      int next_in = 0, next_out = 0;
+
+      CPPUNIT_ASSERT_EQUAL((size_t)3, ring.capacity());
+      CPPUNIT_ASSERT(ring.empty());
+
+      // Fills and empties it at every offset of the slots, so that indexes wrap around
+      for(int round = 0; round < 10; round++) {
+        for(int i = 0; i < 3; i++) CPPUNIT_ASSERT(ring.push(next_in++));
+        CPPUNIT_ASSERT(!ring.push(-1));
+        CPPUNIT_ASSERT_EQUAL((size_t)3, ring.size());
+
+        for(size_t i = 0; i < ring.size(); i++) CPPUNIT_ASSERT_EQUAL(next_out + (int)i, ring.at(i));
+
+        // One out, one in: still full
+        CPPUNIT_ASSERT_EQUAL(next_out++, ring.front());
+        ring.pop();
+        CPPUNIT_ASSERT(ring.push(next_in++));
+        CPPUNIT_ASSERT(!ring.push(-1));
+
+        while(!ring.empty()) {
+          ring.wait_nonempty(); // Returns right away
+          CPPUNIT_ASSERT_EQUAL(next_out++, ring.front());
+          ring.pop();
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(next_in, next_out);
+    }
+
+    void
+    qa_spsc_ring::t2()
+    {
+      const int n = 200000;
+      spsc_ring<int> ring(8);
+      int expected = 0;
+      bool in_order = true;
+
+      boost::thread producer([&ring, n] {
+        for(int i = 0; i < n; i++) {
+          while(!ring.push(i)) boost::this_thread::yield();
+        }
+      });
+
+      while(expected < n) {
+        ring.wait_nonempty(); // Sleeps when the producer is behind
+        if(ring.front() != expected) in_order = false;
+        ring.pop();
+        expected++;
+      }
+      producer.join();
+
+      CPPUNIT_ASSERT(in_order);
+      CPPUNIT_ASSERT(ring.empty());
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
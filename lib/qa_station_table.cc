@@ -0,0 +1,127 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_station_table.h"
+#include "station_table.h"
+#include <cstdlib>
+#include <map>
+#include <set>
+
+namespace gr {
+  namespace macprotocols {
+
+    static void station_addr(uint8_t *addr, int n)
+    {
+      uint8_t base[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+      memcpy(addr, base, 6);
+      addr[3] = n >> 16;
+      addr[4] = n >> 8;
+      addr[5] = n & 0xff;
+    }
+
+    void
+    qa_station_table::t1()
+    {
+      station_table table;
+      std::map<int, uint16_t> ref; // Station number -> short ID
+      uint8_t addr[6];
+
+      srand(21);
+      for(int k = 0; k < 50000; k++) {
+        int n = rand() % 400; // Enough stations for the hash to grow a few times
+        station_addr(addr, n);
+        std::map<int, uint16_t>::iterator it = ref.find(n);
+
+        if(rand() % 3) {
+          // The lowest ID not in use goes to a new station, a known one keeps its own
+          std::set<uint16_t> used;
+          for(std::map<int, uint16_t>::iterator r = ref.begin(); r != ref.end(); r++) used.insert(r->second);
+          uint16_t lowest = 1;
+          while(used.count(lowest)) lowest++;
+
+          int i = table.add(addr);
+          CPPUNIT_ASSERT(i >= 0 and (size_t)i < table.size());
+          CPPUNIT_ASSERT(memcmp(table[i].addr, addr, 6) == 0);
+          if(it != ref.end()) {
+            CPPUNIT_ASSERT_EQUAL(it->second, table[i].id);
+          } else {
+            CPPUNIT_ASSERT_EQUAL(lowest, table[i].id);
+            CPPUNIT_ASSERT_EQUAL(-1, table[i].sync_pos);
+            CPPUNIT_ASSERT_EQUAL(-1, table[i].comm_slot);
+            ref[n] = table[i].id;
+          }
+        } else {
+          int i = table.find(addr);
+          CPPUNIT_ASSERT_EQUAL(it != ref.end(), i >= 0);
+          if(i >= 0) {
+            table.remove(i);
+            ref.erase(it);
+          }
+        }
+
+        // Every known station is found by address and by short ID, the unknown ones are not
+        CPPUNIT_ASSERT_EQUAL(ref.size(), table.size());
+        uint16_t max_id = 0;
+        for(std::map<int, uint16_t>::iterator r = ref.begin(); r != ref.end(); r++) {
+          station_addr(addr, r->first);
+          int i = table.find(addr);
+          CPPUNIT_ASSERT(i >= 0);
+          CPPUNIT_ASSERT_EQUAL(r->second, table[i].id);
+          CPPUNIT_ASSERT_EQUAL(i, table.find_id(r->second));
+          max_id = std::max(max_id, r->second);
+        }
+        CPPUNIT_ASSERT_EQUAL(max_id, table.max_id());
+        station_addr(addr, 400 + rand() % 100);
+        CPPUNIT_ASSERT_EQUAL(-1, table.find(addr));
+        CPPUNIT_ASSERT_EQUAL(-1, table.find_id(0));
+        CPPUNIT_ASSERT_EQUAL(-1, table.find_id(max_id + 1));
+      }
+    }
+
+    void
+    qa_station_table::t2()
+    {
+      station_table table;
+      uint8_t addr[6];
+
+      for(int n = 0; n < STATION_MAX_ID; n++) {
+        station_addr(addr, n);
+        CPPUNIT_ASSERT_EQUAL((uint16_t)(n + 1), table[table.add(addr)].id);
+      }
+      CPPUNIT_ASSERT_EQUAL((uint16_t)STATION_MAX_ID, table.max_id());
+
+      // No ID left: the station is known, without a short ID
+      station_addr(addr, STATION_MAX_ID);
+      int i = table.add(addr);
+      CPPUNIT_ASSERT_EQUAL((uint16_t)0, table[i].id);
+      CPPUNIT_ASSERT_EQUAL(i, table.find(addr));
+
+      // Once one is freed, the next station gets it
+      station_addr(addr, 100);
+      table.remove(table.find(addr));
+      station_addr(addr, STATION_MAX_ID + 1);
+      CPPUNIT_ASSERT_EQUAL((uint16_t)101, table[table.add(addr)].id);
+      CPPUNIT_ASSERT_EQUAL((size_t)STATION_MAX_ID + 1, table.size());
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,167 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_sync_model.h"
+#include "sync_model.h"
+#include <random>
+
+#define OFFSET 5000000 // (us) Local clock ahead of the coordinator's
+#define DRIFT 40e-6
+#define PERIOD 20000 // (us) Between beacons
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef sync_model::time_point time_point;
+
+    // Local time the coordinator's remote is at
+    static double truth(int64_t remote)
+    {
+      return OFFSET + remote*(1 + DRIFT);
+    }
+
+    static time_point at(double us)
+    {
+      return time_point(std::chrono::microseconds(llround(us)));
+    }
+
+    static pmt::pmt_t beacon_frame(pmt::pmt_t dict)
+    {
+      uint8_t psdu[32] = {0};
+      return pmt::cons(dict, pmt::make_blob(psdu, sizeof(psdu)));
+    }
+
+    void
+    qa_sync_model::t1()
+    {
+      sync_model model;
+      std::mt19937 rng(25);
+      std::uniform_real_distribution<double> latency(300, 500); // Through the flowgraph, 400 on average
+      pmt::pmt_t frame = beacon_frame(pmt::make_dict());
+      double see = 0;
+      int n = 0;
+
+      CPPUNIT_ASSERT(!model.ready());
+      for(int k = 0; k < 1000; k++) {
+        int64_t remote = 1000000 + k*PERIOD;
+        time_point t = model.observe(remote, frame, at(truth(remote) + latency(rng)));
+        if(k < 500) continue;
+
+        double e = sync_model::us(t) - (truth(remote) + 400);
+        see += e*e;
+        n++;
+      }
+      CPPUNIT_ASSERT(model.ready());
+      CPPUNIT_ASSERT(std::sqrt(see/n) < 40); // Single arrivals are 58 us RMS off
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(DRIFT, model.drift(), 5e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(truth(1000000 + 1000*PERIOD) + 400, (double)sync_model::us(model.local(1000000 + 1000*PERIOD)), 60);
+    }
+
+    void
+    qa_sync_model::t2()
+    {
+      sync_model model;
+      std::mt19937 rng(26);
+      std::uniform_real_distribution<double> latency(300, 500);
+      pmt::pmt_t frame = beacon_frame(pmt::make_dict());
+      int64_t remote = 1000000;
+
+      for(int k = 0; k < 200; k++, remote += PERIOD) model.observe(remote, frame, at(truth(remote) + latency(rng)));
+      double jitter = model.jitter();
+
+      // Stuck 5 ms behind other messages: timed after the line, not after its arrival
+      time_point t = model.observe(remote, frame, at(truth(remote) + 5400));
+      CPPUNIT_ASSERT(std::fabs(sync_model::us(t) - (truth(remote) + 400)) < 100);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(jitter, model.jitter(), 1e-9);
+
+      remote += PERIOD;
+      t = model.observe(remote, frame, at(truth(remote) + latency(rng)));
+      CPPUNIT_ASSERT(std::fabs(sync_model::us(t) - (truth(remote) + 400)) < 100);
+    }
+
+    void
+    qa_sync_model::t3()
+    {
+      sync_model model;
+      std::mt19937 rng(27);
+      std::exponential_distribution<double> queueing(1/300.0); // Long tail
+      double see = 0;
+      int n = 0;
+
+      for(int k = 0; k < 500; k++) {
+        int64_t remote = 1000000 + k*PERIOD;
+        double air = truth(remote); // Local time the beacon was on the air at
+        double rx = air + 997000000; // PHY clock, unrelated to the local one
+        pmt::pmt_t rx_time = pmt::make_tuple(pmt::from_uint64((uint64_t)(rx/1e6)), pmt::from_double(std::fmod(rx, 1e6)/1e6));
+        pmt::pmt_t frame = beacon_frame(pmt::dict_add(pmt::make_dict(), pmt::mp("rx_time"), rx_time));
+
+        // The handler runs 200 us after the frame was received at the earliest
+        time_point t = model.observe(remote, frame, at(air + 200 + queueing(rng)));
+        if(k < 100) continue;
+
+        double e = sync_model::us(t) - (air + 200);
+        see += e*e;
+        n++;
+      }
+      CPPUNIT_ASSERT(std::sqrt(see/n) < 50); // Handling times alone are 420 us RMS off
+      CPPUNIT_ASSERT(model.jitter() < 20);
+    }
+
+    void
+    qa_sync_model::t4()
+    {
+      sync_model model;
+      std::mt19937 rng(28);
+      std::uniform_real_distribution<double> latency(300, 500);
+      pmt::pmt_t frame = beacon_frame(pmt::make_dict());
+      int64_t remote = 1000000;
+
+      for(int k = 0; k < 300; k++, remote += PERIOD) model.observe(remote, frame, at(truth(remote) + latency(rng)));
+      CPPUNIT_ASSERT(model.ready());
+      double drift = model.drift();
+
+      // The coordinator's clock starts over: the beacon is timed after its arrival until the fit is ready again
+      time_point handled = at(truth(remote) + 450);
+      CPPUNIT_ASSERT(model.observe(1000, frame, handled) == handled);
+      CPPUNIT_ASSERT(!model.ready());
+      CPPUNIT_ASSERT_EQUAL(drift, model.drift());
+
+      for(int k = 1; k < SYNC_MODEL_MIN; k++) model.observe(1000 + k*PERIOD, frame, handled + std::chrono::microseconds(k*PERIOD));
+      CPPUNIT_ASSERT(model.ready());
+    }
+
+    void
+    qa_sync_model::t5()
+    {
+      int64_t us = 0;
+      pmt::pmt_t uhd = pmt::make_tuple(pmt::from_uint64(12), pmt::from_double(0.25));
+
+      CPPUNIT_ASSERT(rx_time_of(beacon_frame(pmt::dict_add(pmt::make_dict(), pmt::mp("rx_time"), uhd)), us));
+      CPPUNIT_ASSERT_EQUAL((int64_t)12250000, us);
+      CPPUNIT_ASSERT(rx_time_of(beacon_frame(pmt::dict_add(pmt::make_dict(), pmt::mp("rx_time"), pmt::from_double(3.5))), us));
+      CPPUNIT_ASSERT_EQUAL((int64_t)3500000, us);
+      CPPUNIT_ASSERT(!rx_time_of(beacon_frame(pmt::make_dict()), us));
+      CPPUNIT_ASSERT(!rx_time_of(beacon_frame(pmt::PMT_NIL), us));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
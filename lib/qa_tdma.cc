@@ -0,0 +1,283 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_tdma.h"
+#include "tdma_impl.h"
+#include <boost/thread/barrier.hpp>
+#include <atomic>
+#include <vector>
+
+#define SLOT_TIME 100 // (us) ACK slot, alpha is 1
+#define COMM_SLOT 950 // (us)
+#define BYTE_TIME 1.0 // (us)
+#define SIFS 16 // (us)
+#define MAX_COMM 1000 // (us) Comm interval shared by the coordinator
+#define MIN_SLOT 100 // (us)
+#define FRAME_LEN 200 // Airtime of 200 us, exchange of 300 us with the ACK slot
+#define LOST -1
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef mac_clock::time_point time_point;
+
+    static const uint8_t node_addr[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x01};
+    static const uint8_t peer_addr[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x02};
+    static const uint8_t broadcast_addr[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+    static pmt::pmt_t frame(uint16_t fc, const uint8_t *addr1, const uint8_t *addr2, uint16_t seq_nr, size_t len)
+    {
+      std::vector<uint8_t> psdu(len, 0);
+      mac_header *h = (mac_header*)psdu.data();
+      h->frame_control = fc;
+      memcpy(h->addr1, addr1, 6);
+      memcpy(h->addr2, addr2, 6);
+      memcpy(h->addr3, broadcast_addr, 6);
+      h->seq_nr = seq_nr;
+      return pmt::cons(pmt::make_dict(), pmt::make_blob(psdu.data(), psdu.size()));
+    }
+
+    static boost::shared_ptr<tdma_impl> make_node(virtual_clock::sptr clock, int comm_slot)
+    {
+      std::vector<uint8_t> mac(node_addr, node_addr + 6);
+      return boost::shared_ptr<tdma_impl>(new tdma_impl(false, mac, SLOT_TIME, 1, false, comm_slot, BYTE_TIME, SIFS, 0, 0, 0, clock));
+    }
+
+    static boost::shared_ptr<tdma_impl> make_coord(virtual_clock::sptr clock)
+    {
+      std::vector<uint8_t> mac(node_addr, node_addr + 6);
+      return boost::shared_ptr<tdma_impl>(new tdma_impl(true, mac, SLOT_TIME, 1, false, COMM_SLOT, BYTE_TIME, SIFS, MAX_COMM, MIN_SLOT, 0, clock));
+    }
+
+    static uint64_t stat(tdma_impl &mac, const char *name)
+    {
+      return pmt::to_uint64(pmt::dict_ref(mac.stats(), pmt::mp(name), pmt::PMT_NIL));
+    }
+
+    /*
+     * Runs fill_slot() over a comm slot starting now, as send_frame() does, while a second thread
+     * stands for the PHY and the peer: it answers attempt k with an ACK for acks[k] (nothing if
+     * LOST), FRAME_LEN airtime and SIFS after the attempt (the ACK itself takes no time). Returns
+     * when each attempt went out (us since the slot started).
+     */
+    static std::vector<long> run_slot(tdma_impl &mac, virtual_clock::sptr clock, long slot_len, const std::vector<int> &acks)
+    {
+      time_point start = clock->now();
+      std::vector<long> attempts;
+      std::atomic<bool> done(false);
+      boost::barrier attached(3);
+      uint64_t seen = stat(mac, "tx_attempts");
+
+      clock->hold();
+      boost::thread sender([&] {
+        clock->attach();
+        attached.wait();
+        mac.fill_slot(start + std::chrono::microseconds(slot_len));
+        done = true;
+        clock->detach();
+      });
+      boost::thread peer([&] {
+        clock->attach();
+        attached.wait();
+        while(!done) {
+          // Polled every us, half-way between the us the MAC acts at: the attempt went out at the last one
+          long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock->now() - start).count();
+          uint64_t n = stat(mac, "tx_attempts");
+          if(n == seen) {
+            clock->sleep_until(start + std::chrono::nanoseconds(ns/1000*1000 + (ns%1000 < 500 ? 500 : 1500)));
+            continue;
+          }
+          long t = ns/1000;
+          attempts.push_back(t);
+          seen = n;
+          int seq_nr = attempts.size() <= acks.size() ? acks[attempts.size() - 1] : LOST;
+          if(seq_nr == LOST) continue;
+          clock->sleep_until(start + std::chrono::microseconds(t + (long)(FRAME_LEN*BYTE_TIME) + SIFS));
+          clock->hold(); // As the PHY does, see publish_held()
+          mac.frame_from_phy(frame(FC_ACK, node_addr, peer_addr, seq_nr, 28));
+        }
+        clock->detach();
+      });
+      attached.wait();
+      clock->release();
+      sender.join();
+      peer.join();
+      return attempts;
+    }
+
+    void
+    qa_tdma::t1()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<tdma_impl> mac = make_node(clock, COMM_SLOT);
+      std::vector<long> attempts;
+
+      for(int seq_nr = 1; seq_nr <= 4; seq_nr++) mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, seq_nr, FRAME_LEN));
+
+      // Each exchange takes airtime, SIFS, the ACK and SIFS again: 232 us. The 4th would need 696 + 300 us.
+      attempts = run_slot(*mac, clock, COMM_SLOT, {1, 2, 3});
+      CPPUNIT_ASSERT_EQUAL((size_t)3, attempts.size());
+      CPPUNIT_ASSERT_EQUAL(0L, attempts[0]);
+      CPPUNIT_ASSERT_EQUAL(232L, attempts[1]);
+      CPPUNIT_ASSERT_EQUAL(464L, attempts[2]);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, stat(*mac, "acks_received"));
+
+      // The last one goes in the next slot, then there is nothing left
+      attempts = run_slot(*mac, clock, COMM_SLOT, {4});
+      CPPUNIT_ASSERT_EQUAL((size_t)1, attempts.size());
+      attempts = run_slot(*mac, clock, COMM_SLOT, {});
+      CPPUNIT_ASSERT(attempts.empty());
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, stat(*mac, "tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, stat(*mac, "acks_received"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)0, stat(*mac, "retries"));
+    }
+
+    void
+    qa_tdma::t2()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<tdma_impl> mac = make_node(clock, COMM_SLOT);
+      std::vector<long> attempts;
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, FRAME_LEN));
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 2, FRAME_LEN));
+
+      // The first ACK is lost: sent again once the ACK slot is over, then the next frame still fits
+      attempts = run_slot(*mac, clock, COMM_SLOT, {LOST, 1, 2});
+      CPPUNIT_ASSERT_EQUAL((size_t)3, attempts.size());
+      CPPUNIT_ASSERT_EQUAL(300L, attempts[1]);
+      CPPUNIT_ASSERT_EQUAL(532L, attempts[2]);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)3, stat(*mac, "tx_attempts"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stat(*mac, "retries"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, stat(*mac, "acks_received"));
+
+      // A late ACK of a frame already acked changes nothing
+      clock->hold();
+      mac->frame_from_phy(frame(FC_ACK, node_addr, peer_addr, 1, 28));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, stat(*mac, "acks_received"));
+    }
+
+    void
+    qa_tdma::t3()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<tdma_impl> mac = make_node(clock, 2000);
+      std::vector<long> attempts;
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, FRAME_LEN));
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 2, FRAME_LEN));
+
+      attempts = run_slot(*mac, clock, 2000, {LOST, LOST, LOST, LOST, LOST, 2});
+      CPPUNIT_ASSERT_EQUAL((size_t)6, attempts.size());
+      CPPUNIT_ASSERT_EQUAL(1200L, attempts[4]);
+      CPPUNIT_ASSERT_EQUAL(1500L, attempts[5]);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stat(*mac, "drops_retry_limit"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)4, stat(*mac, "retries"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stat(*mac, "acks_received"));
+    }
+
+    void
+    qa_tdma::t4()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<tdma_impl> mac = make_node(clock, COMM_SLOT);
+      std::vector<long> attempts;
+
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 1, 900)); // 900 + 100 us
+      mac->frame_from_buff(frame(FC_DATA, broadcast_addr, node_addr, 2, 960)); // No ACK, but still too long
+      mac->frame_from_buff(frame(FC_DATA, peer_addr, node_addr, 3, FRAME_LEN));
+
+      attempts = run_slot(*mac, clock, COMM_SLOT, {3});
+      CPPUNIT_ASSERT_EQUAL((size_t)1, attempts.size());
+      CPPUNIT_ASSERT_EQUAL(0L, attempts[0]);
+      CPPUNIT_ASSERT_EQUAL((uint64_t)2, stat(*mac, "drops_oversize"));
+      CPPUNIT_ASSERT_EQUAL((uint64_t)1, stat(*mac, "acks_received"));
+    }
+
+    void
+    qa_tdma::t5()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<tdma_impl> coord = make_coord(clock);
+      std::vector<long> len;
+
+      // Each frame costs its airtime, SIFS and the ACK slot. Without a size, a frame gets a comm slot.
+      CPPUNIT_ASSERT_EQUAL(0L, coord->demand_time(0, 0));
+      CPPUNIT_ASSERT_EQUAL((long)COMM_SLOT, coord->demand_time(2, 0));
+      CPPUNIT_ASSERT_EQUAL(3*FRAME_LEN + 3L*(SLOT_TIME + SIFS), coord->demand_time(3, 3*FRAME_LEN));
+
+      // MIN_SLOT each, then the small demand is met and the large ones split the rest
+      coord->share_comm({50, 300, 2000}, len);
+      CPPUNIT_ASSERT(len == std::vector<long>({100, 300, 600}));
+      coord->share_comm({2000, 250, 2000}, len);
+      CPPUNIT_ASSERT(len == std::vector<long>({375, 250, 375}));
+
+      // Time nobody needs is not handed out
+      coord->share_comm({150, 150}, len);
+      CPPUNIT_ASSERT(len == std::vector<long>({150, 150}));
+
+      // More stations than MIN_SLOT allows: the interval is split equally
+      coord->share_comm(std::vector<long>(20, 500), len);
+      CPPUNIT_ASSERT(len == std::vector<long>(20, MAX_COMM/20));
+
+      coord->share_comm({}, len);
+      CPPUNIT_ASSERT(len.empty());
+    }
+
+    void
+    qa_tdma::t6()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(time_point(std::chrono::seconds(1000)));
+      boost::shared_ptr<tdma_impl> coord = make_coord(clock), node = make_node(clock, COMM_SLOT);
+      std::vector<uint8_t> trailer;
+      long start, len;
+
+      // Three stations, then the coordinator's own slot, which is not listed. Ends are rounded up to ALLOC_SLOT_UNIT.
+      CPPUNIT_ASSERT_EQUAL(1004L, coord->put_alloc_slots(trailer, {100, 301, 600, 250}, 3));
+      CPPUNIT_ASSERT_EQUAL((size_t)(1 + 2*3), trailer.size());
+      CPPUNIT_ASSERT_EQUAL((uint8_t)ALLOC_WEIGHTED, trailer[0]);
+
+      node->alloc_slot(trailer.data(), trailer.size(), 3, 0, start, len);
+      CPPUNIT_ASSERT_EQUAL(0L, start);
+      CPPUNIT_ASSERT_EQUAL(100L, len);
+      node->alloc_slot(trailer.data(), trailer.size(), 3, 1, start, len);
+      CPPUNIT_ASSERT_EQUAL(100L, start);
+      CPPUNIT_ASSERT_EQUAL(304L, len);
+      node->alloc_slot(trailer.data(), trailer.size(), 3, 2, start, len);
+      CPPUNIT_ASSERT_EQUAL(404L, start);
+      CPPUNIT_ASSERT_EQUAL(600L, len);
+
+      // A trailer cut short, or equal slots: comm slots of COMM_SLOT, one after the other
+      node->alloc_slot(trailer.data(), trailer.size() - 1, 3, 2, start, len);
+      CPPUNIT_ASSERT_EQUAL(2L*COMM_SLOT, start);
+      CPPUNIT_ASSERT_EQUAL((long)COMM_SLOT, len);
+      trailer.clear();
+      trailer.push_back(ALLOC_EQUAL);
+      node->alloc_slot(trailer.data(), trailer.size(), 3, 1, start, len);
+      CPPUNIT_ASSERT_EQUAL((long)COMM_SLOT, start);
+      CPPUNIT_ASSERT_EQUAL((long)COMM_SLOT, len);
+      node->alloc_slot(trailer.data(), 0, 3, 1, start, len);
+      CPPUNIT_ASSERT_EQUAL((long)COMM_SLOT, start);
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
@@ -0,0 +1,54 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_TDMA_H_
+#define _QA_TDMA_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    class qa_tdma : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_tdma);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST(t4);
+      CPPUNIT_TEST(t5);
+      CPPUNIT_TEST(t6);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t1(); // A comm slot takes as many frames as fit with their ACK, SIFS apart, the rest waits
+      void t2(); // A frame not acked is sent again in the same slot if there is time left
+      void t3(); // A frame is dropped after MAX_RETRIES attempts, the next one goes in its place
+      void t4(); // Frames longer than a whole comm slot are dropped instead of holding the queue
+      void t5(); // Comm slots are sized after the backlogs, max-min fair within the comm interval
+      void t6(); // Comm slot boundaries written in an ALLOC are those the nodes read back
+    };
+
+  } /* namespace macprotocols */
+} /* namespace gr */
+
+#endif /* _QA_TDMA_H_ */
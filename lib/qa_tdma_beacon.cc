@@ -0,0 +1,192 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_tdma_beacon.h"
+#include "tdma_beacon.h"
+#include <cstdlib>
+#include <set>
+
+namespace gr {
+  namespace macprotocols {
+
+    static uint8_t me[6] = {0x02, 0x00, 0x00, 0x00, 0x12, 0x34};
+
+    // Ascending set of n short IDs below max_id
+    static std::vector<uint16_t> random_set(size_t n, int max_id)
+    {
+      std::set<uint16_t> s;
+      while(s.size() < n) s.insert(1 + rand() % (max_id - 1));
+      return std::vector<uint16_t>(s.begin(), s.end());
+    }
+
+    static int position_of(const std::vector<uint16_t> &ids, uint16_t id)
+    {
+      for(size_t i = 0; i < ids.size(); i++) if(ids[i] == id) return i;
+      return -1;
+    }
+
+    void
+    qa_tdma_beacon::t1()
+    {
+      beacon_encoder encoder;
+      beacon_decoder decoder;
+      std::vector<beacon_assoc> no_assocs;
+      std::vector<uint16_t> ids;
+      std::vector<uint8_t> out;
+      int bitmaps = 0, lists = 0, repeats = 0;
+
+      srand(22);
+      for(int k = 0; k < 3000; k++) {
+        // A new set now and then, dense (bitmap) or sparse (list)
+        if(k % 5 == 0) ids = rand() % 2 ? random_set(rand() % 200, 256) : random_set(rand() % 20, 4000);
+        uint16_t id = rand() % 4 ? ids.empty() ? 1 : ids[rand() % ids.size()] : 1 + rand() % 4000;
+
+        encoder.encode(ids, no_assocs, out);
+        if(out[0] & BEACON_BITMAP) bitmaps++;
+        else if(out[0] & BEACON_KEYFRAME) lists++;
+        else repeats++;
+
+        uint16_t decoded_id = id;
+        CPPUNIT_ASSERT_EQUAL(out.size(), decoder.decode(out.data(), out.size(), me, decoded_id));
+        CPPUNIT_ASSERT_EQUAL(id, decoded_id);
+        CPPUNIT_ASSERT(decoder.known());
+        CPPUNIT_ASSERT_EQUAL((int)ids.size(), decoder.count());
+        CPPUNIT_ASSERT_EQUAL(position_of(ids, id), decoder.position());
+      }
+      CPPUNIT_ASSERT(bitmaps > 0 and lists > 0 and repeats > 0);
+    }
+
+    void
+    qa_tdma_beacon::t2()
+    {
+      beacon_encoder encoder;
+      beacon_decoder decoder;
+      std::vector<uint16_t> ids;
+      std::vector<beacon_assoc> assocs(3);
+      std::vector<uint8_t> out;
+      uint16_t id = BEACON_NO_ID;
+
+      for(int i = 0; i < 3; i++) {
+        memcpy(assocs[i].addr, me, 6);
+        assocs[i].addr[5] += i - 1; // Ours is the second one
+        assocs[i].id = 10 + i;
+        ids.push_back(10 + i);
+      }
+
+      encoder.encode(ids, assocs, out);
+      decoder.decode(out.data(), out.size(), me, id);
+      CPPUNIT_ASSERT_EQUAL((uint16_t)11, id);
+      CPPUNIT_ASSERT_EQUAL(1, decoder.position());
+
+      // Not listed before it has an ID
+      beacon_decoder fresh;
+      uint16_t none = BEACON_NO_ID;
+      assocs.clear();
+      encoder.encode(ids, assocs, out);
+      fresh.decode(out.data(), out.size(), me, none);
+      CPPUNIT_ASSERT_EQUAL((uint16_t)BEACON_NO_ID, none);
+      CPPUNIT_ASSERT_EQUAL(-1, fresh.position());
+    }
+
+    void
+    qa_tdma_beacon::t3()
+    {
+      beacon_encoder encoder;
+      beacon_decoder decoder;
+      std::vector<beacon_assoc> no_assocs;
+      std::vector<uint16_t> ids;
+      std::vector<uint8_t> out;
+      uint16_t id = 7;
+
+      for(int i = 1; i <= 10; i++) ids.push_back(i);
+      encoder.encode(ids, no_assocs, out); // Keyframe, missed
+
+      for(int k = 1; k < BEACON_KEYFRAME_INTERVAL; k++) {
+        encoder.encode(ids, no_assocs, out);
+        CPPUNIT_ASSERT(!(out[0] & BEACON_KEYFRAME));
+        CPPUNIT_ASSERT_EQUAL(out.size(), decoder.decode(out.data(), out.size(), me, id));
+        CPPUNIT_ASSERT(!decoder.known());
+        CPPUNIT_ASSERT_EQUAL(-1, decoder.position());
+      }
+
+      encoder.encode(ids, no_assocs, out);
+      CPPUNIT_ASSERT(out[0] & BEACON_KEYFRAME);
+      decoder.decode(out.data(), out.size(), me, id);
+      CPPUNIT_ASSERT(decoder.known());
+      CPPUNIT_ASSERT_EQUAL(6, decoder.position());
+    }
+
+    void
+    qa_tdma_beacon::t4()
+    {
+      beacon_encoder encoder;
+      std::vector<beacon_assoc> assocs(2);
+      std::vector<uint8_t> out;
+
+      srand(23);
+      memcpy(assocs[0].addr, me, 6);
+      memcpy(assocs[1].addr, me, 6);
+      for(int k = 0; k < 200; k++) {
+        std::vector<uint16_t> ids = random_set(rand() % 100, k % 2 ? 128 : 2000);
+        encoder.encode(ids, assocs, out);
+
+        for(size_t len = 0; len < out.size(); len++) {
+          beacon_decoder decoder;
+          uint16_t id = BEACON_NO_ID;
+          std::vector<uint8_t> cut(out.begin(), out.begin() + len); // Exact size, so that overreads show up under a checker
+          CPPUNIT_ASSERT_EQUAL((size_t)0, decoder.decode(cut.data(), len, me, id));
+        }
+      }
+    }
+
+    void
+    qa_tdma_beacon::t5()
+    {
+      beacon_encoder encoder;
+      beacon_decoder decoder;
+      std::vector<beacon_assoc> assocs(1);
+      std::vector<uint16_t> ids = {1, 3, 5}, other = {2, 4};
+      std::vector<uint8_t> out;
+      uint16_t id = BEACON_NO_ID;
+
+      encoder.encode(ids, std::vector<beacon_assoc>(), out);
+      CPPUNIT_ASSERT_EQUAL(out.size(), decoder.decode(out.data(), out.size(), me, id));
+
+      // A new set, with our association cut short: neither the association nor the set are taken
+      memcpy(assocs[0].addr, me, 6);
+      assocs[0].id = 4;
+      encoder.encode(other, assocs, out);
+      std::vector<uint8_t> cut(out.begin(), out.end() - 1);
+      CPPUNIT_ASSERT_EQUAL((size_t)0, decoder.decode(cut.data(), cut.size(), me, id));
+      CPPUNIT_ASSERT_EQUAL(BEACON_NO_ID, (int)id);
+      CPPUNIT_ASSERT_EQUAL(3, decoder.count());
+      CPPUNIT_ASSERT(decoder.known());
+
+      // Whole, it is
+      CPPUNIT_ASSERT_EQUAL(out.size(), decoder.decode(out.data(), out.size(), me, id));
+      CPPUNIT_ASSERT_EQUAL(4, (int)id);
+      CPPUNIT_ASSERT_EQUAL(2, decoder.count());
+      CPPUNIT_ASSERT_EQUAL(1, decoder.position());
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
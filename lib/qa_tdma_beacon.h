@@ -0,0 +1,52 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_TDMA_BEACON_H_
+#define _QA_TDMA_BEACON_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace macprotocols {
+
+    class qa_tdma_beacon : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_tdma_beacon);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST(t4);
+      CPPUNIT_TEST(t5);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void t1(); // Random sets, lists and bitmaps, repeated or not, decode to the right position
+      void t2(); // A station learns its short ID from an association
+      void t3(); // A station that missed the keyframe waits for the next one
+      void t4(); // Truncated beacons are rejected, never read past their end
+      void t5(); // A beacon with its associations cut short changes nothing
+    };
+
+  } /* namespace macprotocols */
+} /* namespace gr */
+
+#endif /* _QA_TDMA_BEACON_H_ */
@@ -0,0 +1,133 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_tx_schedule.h"
+#include "tx_schedule.h"
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+#include <utility>
+#include <vector>
+
+namespace gr {
+  namespace macprotocols {
+
+    typedef mac_clock::time_point time_point;
+
+    static const time_point start = time_point(std::chrono::seconds(1000));
+
+    static time_point at(long us)
+    {
+      return start + std::chrono::microseconds(us);
+    }
+
+    static long us(time_point t)
+    {
+      return std::chrono::duration_cast<std::chrono::microseconds>(t - start).count();
+    }
+
+    // Pops n frames on the clock, as the transmit thread does: (tag, time) of each
+    static std::vector<std::pair<long, long> > pop(tx_schedule &sched, mac_clock &clock, int n)
+    {
+      std::vector<std::pair<long, long> > popped;
+      pmt::pmt_t frame;
+      for(int i = 0; i < n; i++) {
+        CPPUNIT_ASSERT(sched.pop(clock, frame));
+        popped.push_back(std::make_pair(pmt::to_long(frame), us(clock.now())));
+      }
+      return popped;
+    }
+
+    void
+    qa_tx_schedule::t1()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      mac_clock::scoped_attach attach(*clock);
+      tx_schedule sched;
+
+      sched.push(*clock, at(30000), at(40000), pmt::from_long(1));
+      sched.push(*clock, at(100), at(40000), pmt::from_long(2));
+      sched.push(*clock, at(100), at(40000), pmt::from_long(3));
+      sched.push(*clock, at(2500), at(40000), pmt::from_long(4));
+      CPPUNIT_ASSERT_EQUAL((size_t)4, sched.size());
+
+      std::vector<std::pair<long, long> > popped = pop(sched, *clock, 4);
+      CPPUNIT_ASSERT(popped[0] == std::make_pair(2L, 100L));
+      CPPUNIT_ASSERT(popped[1] == std::make_pair(3L, 100L));
+      CPPUNIT_ASSERT(popped[2] == std::make_pair(4L, 2500L));
+      CPPUNIT_ASSERT(popped[3] == std::make_pair(1L, 30000L));
+      CPPUNIT_ASSERT_EQUAL((size_t)0, sched.size());
+    }
+
+    void
+    qa_tx_schedule::t2()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      tx_schedule sched;
+      boost::barrier attached(2);
+
+      // The answer to a SYNC heard at 1000, due at 1500, while the next one is waited for until 50000
+      sched.push(*clock, at(50000), at(60000), pmt::from_long(1));
+      clock->hold();
+      boost::thread handler([&] {
+        mac_clock::scoped_attach attach(*clock);
+        attached.wait();
+        clock->sleep_until(at(1000));
+        sched.push(*clock, at(1500), at(2000), pmt::from_long(2));
+      });
+      mac_clock::scoped_attach attach(*clock);
+      attached.wait();
+      clock->release();
+
+      std::vector<std::pair<long, long> > popped = pop(sched, *clock, 2);
+      handler.join();
+      CPPUNIT_ASSERT(popped[0] == std::make_pair(2L, 1500L));
+      CPPUNIT_ASSERT(popped[1] == std::make_pair(1L, 50000L));
+    }
+
+    void
+    qa_tx_schedule::t3()
+    {
+      virtual_clock::sptr clock = virtual_clock::make(start);
+      mac_clock::scoped_attach attach(*clock);
+      tx_schedule sched;
+      pmt::pmt_t frame;
+
+      // Late already: handed over at once, but as missed when its deadline is gone too
+      clock->advance(std::chrono::microseconds(500));
+      sched.push(*clock, at(100), at(400), pmt::from_long(1));
+      sched.push(*clock, at(200), at(600), pmt::from_long(2));
+      sched.push(*clock, at(700), at(700), pmt::from_long(3));
+
+      CPPUNIT_ASSERT(!sched.pop(*clock, frame));
+      CPPUNIT_ASSERT_EQUAL(1L, pmt::to_long(frame));
+      CPPUNIT_ASSERT(sched.pop(*clock, frame));
+      CPPUNIT_ASSERT_EQUAL(2L, pmt::to_long(frame));
+      CPPUNIT_ASSERT_EQUAL(500L, us(clock->now()));
+
+      // Its deadline is its send time: never in time
+      CPPUNIT_ASSERT(!sched.pop(*clock, frame));
+      CPPUNIT_ASSERT_EQUAL(3L, pmt::to_long(frame));
+      CPPUNIT_ASSERT_EQUAL(700L, us(clock->now()));
+    }
+
+  } /* namespace macprotocols */
+} /* namespace gr */
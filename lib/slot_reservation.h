@@ -0,0 +1,94 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_SLOT_RESERVATION_H
+#define INCLUDED_MACPROTOCOLS_SLOT_RESERVATION_H
+
+#include <algorithm>
+#include <stdint.h>
+
+#define RESERVE_MAX 255 // Superframes a comm slot can be reserved for
+#define RESERVE_IDLE 4 // Superframes a node keeps an idle reservation before releasing it
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Node side of a tdma comm slot reservation. A REQ may ask for the slot for several
+		 * superframes. If the ALLOC that answers it lists the node, the coordinator keeps it in the
+		 * following ALLOCs and leaves it out of the SYNCs: the node answers none of them until the
+		 * reservation is over, and is listed again then to renew it. A node whose queue stayed empty
+		 * for RESERVE_IDLE superframes answers the next SYNC anyway, with a SKIP, which releases it.
+		 *
+		 * Not thread-safe: it is meant to be used from the handler of "frame from phy" only.
+		 */
+		class slot_reservation {
+			public:
+				// reserve: superframes asked for, 0 or 1 for none (a plain REQ gets a single one)
+				slot_reservation(int reserve) : d_reserve(reserve > 1 ? std::min(reserve, RESERVE_MAX) : 0), d_left(0), d_idle(0), d_asking(false) {}
+
+				// SYNC heard, listing this node or not. True if it is to be left unanswered, the comm slot being ours already.
+				bool sync(bool listed, bool backlogged) {
+					if(listed or d_left == 0) {
+						d_left = 0; // Listed: our reservation, if any, is over
+						return false;
+					}
+					d_left--;
+					d_idle = backlogged ? 0 : d_idle + 1;
+					if(d_idle < RESERVE_IDLE) return true;
+					d_left = 0;
+					return false;
+				}
+
+				// Reservation byte of the answer to a SYNC: a REQ asks for one, a SKIP never does
+				uint8_t request(bool backlogged) {
+					d_asking = backlogged and d_reserve > 0;
+					return d_asking ? d_reserve : 0;
+				}
+
+				// ALLOC heard: if it lists the node, the reservation asked for is granted. The current superframe is one of them.
+				void alloc(bool listed) {
+					if(d_asking and listed) {
+						d_left = d_reserve - 1;
+						d_idle = 0;
+					}
+					d_asking = false;
+				}
+
+				// The coordinator may have forgotten the node
+				void reset() {
+					d_left = 0;
+				}
+
+				// Superframes left after the current one
+				int left() const {
+					return d_left;
+				}
+
+			private:
+				int d_reserve;
+				int d_left, d_idle; // Superframes left, and those the reservation has been idle
+				bool d_asking; // Our last answer asked for a reservation
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_SLOT_RESERVATION_H */
@@ -0,0 +1,158 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_SPSC_RING_H
+#define INCLUDED_MACPROTOCOLS_SPSC_RING_H
+
+#include <macprotocols/mac_clock.h>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+#define CACHE_LINE_SIZE 64
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Lock-free single-producer/single-consumer ring.
+		 *
+		 * The producer is the message handler that receives frames (push), the consumer is the
+		 * thread that transmits them (front, pop, wait_nonempty). size() and empty() may be read by
+		 * any thread, the result is then only a hint. Producer and consumer indexes live on
+		 * separate cache lines, and each side keeps a cached copy of the other side's index so
+		 * that the shared line is only read when the ring looks full/empty.
+		 */
+		template<typename T>
+		class spsc_ring {
+			public:
+				explicit spsc_ring(size_t capacity) : d_capacity(capacity), d_head(0), d_cached_tail(0),
+						d_tail(0), d_cached_head(0), d_waiting(false) {
+					size_t size = 1;
+					while(size < capacity) size <<= 1;
+					d_mask = size - 1;
+					d_slots.resize(size);
+				}
+
+				// Producer only. Returns false if the ring is full.
+				bool push(const T &item) {
+					size_t tail = d_tail.load(std::memory_order_relaxed);
+					if(tail - d_cached_head >= d_capacity) {
+						d_cached_head = d_head.load(std::memory_order_acquire);
+						if(tail - d_cached_head >= d_capacity) return false;
+					}
+
+					d_slots[tail & d_mask] = item;
+					d_tail.store(tail + 1, std::memory_order_release);
+
+					// Wakes the consumer up only if it is sleeping in wait_nonempty()
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if(d_waiting.load(std::memory_order_relaxed)) {
+						boost::unique_lock<boost::mutex> lock(d_mu);
+						d_cond.notify_all();
+					}
+					return true;
+				}
+
+				// Consumer only. The ring must not be empty.
+				T& front() {
+					return d_slots[d_head.load(std::memory_order_relaxed) & d_mask];
+				}
+
+				// Consumer only. Element i from the head, i < size().
+				T& at(size_t i) {
+					return d_slots[(d_head.load(std::memory_order_relaxed) + i) & d_mask];
+				}
+
+				// Consumer only. The ring must not be empty.
+				void pop() {
+					size_t head = d_head.load(std::memory_order_relaxed);
+					d_slots[head & d_mask] = T(); // Releases the element now, not when the slot is reused
+					d_head.store(head + 1, std::memory_order_release);
+				}
+
+				// Consumer only. Blocks until there is at least one element.
+				void wait_nonempty() {
+					if(nonempty_consumer()) return;
+
+					boost::unique_lock<boost::mutex> lock(d_mu);
+					d_waiting.store(true, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					while(!nonempty_consumer()) d_cond.wait(lock);
+					d_waiting.store(false, std::memory_order_relaxed);
+				}
+
+				// Same, the wait going through clock (see mac_clock)
+				void wait_nonempty(mac_clock &clock) {
+					if(nonempty_consumer()) return;
+
+					boost::unique_lock<boost::mutex> lock(d_mu);
+					d_waiting.store(true, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					clock.wait(lock, d_cond, [this] { return nonempty_consumer(); });
+					d_waiting.store(false, std::memory_order_relaxed);
+				}
+
+				size_t size() const {
+					size_t head = d_head.load(std::memory_order_acquire);
+					return d_tail.load(std::memory_order_acquire) - head;
+				}
+
+				bool empty() const {
+					return size() == 0;
+				}
+
+				size_t capacity() const {
+					return d_capacity;
+				}
+
+			private:
+				bool nonempty_consumer() {
+					size_t head = d_head.load(std::memory_order_relaxed);
+					if(d_cached_tail == head) d_cached_tail = d_tail.load(std::memory_order_acquire);
+					return d_cached_tail != head;
+				}
+
+				// Read-only after construction
+				size_t d_capacity, d_mask;
+				std::vector<T> d_slots;
+				char d_pad0[CACHE_LINE_SIZE];
+
+				// Consumer side
+				std::atomic<size_t> d_head;
+				size_t d_cached_tail;
+				char d_pad1[CACHE_LINE_SIZE];
+
+				// Producer side
+				std::atomic<size_t> d_tail;
+				size_t d_cached_head;
+				char d_pad2[CACHE_LINE_SIZE];
+
+				// Sleeping consumer
+				std::atomic<bool> d_waiting;
+				boost::mutex d_mu;
+				boost::condition_variable d_cond;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_SPSC_RING_H */
@@ -0,0 +1,185 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_STATION_TABLE_H
+#define INCLUDED_MACPROTOCOLS_STATION_TABLE_H
+
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#define STATION_TABLE_MIN_SIZE 64 // Initial hash size, power of 2
+#define STATION_MAX_ID 8191 // Short IDs go from 1 to this, 0 means none
+
+namespace gr {
+	namespace macprotocols {
+
+		struct station {
+			uint8_t addr[6];
+			uint16_t id; // Short ID, 0 if the table ran out of them
+			bool confirmed; // The station showed it knows its short ID
+			int sync_pos; // Alloc slot: position in the last SYNC, -1 if not listed
+			int comm_slot; // Position in the last ALLOC, -1 if none
+			uint32_t heard; // Allocation interval of its last REQ/SKIP
+			int demand; // Frames waiting at the station, as of its last REQ/SKIP
+			uint32_t demand_bytes; // Their size, 0 if the station did not tell
+			uint32_t reserved_until; // Last allocation interval its comm slot is reserved for, 0 if none
+			std::chrono::high_resolution_clock::time_point last_seen;
+		};
+
+		/*
+		 * Stations known to a tdma coordinator. The records sit in a dense vector, in order of
+		 * arrival, and an open-addressed hash (linear probing, FNV-1a over the MAC address, kept at
+		 * most half full) maps addresses to their index. Lookups and inserts are O(1) whatever the
+		 * number of stations, and the table grows as needed.
+		 *
+		 * Each station also gets a short ID, the lowest one free, so that the IDs in use stay dense
+		 * (bitmaps over them stay short). find_id() maps it back to the station in O(1).
+		 *
+		 * Removing a station moves the last record into its place, so indices and pointers are only
+		 * valid until the next remove(). Not thread-safe.
+		 */
+		class station_table {
+			public:
+				station_table() : d_index(STATION_TABLE_MIN_SIZE, -1), d_by_id(1, -1) {}
+
+				size_t size() const { return d_stations.size(); }
+				station& operator[](size_t i) { return d_stations[i]; }
+
+				// Index of addr, -1 if unknown
+				int find(const uint8_t *addr) const {
+					for(size_t h = hash(addr) & mask(); d_index[h] >= 0; h = (h + 1) & mask()) {
+						if(memcmp(d_stations[d_index[h]].addr, addr, 6) == 0) return d_index[h];
+					}
+					return -1;
+				}
+
+				// Index of the station with short ID id, -1 if none
+				int find_id(uint16_t id) const {
+					return id > 0 and id < d_by_id.size() ? d_by_id[id] : -1;
+				}
+
+				// Highest short ID in use, 0 if none
+				uint16_t max_id() const { return d_by_id.size() - 1; }
+
+				// Index of addr, which is added if unknown
+				int add(const uint8_t *addr) {
+					int i = find(addr);
+					if(i >= 0) return i;
+
+					if(2*(d_stations.size() + 1) > d_index.size()) rehash(2*d_index.size());
+
+					station s = station();
+					memcpy(s.addr, addr, 6);
+					s.sync_pos = -1;
+					s.comm_slot = -1;
+					s.id = new_id();
+					d_stations.push_back(s);
+					place(d_stations.size() - 1);
+					if(s.id > 0) d_by_id[s.id] = d_stations.size() - 1;
+					return d_stations.size() - 1;
+				}
+
+				void remove(int i) {
+					// Backward shift deletion keeps the probing chains whole without tombstones
+					size_t h = slot_of(i);
+					for(size_t next = (h + 1) & mask(); d_index[next] >= 0; next = (next + 1) & mask()) {
+						size_t home = hash(d_stations[d_index[next]].addr) & mask();
+						if(((next - home) & mask()) >= ((next - h) & mask())) { // Its chain runs through h
+							d_index[h] = d_index[next];
+							h = next;
+						}
+					}
+					d_index[h] = -1;
+					free_id(d_stations[i].id);
+
+					int last = d_stations.size() - 1;
+					if(i != last) {
+						d_index[slot_of(last)] = i;
+						if(d_stations[last].id > 0) d_by_id[d_stations[last].id] = i;
+						d_stations[i] = d_stations[last];
+					}
+					d_stations.pop_back();
+				}
+
+			private:
+				static size_t hash(const uint8_t *addr) {
+					uint32_t h = 2166136261u;
+					for(int i = 0; i < 6; i++) h = (h ^ addr[i])*16777619u;
+					return h;
+				}
+
+				size_t mask() const { return d_index.size() - 1; }
+
+				// Hash slot holding index i
+				size_t slot_of(int i) const {
+					size_t h = hash(d_stations[i].addr) & mask();
+					while(d_index[h] != i) h = (h + 1) & mask();
+					return h;
+				}
+
+				void place(int i) {
+					size_t h = hash(d_stations[i].addr) & mask();
+					while(d_index[h] >= 0) h = (h + 1) & mask();
+					d_index[h] = i;
+				}
+
+				uint16_t new_id() {
+					uint16_t id;
+					if(!d_free_ids.empty()) {
+						id = d_free_ids.top();
+						d_free_ids.pop();
+					} else if(d_by_id.size() <= STATION_MAX_ID) {
+						id = d_by_id.size();
+					} else {
+						return 0;
+					}
+
+					if(id >= d_by_id.size()) d_by_id.resize(id + 1, -1);
+					return id;
+				}
+
+				void free_id(uint16_t id) {
+					if(id == 0) return;
+					d_by_id[id] = -1;
+					d_free_ids.push(id);
+
+					// Keeps max_id() the highest ID in use. IDs past it stay in d_free_ids.
+					while(d_by_id.size() > 1 and d_by_id.back() < 0) d_by_id.pop_back();
+				}
+
+				void rehash(size_t n) {
+					d_index.assign(n, -1);
+					for(size_t i = 0; i < d_stations.size(); i++) place(i);
+				}
+
+				std::vector<station> d_stations;
+				std::vector<int32_t> d_index;
+				std::vector<int32_t> d_by_id; // Short ID -> index, -1 if free
+				std::priority_queue<uint16_t, std::vector<uint16_t>, std::greater<uint16_t> > d_free_ids;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_STATION_TABLE_H */
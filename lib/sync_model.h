@@ -0,0 +1,215 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_SYNC_MODEL_H
+#define INCLUDED_MACPROTOCOLS_SYNC_MODEL_H
+
+#include <pmt/pmt.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <stdint.h>
+
+#define SYNC_MODEL_SIZE 32 // Beacons the fit is made over
+#define SYNC_MODEL_MIN 4 // Beacons needed before the fit is used
+#define SYNC_MAX_DRIFT 200e-6 // Largest drift between two clocks believed (200 ppm)
+#define SYNC_DRIFT_SPAN 1000000 // (us) Baseline of a drift measurement
+#define SYNC_DRIFT_EWMA 8 // Weight (1/n) of a new drift measurement
+#define SYNC_MAX_GAP 1000000 // (us) Longer silences, or jumps of the PHY clock, start the model over
+#define SYNC_OUTLIER 4 // Beacons this many RMS residuals away from the fit are outliers...
+#define SYNC_MIN_RESIDUAL 50 // (us) ...as long as they are this far at least
+#define SYNC_STAMP_LEN 8 // Coordinator's time (us, u64) in a beacon
+
+namespace gr {
+	namespace macprotocols {
+
+		// PHY timestamp (us) of a received frame: "rx_time" in its metadata, either UHD style (full seconds, fractional seconds) or seconds
+		inline bool rx_time_of(pmt::pmt_t frame, int64_t &us) {
+			static const pmt::pmt_t key = pmt::mp("rx_time");
+
+			pmt::pmt_t car = pmt::car(frame);
+			if(!pmt::is_dict(car)) return false;
+
+			pmt::pmt_t t = pmt::dict_ref(car, key, pmt::PMT_NIL);
+			if(pmt::is_tuple(t) and pmt::length(t) == 2) {
+				us = pmt::to_uint64(pmt::tuple_ref(t, 0))*1000000 + llround(pmt::to_double(pmt::tuple_ref(t, 1))*1e6);
+				return true;
+			}
+			if(pmt::is_number(t)) {
+				us = llround(pmt::to_double(t)*1e6);
+				return true;
+			}
+			return false;
+		}
+
+		/*
+		 * A node's estimate of the coordinator's clock. Each beacon carries the time the coordinator
+		 * sent it at (its own clock); paired with the local time it arrived at, it is a point of the
+		 * line local = a + b*remote, fitted by least squares over the last SYNC_MODEL_SIZE beacons.
+		 * The offset a and drift b - 1 absorb the difference between both clocks, and the fit averages
+		 * out the jitter of single arrivals. Slot starts are then scheduled from the line instead of
+		 * the time the last beacon happened to reach the message handler.
+		 *
+		 * Beacons a few ms apart say next to nothing about a drift of a few ppm, so the slope is not
+		 * fitted over the window: the drift is measured between points of the line SYNC_DRIFT_SPAN
+		 * apart, smoothed, and the window only fits the offset.
+		 *
+		 * Arrival is the PHY's RX timestamp when the frame carries one (see rx_time_of()). The PHY
+		 * has a clock of its own: it is mapped to the local one by the smallest (handled - rx_time)
+		 * over the same window, i.e. the frame that went through the flowgraph fastest.
+		 *
+		 * Beacons far off the line (a message stuck behind others) are left out. Not thread-safe.
+		 */
+		class sync_model {
+			public:
+				typedef std::chrono::high_resolution_clock::time_point time_point;
+
+				sync_model() : d_drift(0), d_drifts(0) { reset(); }
+
+				// Forgets the beacons, but not the drift: the clocks did not change
+				void reset() {
+					d_n = d_next = 0;
+					d_phy_n = d_phy_next = 0;
+					d_rejected = 0;
+					d_xref = d_yref = 0;
+					d_a = d_rms = 0;
+					d_anchored = false;
+					d_anchor_x = 0;
+					d_anchor_y = 0;
+				}
+
+				bool ready() const { return d_n >= SYNC_MODEL_MIN; }
+				double drift() const { return d_drift; }
+				double jitter() const { return d_rms; } // RMS residual (us)
+
+				// Local time of a beacon the coordinator sent at remote (us), handled now. Adds it to the fit.
+				time_point observe(int64_t remote, pmt::pmt_t frame, time_point handled) {
+					int64_t arrival = us(handled), rx;
+					if(rx_time_of(frame, rx)) arrival = phy_to_local(rx, arrival);
+
+					add(remote, arrival);
+					return ready() ? local(remote) : time_point(std::chrono::microseconds(arrival));
+				}
+
+				// Local time of the coordinator's remote (us)
+				time_point local(int64_t remote) const {
+					return time_point(std::chrono::microseconds(d_yref + llround(at(remote))));
+				}
+
+				static int64_t us(time_point t) {
+					return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+				}
+
+			private:
+				void add(int64_t x, int64_t y) {
+					if(d_n > 0) {
+						int64_t last = d_x[(d_next + SYNC_MODEL_SIZE - 1) % SYNC_MODEL_SIZE];
+						if(x <= last or x - last > SYNC_MAX_GAP) reset(); // The coordinator restarted, or we lost it for long
+					}
+
+					if(ready()) {
+						double r = std::fabs(y - d_yref - at(x));
+						if(r > std::max(SYNC_OUTLIER*d_rms, (double)SYNC_MIN_RESIDUAL) and ++d_rejected < SYNC_MODEL_SIZE/2) return;
+						if(d_rejected >= SYNC_MODEL_SIZE/2) reset(); // Not outliers anymore, but a new line
+					}
+					d_rejected = 0;
+
+					d_x[d_next] = x;
+					d_y[d_next] = y;
+					d_next = (d_next + 1) % SYNC_MODEL_SIZE;
+					d_n = std::min(d_n + 1, (size_t)SYNC_MODEL_SIZE);
+					fit(x, y);
+					if(ready()) measure_drift(x);
+				}
+
+				double at(int64_t x) const { // Line at x, relative to d_yref
+					return d_a + (1 + d_drift)*(x - d_xref);
+				}
+
+				void fit(int64_t xref, int64_t yref) {
+					// Offset, around the newest point so that the sums stay small
+					double b = 1 + d_drift, sum = 0, see = 0;
+					for(size_t k = 0; k < d_n; k++) sum += (d_y[k] - yref) - b*(d_x[k] - xref);
+					d_a = sum/d_n;
+					d_xref = xref;
+					d_yref = yref;
+
+					for(size_t k = 0; k < d_n; k++) {
+						double e = d_y[k] - yref - at(d_x[k]);
+						see += e*e;
+					}
+					d_rms = std::sqrt(see/d_n);
+				}
+
+				void measure_drift(int64_t x) {
+					// Remote and local time elapsed between two fitted points
+					double y = d_yref + at(x);
+					if(!d_anchored or x - d_anchor_x < SYNC_DRIFT_SPAN) {
+						if(!d_anchored) {
+							d_anchor_x = x;
+							d_anchor_y = y;
+							d_anchored = true;
+						}
+						return;
+					}
+
+					double m = (y - d_anchor_y)/(x - d_anchor_x) - 1;
+					d_drift = d_drifts++ > 0 ? d_drift + (m - d_drift)/SYNC_DRIFT_EWMA : m;
+					d_drift = std::min(std::max(d_drift, -SYNC_MAX_DRIFT), SYNC_MAX_DRIFT);
+					d_anchor_x = x;
+					d_anchor_y = y;
+				}
+
+				int64_t phy_to_local(int64_t rx, int64_t handled) {
+					int64_t delay = handled - rx;
+					if(d_phy_n > 0 and std::abs(delay - d_phy_delay[(d_phy_next + SYNC_MODEL_SIZE - 1) % SYNC_MODEL_SIZE]) > SYNC_MAX_GAP) d_phy_n = d_phy_next = 0; // PHY clock was set
+
+					d_phy_delay[d_phy_next] = delay;
+					d_phy_next = (d_phy_next + 1) % SYNC_MODEL_SIZE;
+					d_phy_n = std::min(d_phy_n + 1, (size_t)SYNC_MODEL_SIZE);
+					return rx + *std::min_element(d_phy_delay, d_phy_delay + d_phy_n);
+				}
+
+				// Last beacons (remote, arrival), a ring
+				int64_t d_x[SYNC_MODEL_SIZE], d_y[SYNC_MODEL_SIZE];
+				size_t d_n, d_next;
+				int d_rejected; // Outliers in a row
+
+				// local = d_yref + d_a + (1 + d_drift)*(remote - d_xref)
+				int64_t d_xref, d_yref;
+				double d_a, d_rms;
+
+				// Drift, and the point of the line it is next measured from
+				double d_drift;
+				int d_drifts; // Measurements so far
+				bool d_anchored;
+				int64_t d_anchor_x;
+				double d_anchor_y;
+
+				// Last (handled - rx_time), a ring
+				int64_t d_phy_delay[SYNC_MODEL_SIZE];
+				size_t d_phy_n, d_phy_next;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_SYNC_MODEL_H */
@@ -0,0 +1,235 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_TDMA_BEACON_H
+#define INCLUDED_MACPROTOCOLS_TDMA_BEACON_H
+
+#include <algorithm>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Payload of the SYNC/ALLOC frames of tdma and naive_tdma
+#define BEACON_KEYFRAME 0x01 // The station set follows. Otherwise it is the one of the last keyframe of that version.
+#define BEACON_BITMAP 0x02 // Set given as a bitmap over short IDs, otherwise as a list of them
+#define BEACON_HEADER_LEN 4 // Flags, version, number of stations in the set (uint16)
+#define BEACON_KEYFRAME_INTERVAL 8 // Beacons between two keyframes of an unchanged set, for stations that missed one
+#define BEACON_MAX_ASSOC 8 // Associations carried by a beacon
+#define BEACON_NO_ID 0 // Short ID of a station not associated yet
+
+namespace gr {
+	namespace macprotocols {
+
+		// A station learns its short ID from the beacon carrying its MAC address
+		struct beacon_assoc {
+			uint8_t addr[6];
+			uint16_t id;
+		};
+
+		namespace beacon {
+
+			inline void put16(std::vector<uint8_t> &out, uint16_t v) {
+				out.push_back(v & 0xff);
+				out.push_back(v >> 8);
+			}
+
+			inline void put32(std::vector<uint8_t> &out, uint32_t v) {
+				put16(out, v & 0xffff);
+				put16(out, v >> 16);
+			}
+
+			inline void put64(std::vector<uint8_t> &out, uint64_t v) {
+				put32(out, v & 0xffffffff);
+				put32(out, v >> 32);
+			}
+
+			inline void set64(uint8_t *p, uint64_t v) {
+				for(int k = 0; k < 8; k++) p[k] = v >> 8*k;
+			}
+
+			inline uint16_t get16(const uint8_t *p) {
+				return p[0] | p[1] << 8;
+			}
+
+			inline uint32_t get32(const uint8_t *p) {
+				return get16(p) | (uint32_t)get16(p + 2) << 16;
+			}
+
+			inline uint64_t get64(const uint8_t *p) {
+				return get32(p) | (uint64_t)get32(p + 4) << 32;
+			}
+
+		} // namespace beacon
+
+		/*
+		 * Coordinator side. Stations are named by short IDs (1-2 bytes, see station_table) instead of
+		 * their MAC address, and the ordered set of a SYNC or ALLOC (slot order is ascending ID) goes
+		 * out either as a list of IDs or as a bitmap over them, whichever is shorter. When the set is
+		 * the same as in the previous beacon, only the header goes out: the version of the set it
+		 * repeats and its size. A new set gets a new version and is always a keyframe, and so is every
+		 * BEACON_KEYFRAME_INTERVAL-th beacon.
+		 *
+		 * A beacon ends with up to BEACON_MAX_ASSOC associations (MAC address, short ID).
+		 */
+		class beacon_encoder {
+			public:
+				beacon_encoder() : d_version(0), d_since_keyframe(BEACON_KEYFRAME_INTERVAL) {}
+
+				// ids in ascending order
+				void encode(const std::vector<uint16_t> &ids, const std::vector<beacon_assoc> &assocs, std::vector<uint8_t> &out) {
+					uint8_t flags = 0;
+					size_t bitmap_len = ids.empty() ? 0 : ids.back()/8 + 1;
+
+					if(ids != d_last) {
+						d_version++;
+						d_last = ids;
+						d_since_keyframe = BEACON_KEYFRAME_INTERVAL;
+					}
+					if(d_since_keyframe >= BEACON_KEYFRAME_INTERVAL) {
+						flags |= BEACON_KEYFRAME;
+						if(bitmap_len + 2 < 2*ids.size()) flags |= BEACON_BITMAP;
+						d_since_keyframe = 0;
+					}
+					d_since_keyframe++;
+
+					out.clear();
+					out.push_back(flags);
+					out.push_back(d_version);
+					beacon::put16(out, ids.size());
+
+					if(flags & BEACON_BITMAP) {
+						beacon::put16(out, bitmap_len);
+						out.resize(out.size() + bitmap_len, 0);
+						uint8_t *bitmap = &out[out.size() - bitmap_len];
+						for(size_t i = 0; i < ids.size(); i++) bitmap[ids[i]/8] |= 1 << (ids[i] % 8);
+					} else if(flags & BEACON_KEYFRAME) {
+						for(size_t i = 0; i < ids.size(); i++) beacon::put16(out, ids[i]);
+					}
+
+					size_t n = std::min(assocs.size(), (size_t)BEACON_MAX_ASSOC);
+					out.push_back(n);
+					for(size_t i = 0; i < n; i++) {
+						out.insert(out.end(), assocs[i].addr, assocs[i].addr + 6);
+						beacon::put16(out, assocs[i].id);
+					}
+				}
+
+			private:
+				std::vector<uint16_t> d_last;
+				uint8_t d_version;
+				int d_since_keyframe;
+		};
+
+		/*
+		 * Station side: position of the station in the set of a beacon. The last keyframe is kept,
+		 * so beacons that only repeat its version are resolved without it. The position is computed
+		 * once per keyframe (or new short ID): a popcount over the bitmap up to the ID, or a scan of
+		 * the list starting where the station was the last time.
+		 */
+		class beacon_decoder {
+			public:
+				beacon_decoder() : d_count(0), d_position(-1), d_known(false), d_have_keyframe(false), d_stale(true), d_id(BEACON_NO_ID), d_hint(0) {}
+
+				// Bytes of p taken by the beacon, 0 if it is malformed or truncated (and then nothing is taken from it).
+				// id is updated if the beacon carries an association for addr.
+				size_t decode(const uint8_t *p, size_t len, const uint8_t *addr, uint16_t &id) {
+					if(len < BEACON_HEADER_LEN) return 0;
+
+					uint8_t flags = p[0], version = p[1];
+					size_t pos = BEACON_HEADER_LEN, body = 0;
+					int count = beacon::get16(p + 2);
+
+					if(flags & BEACON_BITMAP) {
+						if(len < pos + 2) return 0;
+						body = 2 + beacon::get16(p + pos);
+					} else if(flags & BEACON_KEYFRAME) {
+						body = 2*count;
+					}
+					if(len < pos + body + 1) return 0;
+					size_t n = p[pos + body];
+					if(len < pos + body + 1 + 8*n) return 0;
+
+					d_count = count;
+					if(flags & BEACON_KEYFRAME) {
+						d_flags = flags;
+						d_version = version;
+						d_keyframe.assign(p + pos, p + pos + body);
+						d_have_keyframe = true;
+						d_stale = true;
+					}
+					pos += body + 1;
+
+					for(size_t i = 0; i < n; i++, pos += 8) {
+						if(memcmp(p + pos, addr, 6) == 0) id = beacon::get16(p + pos + 6);
+					}
+
+					d_known = d_have_keyframe and d_version == version;
+					if(d_known and (d_stale or id != d_id)) {
+						d_id = id;
+						d_position = find(id);
+						d_stale = false;
+					}
+					return pos;
+				}
+
+				// Whether the set of the last beacon is known (its keyframe was received)
+				bool known() const { return d_known; }
+
+				// Stations in the set of the last beacon
+				int count() const { return d_count; }
+
+				// Position of the station in it, -1 if not listed or not known
+				int position() const { return d_known ? d_position : -1; }
+
+			private:
+				int find(uint16_t id) {
+					if(id == BEACON_NO_ID) return -1;
+
+					if(d_flags & BEACON_BITMAP) {
+						const uint8_t *bitmap = d_keyframe.data() + 2;
+						size_t len = d_keyframe.size() - 2;
+						if((size_t)id/8 >= len or !(bitmap[id/8] & (1 << (id % 8)))) return -1;
+
+						int position = 0;
+						for(size_t i = 0; i < (size_t)id/8; i++) position += __builtin_popcount(bitmap[i]);
+						return position + __builtin_popcount(bitmap[id/8] & ((1 << (id % 8)) - 1));
+					}
+
+					int n = d_keyframe.size()/2;
+					for(int k = 0; k < n; k++) {
+						int i = (d_hint + k) % n;
+						if(beacon::get16(&d_keyframe[2*i]) == id) return d_hint = i;
+					}
+					return -1;
+				}
+
+				int d_count, d_position;
+				bool d_known, d_have_keyframe, d_stale; // d_stale: d_position is not computed on the last keyframe
+				uint8_t d_flags, d_version;
+				std::vector<uint8_t> d_keyframe; // Set part of the last keyframe
+				uint16_t d_id; // Short ID d_position was computed for
+				int d_hint;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_TDMA_BEACON_H */
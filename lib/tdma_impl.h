@@ -0,0 +1,802 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2018 - André Gomes, The Federal University of Minas Gerias (UFMG) <andre.gomes@dcc.ufmg.br>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Implementation class of the tdma block, see tdma.cc. Only included by tdma.cc and by qa_tdma.cc,
+ * which drives its handlers directly.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_TDMA_IMPL_H
+#define INCLUDED_MACPROTOCOLS_TDMA_IMPL_H
+
+#include <gnuradio/io_signature.h>
+#include "tdma.h"
+#include <boost/thread.hpp>
+#include <unistd.h>
+#include <string>
+#include <cstdlib>
+#include <stdlib.h>
+#include <time.h>
+#include "crc32.h"
+#include "ack_template.h"
+#include "dup_cache.h"
+#include "mac_stats.h"
+#include "tx_schedule.h"
+#include "station_table.h"
+#include "slot_reservation.h"
+#include "tdma_beacon.h"
+#include "sync_model.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+
+#define MAX_RETRIES 5
+#define STATION_TIMEOUT 10000000 // (us) The coordinator forgets stations not heard for this long
+#define STATION_SWEEP 4 // Stations checked for timeout per superframe
+#define TX_QUEUE_SIZE 8 // Frames held by a node that fills its comm slot
+#define BACKLOG_EWMA 8 // Weight (1/n) of a new frame in the mean frame size
+#define ALLOC_SLOT_UNIT 4 // (us) Unit of the comm slot boundaries in an ALLOC
+// ALLOC trailer, after the set of stations and the coordinator's stamp
+#define ALLOC_EQUAL 0 // Comm slots of pr_comm_slot
+#define ALLOC_WEIGHTED 1 // Followed by the end of each comm slot (u16, ALLOC_SLOT_UNIT), in slot order
+// Frame Control (FC) cheat sheet
+#define FC_ACK 0x2B00
+#define FC_DATA 0x0008
+// FC reserved to TDMA
+#define FC_SYNC 0x2000 // Frame Control for SYNC
+#define FC_ALLOC 0x2800 // Frame Control for Allocation
+#define FC_REQ 0x2400 // Frame Control for Requesting a slot during allocation
+#define FC_SKIP 0x2C00 // Frame Control for Skipping a slot during allocation (slot not allocated)
+// Informs the protocol in use on the network
+#define FC_PROTOCOL 0x2900 // Active protocol on network
+#define FC_METRICS 0x2100
+
+using namespace gr::macprotocols;
+
+class tdma_impl : public tdma {
+
+	typedef std::chrono::high_resolution_clock clock;
+
+	public:
+		tdma_impl(bool is_coord, std::vector<uint8_t> src_mac, uint16_t slot_time, uint16_t alpha, bool debug, int comm_slot, double byte_time, int sifs, int max_comm, int min_slot, int reserve, mac_clock::sptr clock) : gr::block("tdma",
+							gr::io_signature::make(0, 0, 0),
+							gr::io_signature::make(0, 0, 0)),
+							pr_slot_time(alpha*slot_time), pr_is_coord(is_coord), pr_debug(debug),
+								pr_sync_time(alpha*slot_time), pr_data_time(alpha*slot_time), pr_ack_time(alpha*slot_time), pr_alloc_slot(alpha*slot_time),
+								pr_status(false), pr_frame_acked(false), pr_comm_started(false), pr_byte_time(byte_time), pr_sifs(sifs),
+								pr_interval(1), pr_sweep(0), pr_short_id(BEACON_NO_ID), pr_reservation(reserve),
+								pr_slot_start(0), pr_slot_len(0), pr_buffered(0), pr_mean_len(0), pr_ack(src_mac.data(), FC_ACK), pr_clock(clock) {
+			// Inputs
+			message_port_register_in(msg_port_frame_from_buff);
+			set_msg_handler(msg_port_frame_from_buff, boost::bind(&tdma_impl::frame_from_buff, this, _1));
+
+			message_port_register_in(msg_port_frame_from_phy);
+			set_msg_handler(msg_port_frame_from_phy, boost::bind(&tdma_impl::frame_from_phy, this, _1));
+
+			message_port_register_in(msg_port_stats_request);
+			set_msg_handler(msg_port_stats_request, boost::bind(&tdma_impl::stats_request, this, _1));
+
+			message_port_register_in(msg_port_backlog_in);
+			set_msg_handler(msg_port_backlog_in, boost::bind(&tdma_impl::backlog_in, this, _1));
+
+			// Outputs
+			message_port_register_out(msg_port_frame_to_phy);
+			message_port_register_out(msg_port_frame_request);
+			message_port_register_out(msg_port_frame_to_app);
+			message_port_register_out(msg_port_stats);
+
+			for(int i = 0; i < 6; i++) {
+				pr_mac_addr[i] = src_mac[i];
+				pr_broadcast_addr[i] = 0xff;
+			}
+
+			pr_comm_slot = comm_slot > 0 ? comm_slot : pr_data_time + pr_ack_time;
+			pr_queue_size = pr_byte_time > 0 ? TX_QUEUE_SIZE : 1; // Without airtimes, a single frame fits a slot
+			pr_max_comm = pr_byte_time > 0 ? std::min(max_comm, 0xffff*ALLOC_SLOT_UNIT) : 0; // Backlogs can't be weighted without airtimes
+			pr_min_slot = min_slot > 0 ? min_slot : pr_comm_slot;
+			pr_sync_time0 = pr_clock->now();
+			pr_comm_time0 = pr_sync_time0;
+		}
+
+		bool start() {
+			/*
+			 * The use of start() prevents the thread bellow to access the message port before it even exists. 
+			 * This ensures the scheduler first deals with the msg port, then the thread is created.
+			*/
+			if(pr_is_coord) thread_sync = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&tdma_impl::sync_func, this)));
+			thread_send_frame = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&tdma_impl::send_frame, this)));
+			thread_scheduled_tx = boost::shared_ptr<gr::thread::thread> (new gr::thread::thread(boost::bind(&tdma_impl::scheduled_tx, this)));
+
+			// TDMA holds a single frame at a time, unless it fills its comm slot, so it advertises that many slots to frame buffer.
+			message_port_pub(msg_port_frame_request, pmt::from_long(pr_queue_size));
+			return block::start();
+		}
+
+		void frame_from_buff(pmt::pmt_t frame) {
+			boost::unique_lock<boost::mutex> lock(pr_mu4);
+			if(pr_debug) std::cout << "New frame from app" << std::endl << std::flush;
+
+			if(pr_queue.size() < pr_queue_size) {
+				long len = pmt::blob_length(pmt::cdr(frame));
+				pr_mean_len = pr_mean_len > 0 ? pr_mean_len + (len - pr_mean_len)/BACKLOG_EWMA : len;
+
+				if(pr_queue.empty()) { // The first frame waits for the next comm interval
+					boost::unique_lock<boost::mutex> lock2(pr_mu2);
+					pr_comm_started = false;
+				}
+				pr_queue.push_back(tx_frame{frame, 0}); // Frame to be sent.
+				pr_status = true; // This means that there is at least one frame to be sent.
+				pr_stats.high_water(STAT_QUEUE_HIGH_WATER, pr_queue.size());
+				pr_clock->notify_all(pr_cond2);
+			} else {
+				pr_stats.inc(STAT_DROPS_QUEUE_FULL);
+			}
+
+			lock.unlock();
+		}
+
+		pmt::pmt_t stats() {
+			return pr_stats.snapshot();
+		}
+
+		void stats_request(pmt::pmt_t msg) {
+			message_port_pub(msg_port_stats, stats());
+		}
+
+		void backlog_in(pmt::pmt_t msg) {
+			// Frames waiting in frame buffer ("bsz out")
+			if(!pmt::is_number(msg)) return;
+			boost::unique_lock<boost::mutex> lock(pr_mu4);
+			pr_buffered = std::max(0L, (long)pmt::to_double(msg));
+		}
+
+		void backlog(uint32_t &frames, uint32_t &bytes) {
+			// Frames waiting to be sent, here and in frame buffer, and their size (mean size for the latter)
+			boost::unique_lock<boost::mutex> lock(pr_mu4);
+			double len = pr_buffered*pr_mean_len;
+			for(size_t k = 0; k < pr_queue.size(); k++) len += pmt::blob_length(pmt::cdr(pr_queue[k].frame));
+			frames = std::min(pr_queue.size() + pr_buffered, (size_t)0xffff);
+			bytes = std::min(len, (double)UINT32_MAX);
+		}
+
+		void send_frame() {
+			pr_clock->attach();
+			while(true) {
+				// Waiting for a new frame
+				boost::unique_lock<boost::mutex> lock0(pr_mu4);
+				pr_clock->wait(lock0, pr_cond2, [this] { return pr_status; });
+				lock0.unlock();
+
+				boost::unique_lock<boost::mutex> lock1(pr_mu2);
+				pr_clock->wait(lock1, pr_cond1, [this] { return pr_comm_started; }); // Waits for the beggining of Communication Interval
+
+				// Waits for the beginning of the allocated comm slot
+				decltype(clock::now()) slot_start = pr_comm_time0 + std::chrono::microseconds(pr_slot_start);
+				decltype(clock::now()) slot_end = slot_start + std::chrono::microseconds(pr_slot_len);
+				pr_comm_started = false; // Anyway, wait until next communication interval
+				lock1.unlock();
+
+				pr_clock->spin_until(slot_start);
+				fill_slot(slot_end);
+			}
+		}
+
+		void start_comm(decltype(clock::now()) comm_time0, long slot_start, long slot_len) {
+			// Hands our comm slot over to send_frame(). Everything its wait depends on is set under pr_mu2.
+			boost::unique_lock<boost::mutex> lock(pr_mu2);
+			pr_comm_time0 = comm_time0;
+			pr_slot_start = slot_start;
+			pr_slot_len = slot_len;
+			pr_comm_started = true;
+			pr_clock->notify_all(pr_cond1);
+		}
+
+		void fill_slot(decltype(clock::now()) slot_end) {
+			/* Sends the queued frames one after the other, SIFS apart, each unicast one waiting for its ACK before
+			   the next one goes, as long as the exchange fits the rest of the slot. Without airtimes (pr_byte_time
+			   is 0) a single frame is sent and its ACK may come until the end of the slot. Frames not acked are
+			   sent again, in this slot if there is time left, until MAX_RETRIES. A frame whose exchange is longer than
+			   any comm slot we can get is dropped, or it would hold the queue forever. */
+			boost::unique_lock<boost::mutex> lock(pr_mu4);
+			int count_tx = 0;
+			long max_slot = pr_max_comm > 0 ? pr_max_comm : pr_comm_slot;
+
+			while(!pr_queue.empty()) {
+				tx_frame &f = pr_queue.front();
+				pmt::pmt_t cdr = pmt::cdr(f.frame);
+				mac_header *h = (mac_header*)pmt::blob_data(cdr);
+				bool broadcast = memcmp(h->addr1, pr_broadcast_addr, 6) == 0; // No ACK expected
+				long airtime = pmt::blob_length(cdr)*pr_byte_time;
+				long exchange = broadcast ? airtime : airtime + pr_ack_time;
+				decltype(clock::now()) now = pr_clock->now(), ack_deadline = slot_end;
+
+				if(pr_byte_time > 0) {
+					if(exchange > max_slot) {
+						pr_stats.inc(STAT_DROPS_OVERSIZE);
+						if(pr_debug) std::cout << "Frame does not fit a comm slot. Drop it!" << std::endl << std::flush;
+						pop_frame();
+						continue;
+					}
+					ack_deadline = now + std::chrono::microseconds(airtime + pr_ack_time);
+					if(now + std::chrono::microseconds(exchange) > slot_end) break; // Does not fit anymore
+				} else if(count_tx > 0) break;
+
+				pr_frame_seq_nr = h->seq_nr;
+				pr_frame_acked = false;
+				publish_held(msg_port_frame_to_phy, f.frame);
+				pr_stats.inc(STAT_TX_ATTEMPTS);
+				if(f.count_tx > 0) pr_stats.inc(STAT_RETRIES);
+				f.count_tx++;
+				count_tx++;
+				if(pr_debug) std::cout << "Transmitting frame for the " << f.count_tx << "th time." << std::endl << std::flush;
+
+				if(broadcast) {
+					if(pr_debug) std::cout << "Broadcast frame was sent!" << std::endl << std::flush;
+					pop_frame();
+					lock.unlock();
+					pr_clock->sleep_for(std::chrono::microseconds(airtime + pr_sifs));
+					lock.lock();
+					continue;
+				}
+
+				if(pr_clock->wait_until(lock, pr_cond3, ack_deadline, [this] { return pr_frame_acked; })) {
+					pop_frame();
+					lock.unlock();
+					pr_clock->sleep_for(std::chrono::microseconds(pr_sifs));
+					lock.lock();
+				} else if(f.count_tx >= MAX_RETRIES) {
+					pr_stats.inc(STAT_DROPS_RETRY_LIMIT);
+					if(pr_debug) std::cout << "Max number of retries exceeded. Drop frame!" << std::endl << std::flush;
+					pop_frame();
+				}
+			}
+		}
+
+		void pop_frame() {
+			// Called with pr_mu4 held
+			pr_queue.pop_front();
+			pr_status = !pr_queue.empty();
+			pr_frame_acked = false;
+			message_port_pub(msg_port_frame_request, pmt::from_long(1)); // Ready for the next frame
+		}
+
+		void scheduled_tx() {
+			// Sends the frames the message handlers left for later, each at its time
+			pmt::pmt_t frame;
+
+			pr_clock->attach();
+			while(true) {
+				if(pr_tx_schedule.pop(*pr_clock, frame)) {
+					publish_held(msg_port_frame_to_phy, frame);
+					if(pr_debug) std::cout << "Scheduled frame was sent!" << std::endl << std::flush;
+				} else {
+					if(pr_debug) std::cout << "Scheduled frame missed its slot. Drop it!" << std::endl << std::flush;
+				}
+			}
+		}
+
+		void frame_from_phy(pmt::pmt_t frame) {
+			mac_clock::scoped_release release(*pr_clock); // Held by the sender, see publish_held()
+			pmt::pmt_t cdr = pmt::cdr(frame);
+			mac_header *h = (mac_header*)pmt::blob_data(cdr);
+
+			int is_broadcast = memcmp(h->addr1, pr_broadcast_addr, 6); // 0 if equal (is_broadcast is TRUE)
+			int is_mine = memcmp(h->addr1, pr_mac_addr, 6); // 0 if equal (is_mine is TRUE)
+
+			if(is_mine != 0 and is_broadcast != 0) {
+				if(pr_debug) std::cout << "This frame is not for me. Drop it!" << std::endl << std::flush;
+				return;
+			}
+
+			switch(h->frame_control) {
+				case FC_DATA: { // Data frame
+					if(is_mine == 0) {
+						if(pr_debug) std::cout << "Data frame belongs to me. Ack sent!" << std::endl << std::flush;
+						pmt::pmt_t ack = generate_ack_frame(frame);
+						publish_held(msg_port_frame_to_phy, ack);
+						pr_stats.inc(STAT_ACKS_SENT);
+
+						// A retransmission (our ACK was lost) is acked again, but not delivered twice
+						if(pr_dup.is_duplicate(h->addr2, h->seq_nr, pr_clock->now())) {
+							pr_stats.inc(STAT_DUPLICATES);
+							if(pr_debug) std::cout << "Duplicate frame. Not delivered to app." << std::endl << std::flush;
+						} else {
+							message_port_pub(msg_port_frame_to_app, frame);
+							pr_stats.inc(STAT_RX_FRAMES);
+						}
+					}
+				} break;
+
+				case FC_ACK: { // ACK frame
+					if(is_mine == 0) {
+						if(pr_debug) std::cout << "ACK for me!" << std::endl << std::flush;
+
+						boost::unique_lock<boost::mutex> lock(pr_mu4);
+						if((h->seq_nr == pr_frame_seq_nr) and !pr_frame_acked and pr_status) { // This means I'm waiting for this ack (Right seq_nr, not acked yet and it has not been dropped).
+							pr_frame_acked = true;
+							pr_clock->notify_all(pr_cond3);
+							pr_stats.inc(STAT_ACKS_RECEIVED);
+							if(pr_debug) std::cout << "Frame was acked properly!" << std::endl << std::flush;
+						}
+					}
+				} break;
+
+				case FC_SYNC: { // SYNC frame
+					if(!pr_is_coord and is_broadcast == 0) { // Normal node. Coordinator handles this on sync_func.
+						// Beginning of super frame. After a long silence, the coordinator may have given our short ID away.
+						decltype(clock::now()) now = pr_clock->now();
+						if(now - pr_sync_time0 > std::chrono::microseconds(STATION_TIMEOUT)) {
+							pr_short_id = BEACON_NO_ID;
+							pr_reservation.reset();
+						}
+						pr_sync_time0 = now;
+						if(pr_debug) std::cout << "Beginning of super frame." << std::endl << std::flush;
+
+						// Identifying order for transmitting resp frame (and our short ID, if the SYNC carries it).
+						uint8_t *f = (uint8_t*)pmt::blob_data(cdr);
+						int msg_len = pmt::blob_length(cdr) - 24; // Strips header
+						size_t len = pr_sync_beacon.decode(f + 24, msg_len, pr_mac_addr, pr_short_id);
+						if(len == 0) {
+							if(pr_debug) std::cout << "Malformed SYNC frame." << std::endl << std::flush;
+							break;
+						}
+						pr_sync_time0 = beacon_time(frame, f + 24 + len, msg_len - (long)len, now);
+						if(pr_debug) std::cout << "SYNC taken at " << std::chrono::duration_cast<std::chrono::microseconds>(now - pr_sync_time0).count() << "us ago. Clock jitter = "
+							<< pr_sync_model.jitter() << "us, drift = " << pr_sync_model.drift()*1e6 << "ppm." << std::endl << std::flush;
+						int tx_order = pr_sync_beacon.position();
+						bool reserved = pr_reservation.left() > 0;
+						if(pr_reservation.sync(tx_order >= 0, pr_status)) break; // Our comm slot is reserved, nothing to answer
+						if(reserved and tx_order < 0 and pr_debug) std::cout << "Releasing reserved comm slot." << std::endl << std::flush;
+						if(tx_order == -1) tx_order = pr_sync_beacon.count(); // This means node is not listed. Therefore, it must transmit at the last alloc slot.
+
+						// Is there anything to transmit? Yes: request comm slot, no: send SKIP comm slot. Either tells our short ID
+						// and our backlog (frames, bytes), which sizes the comm slot. A REQ may reserve the slot for several superframes.
+						uint32_t frames, bytes;
+						std::vector<uint8_t> msdu;
+						backlog(frames, bytes);
+						beacon::put16(msdu, pr_short_id);
+						beacon::put16(msdu, frames);
+						beacon::put32(msdu, bytes);
+						msdu.push_back(pr_reservation.request(pr_status));
+						pmt::pmt_t resp_frame = generate_frame(msdu.data(), msdu.size(), pr_status ? FC_REQ : FC_SKIP, 0x0000, h->addr2);
+
+						// Sent at the beginning of the alloc slot by scheduled_tx(), never once the slot is over
+						long tx_time0 = pr_sync_time + tx_order*pr_alloc_slot;
+						pr_tx_schedule.push(*pr_clock, pr_sync_time0 + std::chrono::microseconds(tx_time0),
+							pr_sync_time0 + std::chrono::microseconds(tx_time0 + pr_alloc_slot), resp_frame);
+						if(pr_debug) std::cout << "REQ/SKIP scheduled at " << tx_time0 << "us. " << pr_sync_beacon.count() << " nodes are active on the network." << std::endl << std::flush;
+					}
+				} break;
+
+				case FC_REQ: { // Someone is requesting a slot allocation
+					if(pr_is_coord and is_mine == 0) {
+						if(pr_debug) std::cout << "A node has requested a comm slot" << std::endl << std::flush;
+						station_heard(h->addr2, true, cdr);
+					}
+				} break;
+
+				case FC_SKIP: { // Someone is skipping the slot allocation
+					if(pr_is_coord and is_mine == 0) {
+						if(pr_debug) std::cout << "A node has skipped a comm slot" << std::endl << std::flush;
+						station_heard(h->addr2, false, cdr);
+					}
+				} break;
+
+				case FC_ALLOC: { // This figures out which comm slot is allocated for this node.
+					if(!pr_is_coord and is_broadcast == 0) {
+						// Decoded even with nothing to send, as later ALLOCs may only refer to this one
+						uint8_t *f = (uint8_t*)pmt::blob_data(cdr);
+						int msg_len = pmt::blob_length(cdr) - 24; // Strips header
+						size_t len = pr_alloc_beacon.decode(f + 24, msg_len, pr_mac_addr, pr_short_id);
+						if(len == 0) break;
+						decltype(clock::now()) comm_time0 = beacon_time(frame, f + 24 + len, msg_len - (long)len, pr_clock->now());
+						pr_reservation.alloc(pr_alloc_beacon.position() >= 0); // Granted, along with the reservation we asked for
+						if(!pr_status) break;
+						if(pr_debug) std::cout << "ALLOC frame has arrived. Figuring out order." << std::endl << std::flush;
+
+						// Identifying order for transmitting resp frame.
+						int tx_order = pr_alloc_beacon.position();
+						if(tx_order >= 0) { // Beginning of Communication Interval
+							// Our comm slot, from the trailer after the set and the stamp
+							long slot_start, slot_len;
+							alloc_slot(f + 24 + len + SYNC_STAMP_LEN, msg_len - (long)len - SYNC_STAMP_LEN, pr_alloc_beacon.count(), tx_order, slot_start, slot_len);
+							start_comm(comm_time0, slot_start, slot_len);
+
+							if(pr_debug) std::cout << "COMM Slot was allocated. Node will be the " << tx_order << "th to transmit, at " << slot_start << "us for " << slot_len << "us." << std::endl << std::flush;
+						} else if (tx_order == -1) if(pr_debug) std::cout << "No COMM Slot allocated to me. Waiting for next super frame..." << std::endl << std::flush;
+					}
+				} break; 
+					
+				case FC_METRICS: {
+					if(is_mine) {
+						pmt::pmt_t ack = generate_ack_frame(frame);
+						publish_held(msg_port_frame_to_phy, ack);
+					}
+				} break;
+
+				case FC_PROTOCOL: { // Get the active protocol on network
+					// TODO
+				} break;
+
+				default: {
+					if(pr_debug) std::cout << "Unkown frame type." << std::endl << std::flush;
+					return;
+				}
+			}
+		}
+
+		decltype(clock::now()) beacon_time(pmt::pmt_t frame, const uint8_t *stamp, long len, decltype(clock::now()) handled) {
+			// Node: local time a SYNC/ALLOC was sent at, after the coordinator's stamp that follows the beacon and our model
+			// of its clock. Without a stamp, the time it was handled.
+			if(len < SYNC_STAMP_LEN) return handled;
+			return pr_sync_model.observe(beacon::get64(stamp), frame, handled);
+		}
+
+		void station_heard(const uint8_t *addr, bool request, pmt::pmt_t cdr) {
+			// Coordinator: REQ (request is true) or SKIP of a station during the allocation interval. It carries the
+			// short ID of the station and, except from older stations, its backlog (frames u16, bytes u32) and the number
+			// of superframes it wants the comm slot reserved for (u8, 0 for this one only). A SKIP releases a reservation.
+			const uint8_t *p = (const uint8_t*)pmt::blob_data(cdr) + 24;
+			long len = (long)pmt::blob_length(cdr) - 24;
+			uint16_t short_id = len >= 2 ? beacon::get16(p) : BEACON_NO_ID;
+
+			boost::unique_lock<boost::mutex> lock(pr_mu1);
+			int i = pr_stations.add(addr);
+			station &s = pr_stations[i];
+
+			s.last_seen = pr_clock->now();
+			s.confirmed = s.id != BEACON_NO_ID and short_id == s.id; // Otherwise the next SYNC tells it its short ID
+			if(s.heard == pr_interval) return; // Already answered this SYNC
+			s.heard = pr_interval;
+			s.demand = request ? 1 : 0;
+			s.demand_bytes = 0;
+			if(len >= 8 and request) {
+				s.demand = std::max(1, (int)beacon::get16(p + 2));
+				s.demand_bytes = beacon::get32(p + 4);
+			}
+			s.comm_slot = -1;
+
+			if(s.id == BEACON_NO_ID) return; // No short ID left, it can only use the alloc slot of new nodes
+			s.reserved_until = 0;
+			if(len >= 9 and request and p[8] > 1) {
+				s.reserved_until = pr_interval + std::min((int)p[8], RESERVE_MAX) - 1;
+				if(std::find(pr_reserved_ids.begin(), pr_reserved_ids.end(), s.id) == pr_reserved_ids.end()) pr_reserved_ids.push_back(s.id);
+			}
+			pr_heard.push_back(i);
+			if(request) pr_requested.push_back(i);
+		}
+
+		void station_ids(const std::vector<int> &stations, std::vector<uint16_t> &ids) {
+			// Coordinator, with pr_mu1 held: short IDs of the stations, in slot order (ascending)
+			ids.clear();
+			for(size_t k = 0; k < stations.size(); k++) ids.push_back(pr_stations[stations[k]].id);
+			std::sort(ids.begin(), ids.end());
+		}
+
+		long demand_time(uint32_t frames, uint32_t bytes) {
+			// Airtime (us) of a backlog, each frame with its ACK and SIFS. A station that did not tell its size gets a comm slot.
+			if(bytes == 0) return frames > 0 ? pr_comm_slot : 0;
+			return bytes*pr_byte_time + (long)frames*(pr_ack_time + pr_sifs);
+		}
+
+		void share_comm(const std::vector<long> &demand, std::vector<long> &len) {
+			/* Coordinator: comm slot lengths (us) for the demands, within pr_max_comm. Each one gets pr_min_slot (less if
+			   they don't all fit), then the rest is shared max-min fair: the smallest demands are met in full, the largest
+			   split what is left equally. Time nobody needs is not handed out, the superframe is shorter instead. */
+			size_t n = demand.size();
+			if(n == 0) {
+				len.clear();
+				return;
+			}
+			long min_slot = std::min((long)pr_min_slot, (long)pr_max_comm/(long)n);
+			long left = pr_max_comm - n*min_slot;
+			std::vector<size_t> order(n);
+
+			len.assign(n, min_slot);
+			for(size_t k = 0; k < n; k++) order[k] = k;
+			std::sort(order.begin(), order.end(), [&demand](size_t a, size_t b) { return demand[a] < demand[b]; });
+			for(size_t k = 0; k < n and left > 0; k++) {
+				long extra = std::min(std::max(0L, demand[order[k]] - min_slot), left/(long)(n - k));
+				len[order[k]] += extra;
+				left -= extra;
+			}
+		}
+
+		long put_alloc_slots(std::vector<uint8_t> &msdu, const std::vector<long> &slot_len, size_t n) {
+			// Coordinator: weighted ALLOC trailer for the first n comm slots, each one rounded up to ALLOC_SLOT_UNIT. Returns where the last one ends.
+			long end = 0;
+			msdu.push_back(ALLOC_WEIGHTED);
+			for(size_t k = 0; k < n; k++) {
+				end = (end + slot_len[k] + ALLOC_SLOT_UNIT - 1)/ALLOC_SLOT_UNIT*ALLOC_SLOT_UNIT;
+				beacon::put16(msdu, end/ALLOC_SLOT_UNIT);
+			}
+			return end;
+		}
+
+		void alloc_slot(const uint8_t *trailer, long len, int count, int pos, long &slot_start, long &slot_len) {
+			// Node: comm slot (us since the start of the comm interval) of the pos-th of count stations in an ALLOC, whose trailer
+			// is len bytes long. The coordinator may have sized it after our backlog, otherwise all are pr_comm_slot long.
+			if(len >= 1 + 2*count and trailer[0] == ALLOC_WEIGHTED) {
+				long start = pos > 0 ? beacon::get16(trailer + 1 + 2*(pos - 1)) : 0;
+				slot_start = start*ALLOC_SLOT_UNIT;
+				slot_len = (beacon::get16(trailer + 1 + 2*pos) - start)*ALLOC_SLOT_UNIT;
+			} else {
+				slot_start = pos*pr_comm_slot;
+				slot_len = pr_comm_slot;
+			}
+		}
+
+		void expire_stations() {
+			// Coordinator, with pr_mu1 held: forgets stations not heard for STATION_TIMEOUT, a few per superframe
+			decltype(clock::now()) now = pr_clock->now();
+
+			for(int k = 0; k < STATION_SWEEP and pr_stations.size() > 0; k++) {
+				if(pr_sweep >= pr_stations.size()) pr_sweep = 0;
+				station &s = pr_stations[pr_sweep];
+				if(now - s.last_seen > std::chrono::microseconds(STATION_TIMEOUT) and s.reserved_until < pr_interval) { // Reserved ones stay silent
+					if(pr_debug) std::cout << "Station timed out." << std::endl << std::flush;
+					pr_stations.remove(pr_sweep); // The last one takes its place, and is checked next
+				} else {
+					pr_sweep++;
+				}
+			}
+		}
+
+		void publish_held(pmt::pmt_t port, pmt::pmt_t msg) {
+			// Frames: under a virtual clock, time stands still until every receiver has handled msg
+			pr_clock->hold(pmt::length(message_subscribers(port)));
+			message_port_pub(port, msg);
+		}
+
+		pmt::pmt_t generate_ack_frame(pmt::pmt_t frame) {
+			mac_header *header = (mac_header*)pmt::blob_data(pmt::cdr(frame));
+
+			// Same as generate_frame(msdu, 0, FC_ACK, seq_nr, addr2), but only seq_nr and addr1 are patched on the prebuilt ACK.
+			pmt::pmt_t ack = pr_ack.build(header->addr2, pr_broadcast_addr, 0x0000, header->seq_nr);
+
+			if (pr_debug) std::cout << "Seq num of rx frame = " << header->seq_nr << std::endl;
+
+			return ack;
+		}
+
+		void sync_func() { // Only Coordinator
+			// This function dictates the beginning of all super frames. It sends the SYNC and ALLC messages
+			if(pr_debug) std::cout << "Starting SYNC Function, coordinator mode ON" << std::endl << std::flush;
+			
+			std::vector<uint8_t> msdu;
+			std::vector<uint16_t> ids;
+			std::vector<beacon_assoc> assocs;
+			std::vector<long> demand, slot_len;
+			uint32_t frames, bytes;
+			long own_start, own_len;
+			size_t stamp;
+			decltype(clock::now()) comm_time0;
+			int num_listed, num_active;
+			size_t num_reserved;
+			float waiting_time, elapsed_time;
+			pmt::pmt_t sync_frame, alloc_frame;
+			pr_clock->attach();
+			while(true) {
+				// Building the SYNC frame: stations heard during the last allocation interval, by short ID, and the
+				// short IDs of those that do not know theirs yet. Stations holding a reservation are left out, they stay
+				// silent until it ends, and then are listed to renew it.
+				boost::unique_lock<boost::mutex> lock(pr_mu1);
+				pr_heard.erase(std::remove_if(pr_heard.begin(), pr_heard.end(), [this](int i) { return pr_stations[i].reserved_until > pr_interval; }), pr_heard.end());
+				num_reserved = 0;
+				for(size_t k = 0; k < pr_reserved_ids.size(); k++) {
+					int i = pr_stations.find_id(pr_reserved_ids[k]);
+					if(i < 0) continue; // Timed out
+					if(pr_stations[i].reserved_until > pr_interval) pr_reserved_ids[num_reserved++] = pr_reserved_ids[k];
+					else if(pr_stations[i].heard != pr_interval) pr_heard.push_back(i); // Over, and not heard otherwise
+				}
+				pr_reserved_ids.resize(num_reserved);
+				station_ids(pr_heard, ids);
+				assocs.clear();
+				for(size_t k = 0; k < ids.size(); k++) {
+					station &st = pr_stations[pr_stations.find_id(ids[k])];
+					st.sync_pos = k;
+					if(!st.confirmed and assocs.size() < BEACON_MAX_ASSOC) {
+						assocs.push_back(beacon_assoc());
+						memcpy(assocs.back().addr, st.addr, 6);
+						assocs.back().id = st.id;
+					}
+				}
+				num_listed = ids.size();
+				pr_sync_encoder.encode(ids, assocs, msdu);
+				beacon::put64(msdu, 0); // Stamp, set when it goes
+
+				pr_heard.clear(); // Active nodes will report themselves during "waiting_time".
+				pr_requested.clear();
+				pr_interval++;
+				expire_stations();
+				lock.unlock();
+
+				// Sending SYNC Frame Control, stamped with our clock: nodes time the superframe after it
+				pr_sync_time0 = pr_clock->now(); // Beginning of Allocation Interval
+				beacon::set64(&msdu[msdu.size() - SYNC_STAMP_LEN], sync_model::us(pr_sync_time0));
+				sync_frame = generate_frame(msdu.data(), msdu.size(), FC_SYNC, 0x0000, pr_broadcast_addr);
+				publish_held(msg_port_frame_to_phy, sync_frame);
+
+				// Wait the end of allocation interval. +1 alloc slot is reserved for new nodes.
+				waiting_time = pr_sync_time + (num_listed + 1)*pr_alloc_slot;
+				if(pr_debug) std::cout << "pr_sync_time = " << pr_sync_time << ", listed nodes = " << num_listed << ", SYNC payload = " << msdu.size() << " bytes" << std::endl << std::flush;
+				pr_clock->spin_until(pr_sync_time0 + std::chrono::microseconds((long)waiting_time));
+				elapsed_time = (float) std::chrono::duration_cast<std::chrono::microseconds>(pr_clock->now() - pr_sync_time0).count();
+				if(pr_debug) std::cout << "SYN time (theory) = " << waiting_time << "us, SYN time (actual) = " << elapsed_time << "us." << std::endl << std::flush;
+
+				// Alloc interval is about to end. The last thing is to send the ordered list of stations that requested a comm slot.
+				lock.lock();
+				num_active = pr_heard.size();
+				if(pr_debug) std::cout << "Number of active nodes = " << num_active << ", number of requested comm slots = " << pr_requested.size() << ", reserved = " << pr_reserved_ids.size() << std::endl << std::flush;
+				station_ids(pr_requested, ids);
+				for(size_t k = 0; k < pr_reserved_ids.size(); k++) {
+					int i = pr_stations.find_id(pr_reserved_ids[k]);
+					if(i >= 0 and pr_stations[i].heard != pr_interval) ids.push_back(pr_reserved_ids[k]); // Not renewed nor released in this interval
+				}
+				std::sort(ids.begin(), ids.end());
+				for(size_t k = 0; k < ids.size(); k++) pr_stations[pr_stations.find_id(ids[k])].comm_slot = k;
+				assocs.clear();
+				pr_alloc_encoder.encode(ids, assocs, msdu);
+				stamp = msdu.size();
+				beacon::put64(msdu, 0);
+
+				if(pr_max_comm > 0) {
+					// Comm slots sized after the backlogs, ours (downlink) last if we have any. Their ends follow the set.
+					demand.clear();
+					for(size_t k = 0; k < ids.size(); k++) {
+						station &st = pr_stations[pr_stations.find_id(ids[k])];
+						demand.push_back(demand_time(st.demand, st.demand_bytes));
+					}
+					backlog(frames, bytes);
+					if(frames > 0) demand.push_back(demand_time(frames, bytes));
+					share_comm(demand, slot_len);
+
+					own_start = put_alloc_slots(msdu, slot_len, ids.size());
+					own_len = frames > 0 ? slot_len.back() : 0;
+				} else {
+					msdu.push_back(ALLOC_EQUAL);
+					own_start = ids.size()*pr_comm_slot; // Coordinator goes last, after every station in ALLOC, reserved ones included
+					own_len = pr_comm_slot;
+				}
+				lock.unlock();
+
+				// Beginning of Communication Interval
+				comm_time0 = pr_clock->now();
+				beacon::set64(&msdu[stamp], sync_model::us(comm_time0));
+				alloc_frame = generate_frame(msdu.data(), msdu.size(), FC_ALLOC, 0x0000, pr_broadcast_addr);
+				publish_held(msg_port_frame_to_phy, alloc_frame);
+
+				// TODO: check if coordinator has something to transmitting before allocating its comm slot
+				start_comm(comm_time0, own_start, own_len);
+				if(pr_debug) std::cout << "COMM Slot was allocated. Coordinator transmits at " << own_start << "us for " << own_len << "us." << std::endl << std::flush;
+				
+				// Wait before starting another super frame, which begins once the coordinator's comm slot (the last one) is over
+				waiting_time = own_start + own_len;
+				pr_clock->sleep_for(std::chrono::microseconds((long)waiting_time)); // It seems this one does not need too much accuracy. Use spin_until() if necessary.
+			}
+		}
+
+	pmt::pmt_t generate_frame(uint8_t *msdu, int msdu_size, uint16_t fc, uint16_t seq_nr, uint8_t *dst_addr) {
+		// Inputs: (data, data size, frame control, sequence number, destination address)
+		mac_header header;
+		header.frame_control = fc;
+		header.duration = 0x0000;
+		header.seq_nr = seq_nr;
+
+		memcpy(header.addr1, dst_addr, 6);
+		memcpy(header.addr2, pr_mac_addr, 6);
+		memcpy(header.addr3, pr_broadcast_addr, 6);
+
+		uint8_t psdu[1528];
+		memcpy(psdu, &header, 24); // Header is 24 bytes long
+		memcpy(psdu + 24, msdu, msdu_size); 
+
+		uint32_t fcs = crc32(psdu, 24 + msdu_size);
+
+		memcpy(psdu + 24 + msdu_size, &fcs, sizeof(uint32_t));
+
+		// Building frame from cdr & car
+		pmt::pmt_t frame = pmt::make_blob(psdu, 24 + msdu_size + sizeof(uint32_t));
+		pmt::pmt_t dict = pmt::make_dict();
+		dict = pmt::dict_add(dict, pmt::mp("crc_included"), pmt::PMT_T);
+
+		return pmt::cons(dict, frame);
+	}
+
+	private:
+		// Input parameters
+		int pr_slot_time;
+		bool pr_is_coord, pr_debug;
+
+		// Internal parameters & variables. Every time is in us of pr_clock: alpha stretches the slots (alpha*slot_time),
+		// while pr_byte_time and pr_sifs are PHY times, so a frame is weighed against a slot by its real airtime.
+		int pr_sync_time, pr_data_time, pr_ack_time, pr_alloc_slot, pr_comm_slot;
+		bool pr_status, pr_frame_acked, pr_comm_started;
+		double pr_byte_time; // Airtime of a byte (us), 0 if unknown
+		int pr_sifs;
+		int pr_max_comm, pr_min_slot; // Comm interval shared after the backlogs (us, 0 for equal comm slots), and the least comm slot
+
+		// Coordinator: known stations, and those that answered the current SYNC / requested a comm slot, in order of arrival
+		station_table pr_stations;
+		std::vector<int> pr_heard, pr_requested;
+		std::vector<uint16_t> pr_reserved_ids; // Short IDs of the stations holding a reservation
+		uint32_t pr_interval; // Allocation intervals so far
+		size_t pr_sweep; // Next station checked for timeout
+
+		// Coordinator: SYNC/ALLOC payloads
+		beacon_encoder pr_sync_encoder, pr_alloc_encoder;
+
+		// Node: own short ID, and the last SYNC and ALLOC sets
+		uint16_t pr_short_id;
+		beacon_decoder pr_sync_beacon, pr_alloc_beacon;
+		sync_model pr_sync_model; // The coordinator's clock, after the stamps of its SYNCs and ALLOCs
+		slot_reservation pr_reservation; // Node: our comm slot reservation, if any
+		decltype(clock::now()) pr_sync_time0, pr_comm_time0; // This times the beggining of SYNC frame
+		long pr_slot_start, pr_slot_len; // Own comm slot (us since pr_comm_time0). These, pr_comm_time0 and pr_comm_started are guarded by pr_mu2.
+		float pr_guard_time; // Accepted "error" time during transmission synchronization
+
+		// MAC addr
+		uint8_t pr_mac_addr[6], pr_broadcast_addr[6];
+
+		// Input ports
+		pmt::pmt_t msg_port_frame_from_buff = pmt::mp("frame from buffer");
+		pmt::pmt_t msg_port_frame_from_phy = pmt::mp("frame from phy");
+		pmt::pmt_t msg_port_stats_request = pmt::mp("stats request");
+		pmt::pmt_t msg_port_backlog_in = pmt::mp("backlog in");
+
+		// Output ports
+		pmt::pmt_t msg_port_frame_to_phy = pmt::mp("frame to phy");
+		pmt::pmt_t msg_port_frame_request = pmt::mp("frame request");
+		pmt::pmt_t msg_port_frame_to_app = pmt::mp("frame to app");
+		pmt::pmt_t msg_port_stats = pmt::mp("stats");
+
+		// Mutex & Threads & Cond variables
+		boost::mutex pr_mu1, pr_mu2, pr_mu4;
+		boost::condition_variable pr_cond1, pr_cond2, pr_cond3;
+		boost::shared_ptr<gr::thread::thread> thread_send_frame, thread_sync, thread_scheduled_tx;
+
+		// Control frames due at a given time (REQ/SKIP), sent by scheduled_tx()
+		tx_schedule pr_tx_schedule;
+
+		// Frames to be sent, the first one is in flight. pr_status tells whether there is any.
+		struct tx_frame {
+			pmt::pmt_t frame;
+			int count_tx;
+		};
+		std::deque<tx_frame> pr_queue;
+		size_t pr_queue_size;
+		size_t pr_buffered; // Frames waiting in frame buffer, as last reported
+		double pr_mean_len; // Mean size of the frames handed to us (bytes)
+
+		// Prebuilt ACK frame
+		ack_template pr_ack;
+
+		// Received (transmitter, seq_nr)
+		dup_cache pr_dup;
+		uint16_t pr_frame_seq_nr;
+
+		// Time source: real time unless the block was made with a virtual clock
+		mac_clock::sptr pr_clock;
+
+		mac_stats pr_stats{STAT_TX_ATTEMPTS, STAT_RETRIES, STAT_ACKS_RECEIVED, STAT_ACKS_SENT, STAT_RX_FRAMES, STAT_DUPLICATES,
+			STAT_DROPS_RETRY_LIMIT, STAT_DROPS_QUEUE_FULL, STAT_DROPS_OVERSIZE, STAT_QUEUE_HIGH_WATER};
+};
+
+#endif /* INCLUDED_MACPROTOCOLS_TDMA_IMPL_H */
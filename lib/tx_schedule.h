@@ -0,0 +1,113 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2018 André Gomes, UFMG - <andre.gomes@dcc.ufmg.br>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.	If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_MACPROTOCOLS_TX_SCHEDULE_H
+#define INCLUDED_MACPROTOCOLS_TX_SCHEDULE_H
+
+#include <macprotocols/mac_clock.h>
+#include <pmt/pmt.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <queue>
+#include <vector>
+#include <stdint.h>
+
+#define TX_SCHEDULE_EARLY 2000 // (us) The last stretch before a send time is left to mac_clock::spin_until()
+
+namespace gr {
+	namespace macprotocols {
+
+		/*
+		 * Frames waiting for a send time, e.g. the answer of a node to a SYNC, due at its allocation
+		 * slot. The message handler that builds such a frame pushes it and returns right away; a
+		 * transmit thread pops the frames in send time order and publishes them.
+		 *
+		 * A binary min-heap keyed by (send time, push order): frames due at the same time go out in
+		 * the order they were pushed. The popping thread waits on a condition variable until shortly
+		 * before the earliest send time, so a frame pushed meanwhile with an earlier one wakes it up,
+		 * and spins through the rest with the clock.
+		 */
+		class tx_schedule {
+			public:
+				tx_schedule() : d_next_order(0) {}
+
+				// Frame to be sent at t. It is dropped if it can only go out at deadline or later. clock: the one pop() waits on.
+				void push(mac_clock &clock, mac_clock::time_point t, mac_clock::time_point deadline, pmt::pmt_t frame) {
+					boost::unique_lock<boost::mutex> lock(d_mu);
+					d_heap.push(entry{t, deadline, d_next_order++, frame});
+					clock.notify_all(d_cond);
+				}
+
+				// Blocks until the earliest frame is due and hands it over. False if it missed its deadline.
+				bool pop(mac_clock &clock, pmt::pmt_t &frame) {
+					boost::unique_lock<boost::mutex> lock(d_mu);
+
+					while(true) {
+						clock.wait(lock, d_cond, [this] { return !d_heap.empty(); });
+						mac_clock::time_point t = d_heap.top().t;
+
+						if(clock.now() < t - std::chrono::microseconds(TX_SCHEDULE_EARLY)) {
+							// Woken up early by any frame pushed with an earlier send time
+							clock.wait_until(lock, d_cond, t - std::chrono::microseconds(TX_SCHEDULE_EARLY),
+								[this, t] { return d_heap.top().t < t; });
+							continue;
+						}
+
+						if(clock.now() < t) {
+							lock.unlock();
+							clock.spin_until(t);
+							lock.lock();
+							continue; // The top may have changed meanwhile, and it is due as well then
+						}
+
+						entry e = d_heap.top();
+						d_heap.pop();
+						frame = e.frame;
+						return clock.now() < e.deadline;
+					}
+				}
+
+				size_t size() {
+					boost::unique_lock<boost::mutex> lock(d_mu);
+					return d_heap.size();
+				}
+
+			private:
+				struct entry {
+					mac_clock::time_point t, deadline;
+					uint64_t order;
+					pmt::pmt_t frame;
+
+					// std::priority_queue keeps the largest on top
+					bool operator<(const entry &o) const {
+						return t != o.t ? t > o.t : order > o.order;
+					}
+				};
+
+				boost::mutex d_mu;
+				boost::condition_variable d_cond;
+				std::priority_queue<entry, std::vector<entry> > d_heap;
+				uint64_t d_next_order;
+		};
+
+	} // namespace macprotocols
+} // namespace gr
+
+#endif /* INCLUDED_MACPROTOCOLS_TX_SCHEDULE_H */
@@ -13,6 +13,7 @@
 #include "macprotocols/tdma.h"
 #include "macprotocols/myswitch.h"
 #include "macprotocols/naive_tdma.h"
+#include "macprotocols/channel_emulator.h"
 %}
 
 
@@ -26,3 +27,5 @@ GR_SWIG_BLOCK_MAGIC2(macprotocols, tdma);
 GR_SWIG_BLOCK_MAGIC2(macprotocols, myswitch);
 %include "macprotocols/naive_tdma.h"
 GR_SWIG_BLOCK_MAGIC2(macprotocols, naive_tdma);
+%include "macprotocols/channel_emulator.h"
+GR_SWIG_BLOCK_MAGIC2(macprotocols, channel_emulator);